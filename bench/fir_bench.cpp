@@ -0,0 +1,166 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// Speed of the convolution kernels of the Rate Converters at each instruction set level
+//  - Kernels:   dot products of the 8-bit path and of the 16 and 24-bit one, in GMAC/s, for growing filter lengths
+//  - Converter: stereo conversions of a Rate Converter running the kernels of each level, in multiples of real time
+// Every level is checked against the scalar kernels, the integer paths must be bit-exact
+// Fails if a level's output differs from the scalar one
+
+#define DOT_SAMPLES   4096      // Samples swept by the dot products, which stay in the caches
+#define BENCH_MACS    (1ll << 26)   // Multiply-accumulates of each timing of a kernel
+#define SPEED_SECONDS 2         // Length of the wave timed for each converter
+
+static const char* level_names[] = { "Scalar", "SSE4.1", "AVX2" };
+
+static const size_t tap_counts[] = { 8, 24, 64, 256 };
+
+// Factors and taps of the timed steps, non-integral, interpolation and decimation
+static const size_t converter_steps[][3] = { { 160, 147, 481 }, { 147, 160, 481 }, { 3, 2, 7 }, { 3, 1, 9 }, { 1, 3, 9 } };
+
+// Kernel of a table, called through the types of its coefficients and samples
+struct BenchKernel
+{   const char* name;           // Name of the samples
+    double (*run)(const FIRKernels* k, const void* coefs, const void* samples, size_t n);
+};
+
+static double run_u8(const FIRKernels* k, const void* coefs, const void* samples, size_t n)  { return k->dot_u8((const short*)coefs, (const uchar*)samples, n); }
+static double run_i32(const FIRKernels* k, const void* coefs, const void* samples, size_t n) { return (double)k->dot_i32((const int*)coefs, (const int*)samples, n); }
+
+static const BenchKernel bench_kernels[] =
+{   { "8-bit",  run_u8 },
+    { "16/24-bit", run_i32 },
+};
+
+// Speed of a kernel sliding its filter over the samples, in GMAC/s
+// The sums of the outputs are returned through "check", so the calls aren't optimised out
+static double measure_kernel(const BenchKernel &kernel, const FIRKernels* k, const void* coefs, const char* samples,
+                             size_t sample_size, size_t taps, double &check)
+{
+    size_t outputs = DOT_SAMPLES - taps;
+    size_t runs = (size_t)(BENCH_MACS / (outputs * taps)) + 1;
+
+    double best = 1e9;
+    for(int run = 0; run < 3; run++)
+    {   double sum = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t r = 0; r < runs; r++)
+        {   for(size_t i = 0; i < outputs; i++)
+            {   sum += kernel.run(k, coefs, samples + i * sample_size, taps);
+            }
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = secs < best ? secs : best;
+        check = sum;
+    }
+
+    return (double)outputs * taps * runs / best / 1e9;
+}
+
+// Converts a stereo 16-bit wave at 48kHz through a step running the kernels of a level, in 10ms buffers
+// as the nodes of the sources are, and returns its speed in multiples of real time, the output is left in dst
+static double measure_converter(const size_t* step, const FIRKernels* k, const std::vector<short> &src, std::vector<short> &dst)
+{
+    size_t blocks = src.size() / 2, max_input = 480;
+    dst.assign((blocks * step[0] / step[1] + 16) * 2, 0);
+
+    double best = 1e9;
+    for(int run = 0; run < 3; run++)
+    {   RateConverter cnv(step[0], step[1], step[2], 2, _Int16);
+        cnv.kernels = k;
+
+        short* out = &dst[0];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t done = 0; done < blocks; done += max_input)
+        {   size_t count = blocks - done < max_input ? blocks - done : max_input;
+            out += 2 * convert_sample_rate(&src[done * 2], out, count, cnv);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = secs < best ? secs : best;
+    }
+
+    return SPEED_SECONDS / best;
+}
+
+int main()
+{
+    int levels = detect_simd_level() + 1;
+    int failures = 0;
+
+    // Samples of scattered bits, and coefficients small enough that the longest 8-bit sums don't overflow
+    std::vector<char> samples(DOT_SAMPLES * 4);
+    std::vector<short> coefs16(DOT_SAMPLES);
+    std::vector<int> coefs32(DOT_SAMPLES);
+    for(size_t i = 0; i < samples.size(); i++)
+    {   samples[i] = (char)((i * 2654435761u) >> 13);
+    }
+    for(size_t i = 0; i < DOT_SAMPLES; i++)
+    {   coefs16[i] = (short)((int)(i * 2246822519u) >> 24);
+        coefs32[i] = (int)(i * 2246822519u) >> 6;
+    }
+
+    // 16 and 24-bit samples are widened to 32 bits, so they are kept within 24 bits here
+    int* samples32 = (int*)&samples[0];
+    for(size_t i = 0; i < DOT_SAMPLES; i++)
+    {   samples32[i] >>= 8;
+    }
+
+    printf("%-10s %6s", "Samples", "Taps");
+    for(int level = 0; level < levels; level++)
+    {   printf(" %9s GMAC/s", level_names[level]);
+    }
+    printf("\n");
+
+    size_t sizes[] = { 1, 4 };
+    for(size_t b = 0; b < sizeof(bench_kernels) / sizeof(bench_kernels[0]); b++)
+    {   const void* coefs = b == 1 ? (const void*)&coefs32[0] : (const void*)&coefs16[0];
+
+        for(size_t t = 0; t < sizeof(tap_counts) / sizeof(tap_counts[0]); t++)
+        {   printf("%-10s %6zu", bench_kernels[b].name, tap_counts[t]);
+
+            double expected = 0;
+            for(int level = 0; level < levels; level++)
+            {   double check;
+                double speed = measure_kernel(bench_kernels[b], get_fir_kernels((SIMDLevel)level), coefs, &samples[0], sizes[b], tap_counts[t], check);
+                expected = level == 0 ? check : expected;
+
+                printf(" %16.2f%s", speed, check != expected ? " (differs)" : "");
+                failures += check != expected;
+            }
+            printf("\n");
+        }
+    }
+
+    // Converters of stereo 16-bit samples, whose outputs must match the scalar ones byte for byte
+    std::vector<short> src(48000 * SPEED_SECONDS * 2);
+    for(size_t i = 0; i < src.size(); i++)
+    {   src[i] = (short)((i * 2654435761u) >> 16);
+    }
+
+    printf("\n%-10s %6s", "Step", "Taps");
+    for(int level = 0; level < levels; level++)
+    {   printf(" %9s x real", level_names[level]);
+    }
+    printf("\n");
+
+    for(size_t s = 0; s < sizeof(converter_steps) / sizeof(converter_steps[0]); s++)
+    {   char name[16];
+        snprintf(name, sizeof(name), "%zu/%zu", converter_steps[s][0], converter_steps[s][1]);
+        printf("%-10s %6zu", name, converter_steps[s][2]);
+
+        std::vector<short> scalar, output;
+        for(int level = 0; level < levels; level++)
+        {   double speed = measure_converter(converter_steps[s], get_fir_kernels((SIMDLevel)level), src, level == 0 ? scalar : output);
+            bool differs = level != 0 && output != scalar;
+
+            printf(" %16.0f%s", speed, differs ? " (differs)" : "");
+            failures += differs;
+        }
+        printf("\n");
+    }
+
+    return failures != 0;
+}
@@ -0,0 +1,173 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+// Speed of the Rate Converters specialised at compile time against the generic ones, for the steps FormatConverter
+// plans for the most common conversions in the Standard tier, the half-band stages have kernels of their own
+// Both convert the same wave in 10ms buffers, in multiples of real time, and must output the same integer samples,
+// the float ones only differ by the order of the additions of the SIMD kernels, within FLOAT_TOLERANCE
+// Fails if a specialised converter's output differs from the generic one, or if a step of the conversions
+// runs the generic path or the windowed-sinc resampler
+
+#define SPEED_SECONDS   4       // Length of the wave timed for each converter
+#define FLOAT_TOLERANCE 1e-6    // Largest difference of the float outputs, relative to full scale
+
+static const long rate_pairs[][2] = { { 16000, 48000 }, { 8000, 48000 }, { 48000, 16000 }, { 44100, 48000 }, { 48000, 44100 } };
+
+// Step of a cascade
+struct BenchStep
+{   size_t L, M, taps;          // Factors and taps of the step
+    long in_rate;               // Sampling rate of its input
+    FIRWindow window;           // Window of its filters
+    int cutoff;                 // Cutoff of its filters, in thousandths of the Nyquist frequency
+};
+
+// Formats of the timed conversions
+struct BenchFormat
+{   const char* name;           // Name of the format
+    SampleType type;            // Type of the samples
+    size_t channels;            // Number of channels
+};
+
+static const BenchFormat bench_formats[] =
+{   { "16-bit mono",   _Int16, 1 },
+    { "16-bit stereo", _Int16, 2 },
+    { "float stereo",  _Float, 2 },
+};
+
+// Converts n blocks of a type through a converter
+static int convert_blocks(const char* src, char* dst, size_t blocks, SampleType type, RateConverter &cnv)
+{
+    if(type == _Float)
+    {   return convert_sample_rate((const float*)src, (float*)dst, blocks, cnv);
+    }
+
+    return convert_sample_rate((const short*)src, (short*)dst, blocks, cnv);
+}
+
+// Converts the wave through a step, specialised or generic, and returns its speed in multiples of real time
+// The output is left in dst
+static double measure_step(const BenchStep &step, const BenchFormat &format, bool fixed, const std::vector<char> &src, std::vector<char> &dst)
+{
+    size_t block     = format.channels * (format.type == _Float ? 4 : 2);
+    size_t blocks    = step.in_rate * SPEED_SECONDS;
+    size_t max_input = step.in_rate / 100;
+    dst.assign((blocks * step.L / step.M + 16) * block, 0);
+
+    double best = 1e9;
+    for(int run = 0; run < 3; run++)
+    {   RateConverter cnv(step.L, step.M, step.taps, format.channels, format.type, step.window, step.cutoff);
+        cnv.fixed_kernel = fixed ? find_fixed_kernel(step.L, step.M, step.taps, step.window, step.cutoff, format.type) : NULL;
+
+        char* out = &dst[0];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t done = 0; done < blocks; done += max_input)
+        {   size_t count = blocks - done < max_input ? blocks - done : max_input;
+            out += block * convert_blocks(&src[done * block], out, count, format.type, cnv);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = secs < best ? secs : best;
+    }
+
+    return SPEED_SECONDS / best;
+}
+
+// Compares the outputs of the generic and specialised converters
+static bool same_output(const std::vector<char> &generic, const std::vector<char> &fixed, SampleType type)
+{
+    if(type != _Float)
+    {   return generic == fixed;
+    }
+
+    const float* a = (const float*)&generic[0];
+    const float* b = (const float*)&fixed[0];
+    for(size_t i = 0; i < generic.size() / sizeof(float); i++)
+    {   if(fabs(a[i] - b[i]) > FLOAT_TOLERANCE)
+        {   return false;
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    const QualityPreset &preset = get_quality_preset(Quality_Standard);
+    int failures = 0;
+
+    // Steps of the cascades, the half-band stages have their own kernels
+    std::vector<BenchStep> steps;
+    for(size_t p = 0; p < sizeof(rate_pairs) / sizeof(rate_pairs[0]); p++)
+    {   const ConversionPlan* plan = acquire_conversion_plan(makeWaveFmt(2, 16, rate_pairs[p][0]), makeWaveFmt(2, 16, rate_pairs[p][1]));
+        double rate = rate_pairs[p][0];
+        for(int i = 0; i < plan->step_count; i++)
+        {   BenchStep step = { (size_t)plan->steps[i].L, (size_t)plan->steps[i].M, (size_t)plan->taps[i], (long)rate, preset.window, plan->cutoffs[i] };
+            rate = rate * step.L / step.M;
+
+            bool listed = false;
+            for(size_t s = 0; s < steps.size(); s++)
+            {   listed = listed || (steps[s].L == step.L && steps[s].M == step.M && steps[s].taps == step.taps && steps[s].cutoff == step.cutoff);
+            }
+
+            if(plan->half_band[i])
+            {   continue;
+            }
+
+            if(find_fixed_kernel(step.L, step.M, step.taps, step.window, step.cutoff, _Int16) != NULL)
+            {   if(!listed)
+                {   steps.push_back(step);
+                }
+            }
+            else
+            {   printf("%5ld -> %-5ld step %zu/%zu, %zu taps, cutoff %d: generic\n", rate_pairs[p][0], rate_pairs[p][1],
+                       step.L, step.M, step.taps, step.cutoff);
+                failures++;
+            }
+        }
+
+        if(plan->resample)
+        {   printf("%5ld -> %-5ld windowed-sinc resampler\n", rate_pairs[p][0], rate_pairs[p][1]);
+            failures++;
+        }
+        release_conversion_plan(plan);
+    }
+
+    // Largest wave of all the steps, of scattered 16-bit samples and of float samples within [-0.5, 0.5]
+    std::vector<char> src16(48000 * SPEED_SECONDS * 4), src32(48000 * SPEED_SECONDS * 8);
+    for(size_t i = 0; i < src16.size() / 2; i++)
+    {   ((short*)&src16[0])[i] = (short)((i * 2654435761u) >> 16);
+    }
+    for(size_t i = 0; i < src32.size() / 4; i++)
+    {   ((float*)&src32[0])[i] = (float)((int)(i * 2654435761u) >> 8) / (1 << 24);
+    }
+
+    printf("\n%-15s %-8s %6s %14s %14s %8s\n", "Format", "Step", "Taps", "Generic x real", "Fixed x real", "Gain");
+
+    for(size_t f = 0; f < sizeof(bench_formats) / sizeof(bench_formats[0]); f++)
+    {   for(size_t s = 0; s < steps.size(); s++)
+        {
+            // Float decimations stay on the SIMD kernels of the generic path
+            if(find_fixed_kernel(steps[s].L, steps[s].M, steps[s].taps, steps[s].window, steps[s].cutoff, bench_formats[f].type) == NULL)
+            {   continue;
+            }
+
+            const std::vector<char> &src = bench_formats[f].type == _Float ? src32 : src16;
+            std::vector<char> generic, fixed;
+            double generic_speed = measure_step(steps[s], bench_formats[f], false, src, generic);
+            double fixed_speed   = measure_step(steps[s], bench_formats[f], true, src, fixed);
+            bool differs = !same_output(generic, fixed, bench_formats[f].type);
+
+            char name[16];
+            snprintf(name, sizeof(name), "%zu/%zu", steps[s].L, steps[s].M);
+            printf("%-15s %-8s %6zu %14.0f %14.0f %7.2fx%s\n", bench_formats[f].name, name, steps[s].taps,
+                   generic_speed, fixed_speed, fixed_speed / generic_speed, differs ? "  differs from generic" : "");
+
+            failures += differs;
+        }
+    }
+
+    return failures != 0;
+}
@@ -0,0 +1,121 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// Speed of the channel and bit depth conversion kernels at each instruction set level
+//  - In cache: conversions of a 10ms stereo buffer, as the nodes of the output convert them
+//  - Memory:   conversions of a wave much larger than the caches
+// Speeds are in GB/s of samples read and written, and every level is checked against the scalar kernels
+// Fails if a level's output differs from the scalar one
+
+#define CACHE_BLOCKS  480               // Blocks of a 10ms buffer at 48kHz
+#define MEMORY_BYTES  (128 << 20)       // Bytes of the largest side of a wave larger than the caches
+#define BENCH_BYTES   (1ll << 31)       // Bytes moved by each timing, spread over repeated conversions
+
+static const char* level_names[] = { "Scalar", "SSE4.1", "AVX2" };
+
+// Kernel of a table, called through the sizes of its samples
+struct BenchKernel
+{   const char* name;           // Name of the conversion
+    size_t in_size;             // Bytes read for each block
+    size_t out_size;            // Bytes written for each block
+    void (*run)(const FormatKernels* k, const char* src, char* dst, size_t blocks);
+};
+
+// Calls of each kernel of a table
+#define BENCH_CALL(name, field, S, D) \
+    static void name(const FormatKernels* k, const char* src, char* dst, size_t n) { k->field((const S*)src, (D*)dst, n); }
+
+BENCH_CALL(run_u8_to_i16, u8_to_i16, uchar, short)
+BENCH_CALL(run_i16_to_u8, i16_to_u8, short, uchar)
+BENCH_CALL(run_dup_u8,    dup_u8,    uchar, uchar)
+BENCH_CALL(run_dup_i16,   dup_i16,   short, short)
+BENCH_CALL(run_dup_i32,   dup_i32,   int,   int)
+BENCH_CALL(run_avg_u8,    avg_u8,    uchar, uchar)
+BENCH_CALL(run_avg_i16,   avg_i16,   short, short)
+BENCH_CALL(run_avg_i32,   avg_i32,   int,   int)
+BENCH_CALL(run_avg_f32,   avg_f32,   float, float)
+
+// Mixes through a matrix of equal gains, the kernels take the same time whatever their values
+static float mix_gains[MIX_CHANNELS * MIX_CHANNELS];
+
+#define BENCH_MIX(name, in, out) \
+    static void name(const FormatKernels* k, const char* src, char* dst, size_t n) { k->mix_f32((const float*)src, (float*)dst, mix_gains, in, out, n); }
+
+BENCH_MIX(run_mix_6_2, 6, 2)
+BENCH_MIX(run_mix_8_2, 8, 2)
+BENCH_MIX(run_mix_8_6, 8, 6)
+
+static const BenchKernel bench_kernels[] =
+{   { "8 to 16-bit",       1, 2, run_u8_to_i16 },
+    { "16 to 8-bit",       2, 1, run_i16_to_u8 },
+    { "mono to stereo 8",  1, 2, run_dup_u8 },
+    { "mono to stereo 16", 2, 4, run_dup_i16 },
+    { "mono to stereo 32", 4, 8, run_dup_i32 },
+    { "stereo to mono 8",  2, 1, run_avg_u8 },
+    { "stereo to mono 16", 4, 2, run_avg_i16 },
+    { "stereo to mono 32", 8, 4, run_avg_i32 },
+    { "stereo to mono f",  8, 4, run_avg_f32 },
+    { "5.1 to stereo f",  24, 8, run_mix_6_2 },
+    { "7.1 to stereo f",  32, 8, run_mix_8_2 },
+    { "7.1 to 5.1 f",     32, 24, run_mix_8_6 },
+};
+
+// Speed of a kernel converting buffers of n blocks, in GB/s
+static double measure_kernel(const BenchKernel &kernel, const FormatKernels* k, const char* src, char* dst, size_t blocks)
+{
+    size_t bytes = blocks * (kernel.in_size + kernel.out_size);
+    size_t runs = (size_t)(BENCH_BYTES / bytes) + 1;
+
+    double best = 1e9;
+    for(int run = 0; run < 3; run++)
+    {   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < runs; i++)
+        {   kernel.run(k, src, dst, blocks);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = secs < best ? secs : best;
+    }
+
+    return (double)bytes * runs / best / 1e9;
+}
+
+int main()
+{
+    int levels = detect_simd_level() + 1;
+    int failures = 0;
+
+    // Floats within [-2, 2] of scattered bits, whose bytes are just as scattered for the integer kernels
+    std::vector<char> src(MEMORY_BYTES + 64), dst(MEMORY_BYTES + 64), check(CACHE_BLOCKS * 32 + 64);
+    float* floats = (float*)&src[0];
+    for(size_t i = 0; i < src.size() / sizeof(float); i++)
+    {   floats[i] = (float)((int)(i * 2654435761u) >> 8) / (1 << 22);
+    }
+
+    printf("%-18s %-8s %14s %14s\n", "Kernel", "Level", "In cache GB/s", "Memory GB/s");
+
+    for(size_t b = 0; b < sizeof(bench_kernels) / sizeof(bench_kernels[0]); b++)
+    {
+        const BenchKernel &kernel = bench_kernels[b];
+
+        // Odd counts and offsets, so the tails and the unaligned accesses are checked too
+        kernel.run(get_format_kernels(SIMD_Scalar), &src[1], &check[0], CACHE_BLOCKS + 7);
+
+        for(int level = 0; level < levels; level++)
+        {   const FormatKernels* k = get_format_kernels((SIMDLevel)level);
+
+            kernel.run(k, &src[1], &dst[0], CACHE_BLOCKS + 7);
+            bool differs = memcmp(&dst[0], &check[0], (CACHE_BLOCKS + 7) * kernel.out_size) != 0;
+
+            double cached = measure_kernel(kernel, k, &src[0], &dst[0], CACHE_BLOCKS);
+            double memory = measure_kernel(kernel, k, &src[0], &dst[0], MEMORY_BYTES / (kernel.in_size > kernel.out_size ? kernel.in_size : kernel.out_size));
+            printf("%-18s %-8s %14.2f %14.2f%s\n", kernel.name, level_names[level], cached, memory, differs ? "  differs from scalar" : "");
+
+            failures += differs;
+        }
+    }
+
+    return failures != 0;
+}
@@ -0,0 +1,190 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// Cost of the cascades planned by plan_scaling_factors against the ones of optimize_scaling_factors,
+// for every pair of rates the output devices support, in every quality tier, the conversions the
+// windowed-sinc resampler takes are only counted
+//  - Estimated: multiply-accumulates per second of output of a channel, from estimate_cascade_cost
+//  - Measured:  stereo 16-bit conversion time of the cascade, in milliseconds per second of output
+// Fails if a cascade is estimated to cost more than the one it replaces, or if the total measured time grows
+// Run with -v to print every conversion
+
+#define SPEED_SECONDS 2     // Length of the wave timed for each cascade
+#define TIME_MARGIN   1.05  // Measured times within this ratio of each other are noise
+
+// Rates of the output devices, FrequencyList in AudioOutput.cpp
+static const long device_rates[] = { 8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000 };
+
+// Cascade planned by the previous heuristic, which pairs the largest factors of L with factors of M
+static int plan_greedy(scale* scales, long in_rate, long out_rate)
+{
+    int in_fsize  = get_prime_factors(in_rate, NULL);
+    int out_fsize = get_prime_factors(out_rate, NULL);
+    std::vector<factor> in_factors(in_fsize), out_factors(out_fsize);
+    get_prime_factors(in_rate, &in_factors[0]);
+    get_prime_factors(out_rate, &out_factors[0]);
+
+    remove_common_factors(&out_factors[0], out_fsize, &in_factors[0], in_fsize);
+
+    int S_size = 0;
+    optimize_scaling_factors(scales, S_size, &out_factors[0], out_fsize, &in_factors[0], in_fsize);
+    return S_size;
+}
+
+// Lowest rate output by the steps of a cascade, relative to the lower of the input and output rates
+static double lowest_rate(const scale* scales, int S_size, long in_rate, long out_rate)
+{
+    double rate = in_rate, lowest = in_rate;
+    for(int i = 0; i < S_size; i++)
+    {   rate *= (double)scales[i].L / scales[i].M;
+        lowest = rate < lowest ? rate : lowest;
+    }
+
+    return lowest / (in_rate < out_rate ? in_rate : out_rate);
+}
+
+// Time of a stereo 16-bit conversion through a cascade, in milliseconds per second of output
+static double measure_cascade(const scale* scales, int S_size, long in_rate, ResampleQuality quality)
+{
+    const QualityPreset &preset = get_quality_preset(quality);
+
+    // Converters and buffers set up as FormatConverter does
+    std::vector<RateConverter> steps(S_size);
+    std::vector< std::vector<short> > buffers(S_size);
+    size_t max_input = in_rate / 100 + 1, size = max_input;
+    double rate = in_rate, next_rate;
+    for(int i = 0; i < S_size; i++)
+    {   bool half_band;
+        int cutoff;
+        double output_taps;
+        next_rate = rate * scales[i].L / scales[i].M;
+        int taps = size_cascade_step(scales[i], quality, (rate < in_rate ? rate : in_rate) / next_rate, half_band, cutoff, output_taps);
+        rate = next_rate;
+
+        steps[i].init(scales[i].L, scales[i].M, taps, 2, _Int16, preset.window, cutoff, half_band);
+        if(!half_band)
+        {   steps[i].fixed_kernel = find_fixed_kernel(scales[i].L, scales[i].M, taps, preset.window, cutoff, _Int16);
+        }
+
+        size = size * scales[i].L / scales[i].M + 1;
+        buffers[i].resize(size * 2);
+    }
+
+    size_t blocks = in_rate * SPEED_SECONDS;
+    std::vector<short> src(blocks * 2);
+    unsigned seed = 1;
+    for(size_t i = 0; i < src.size(); i++)
+    {   seed = seed * 1103515245 + 12345;
+        src[i] = (short)(seed >> 16);
+    }
+
+    double best = 1e9;
+    for(int run = 0; run < 3; run++)
+    {   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t done = 0; done < blocks; done += max_input)
+        {   const short* in = &src[done * 2];
+            size_t count = blocks - done < max_input ? blocks - done : max_input;
+            for(int i = 0; i < S_size; i++)
+            {   count = convert_sample_rate(in, &buffers[i][0], count, steps[i]);
+                in = &buffers[i][0];
+            }
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = secs < best ? secs : best;
+    }
+
+    return 1000 * best / SPEED_SECONDS;
+}
+
+// Writes the steps of a cascade
+static void print_steps(const scale* scales, int S_size)
+{
+    char text[64] = "";
+    for(int i = 0; i < S_size; i++)
+    {   snprintf(text + strlen(text), sizeof(text) - strlen(text), "%s%d/%d", i ? " " : "", scales[i].L, scales[i].M);
+    }
+    printf(" %-22s", text);
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    int rate_count = sizeof(device_rates) / sizeof(device_rates[0]);
+    int failures = 0;
+
+    printf("%-10s %9s %8s %14s %14s %14s %14s %8s\n", "Tier", "Resampler", "Changed", "Greedy (MMAC)", "Planned (MMAC)", "Greedy (ms)", "Planned (ms)", "Worse");
+
+    for(int q = Quality_Fast; q <= Quality_Archival; q++)
+    {
+        ResampleQuality quality = (ResampleQuality)q;
+        double greedy_macs = 0, planned_macs = 0, greedy_time = 0, planned_time = 0;
+        int resampled = 0, changed = 0, worse = 0;
+
+        for(int a = 0; a < rate_count; a++)
+        {   for(int b = 0; b < rate_count; b++)
+            {
+                long in_rate = device_rates[a], out_rate = device_rates[b];
+                if(in_rate == out_rate)
+                {   continue;
+                }
+
+                scale greedy[32], planned[32];
+                int greedy_size = plan_greedy(greedy, in_rate, out_rate);
+                const ConversionPlan* plan = acquire_conversion_plan(makeWaveFmt(2, 16, in_rate), makeWaveFmt(2, 16, out_rate), quality);
+                int planned_size = plan->resample ? 0 : plan->step_count;
+                memcpy(planned, plan->steps, planned_size * sizeof(scale));
+                release_conversion_plan(plan);
+
+                if(planned_size == 0)
+                {   if(verbose)
+                    {   printf("  %-9s %5ld -> %-5ld", get_quality_preset(quality).name, in_rate, out_rate);
+                        print_steps(greedy, greedy_size);
+                        printf(" %-22s\n", "resampler");
+                    }
+                    resampled++;
+                    continue;
+                }
+
+                double g_macs = estimate_cascade_cost(greedy, greedy_size, in_rate, quality);
+                double p_macs = estimate_cascade_cost(planned, planned_size, in_rate, quality);
+                bool same = greedy_size == planned_size && memcmp(greedy, planned, greedy_size * sizeof(scale)) == 0;
+
+                double g_time = measure_cascade(greedy, greedy_size, in_rate, quality);
+                double p_time = same ? g_time : measure_cascade(planned, planned_size, in_rate, quality);
+
+                // The heuristic may drop below the band of the signal, which the planner doesn't allow
+                bool estimate_worse = p_macs > g_macs * (1 + 1e-9) && lowest_rate(greedy, greedy_size, in_rate, out_rate) >= 1 - 1e-9;
+                bool time_worse = p_time > g_time * TIME_MARGIN;
+
+                if(verbose || estimate_worse)
+                {   printf("  %-9s %5ld -> %-5ld", get_quality_preset(quality).name, in_rate, out_rate);
+                    print_steps(greedy, greedy_size);
+                    print_steps(planned, planned_size);
+                    printf(" %8.2f %8.2f MMAC %8.2f %8.2f ms%s\n", g_macs / 1e6, p_macs / 1e6, g_time, p_time,
+                           estimate_worse ? "  estimate regressed" : time_worse ? "  slower" : "");
+                }
+
+                failures += estimate_worse;
+                changed  += !same;
+                worse    += time_worse;
+                greedy_macs  += g_macs / 1e6;
+                planned_macs += p_macs / 1e6;
+                greedy_time  += g_time;
+                planned_time += p_time;
+            }
+        }
+
+        printf("%-10s %9d %8d %14.1f %14.1f %14.1f %14.1f %8d\n", get_quality_preset(quality).name, resampled, changed,
+               greedy_macs, planned_macs, greedy_time, planned_time, worse);
+
+        if(planned_time > greedy_time * TIME_MARGIN)
+        {   printf("  %s: the planned cascades are slower in total\n", get_quality_preset(quality).name);
+            failures++;
+        }
+    }
+
+    return failures != 0;
+}
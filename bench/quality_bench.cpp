@@ -0,0 +1,259 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+// Speed and quality of the resampling tiers over common conversions
+//  - MACs/sample: multiply-accumulates of each output sample of a channel
+//  - Throughput:  stereo 16-bit conversion speed, in multiples of real time
+//  - Stopband:    worst attenuation of the images and aliases of test tones,
+//                 measured on 32-bit float samples so quantization doesn't mask them
+//  - 16-bit SNR:  worst signal to noise ratio of a tone converted as 16-bit samples, rounding included
+// Run with -v to print every conversion
+// Fails if a tier's worst stopband attenuation or SNR falls below its floors, the ones its preset is designed for,
+// or if a tier doesn't cost more MACs than the tier below it and measure better on both, short of the 16-bit SNR ceiling
+
+#define TONE_SECONDS  0.5   // Length of each test tone
+#define SPEED_SECONDS 10    // Length of the wave timed for the throughput
+#define TONE_COUNT    8     // Tones tested in the passband and in the stopband
+#define SNR_TONE      1000  // Frequency of the tone of the 16-bit signal to noise ratio
+#define SNR_AMPLITUDE 0.9   // Amplitude of that tone, as a fraction of full scale
+#define SNR_CEILING   94.0  // SNR of an exact conversion of that tone, whose input and output roundings add up
+
+// Lowest worst attenuation of each tier, in dB
+static const double stopband_floors[] = { 25, 45, 60, 100, 110 };
+
+// Lowest worst 16-bit signal to noise ratio of each tier, in dB
+static const double snr_floors[] = { 45, 80, 88, 90, 90 };
+
+static const long rate_pairs[][2] =
+{   { 44100, 48000 }, { 48000, 44100 }, { 48000, 16000 },
+    { 16000, 48000 }, {  8000, 44100 }, { 96000, 44100 },
+    { 48000, 24000 }, {  8000, 16000 }, {  8000, 48000 },
+};
+
+// Multiply-accumulates of each output sample of a channel
+static double macs_per_sample(const FormatConverter &cnv)
+{
+    if(cnv.resampler != NULL)
+    {   return 2.0 * cnv.resampler->taps;
+    }
+
+    // Each output of a step convolves one phase of its filter, taps / L coefficients
+    // Half-band steps multiply the k pairs of their 4k-1 taps and the centre, once for every L outputs
+    double rate = 1, macs = 0;
+    for(int i = 0; i < cnv.step_count; i++)
+    {   rate *= (double)cnv.sub_steps[i].L / cnv.sub_steps[i].M;
+        if(cnv.plan->half_band[i])
+        {   macs += rate * (((cnv.plan->taps[i] + 1) >> 2) + 1) / cnv.sub_steps[i].L;
+        }
+        else
+        {   macs += rate * cnv.plan->taps[i] / cnv.sub_steps[i].L;
+        }
+    }
+
+    return macs / rate;
+}
+
+// Converts a whole wave in the steps of the converter, returns the number of output blocks
+static size_t convert_all(FormatConverter &cnv, const char* src, char* dst, size_t blocks)
+{
+    size_t done = 0, output = 0;
+    while(done < blocks)
+    {   size_t step = blocks - done < (size_t)cnv.max_input ? blocks - done : cnv.max_input;
+        output += cnv.convert((char*)src + done * cnv.in_fmt.blockAlign, dst + output * cnv.out_fmt.blockAlign, step);
+        done += step;
+    }
+
+    return output;
+}
+
+// Ratio in dB of the energy of a tone of frequency f and amplitude "amplitude" to everything else in an output
+// The tone is fitted by least squares, so its gain and phase are left out and the residual is what the filters
+// let through, and the rounding of the samples
+static double tone_to_residual(const std::vector<double> &dst, size_t first, size_t last, long out_rate, double f, double amplitude)
+{
+    const double pi = 3.14159265358979323846;
+    double tone_energy = 0.5 * amplitude * amplitude * (last - first);
+
+    if(2 * f >= out_rate)
+    {   double leak = 0;
+        for(size_t i = first; i < last; i++)
+        {   leak += dst[i] * dst[i];
+        }
+        return 10 * log10(tone_energy / (leak + 1e-30));
+    }
+
+    double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+    for(size_t i = first; i < last; i++)
+    {   double w = 2 * pi * f * i / out_rate, s = sin(w), c = cos(w);
+        ss += s * s; cc += c * c; sc += s * c;
+        ys += dst[i] * s; yc += dst[i] * c;
+    }
+
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+
+    double leak = 0;
+    for(size_t i = first; i < last; i++)
+    {   double w = 2 * pi * f * i / out_rate;
+        double e = dst[i] - a * sin(w) - b * cos(w);
+        leak += e * e;
+    }
+
+    return 10 * log10(tone_energy / (leak + 1e-30));
+}
+
+// Attenuation in dB of everything but a tone of frequency f in the output of a tone at f,
+// or of the whole output if f is above the output's Nyquist frequency
+static double tone_attenuation(long in_rate, long out_rate, ResampleQuality quality, double f)
+{
+    WaveFmt in  = makeWaveFmt(1, 32, in_rate, _IEEEFloat);
+    WaveFmt out = makeWaveFmt(1, 32, out_rate, _IEEEFloat);
+    FormatConverter cnv(in, out, quality);
+
+    const double pi = 3.14159265358979323846;
+    size_t blocks = (size_t)(in_rate * TONE_SECONDS);
+    std::vector<float> src(blocks);
+    for(size_t i = 0; i < blocks; i++)
+    {   src[i] = (float)(0.5 * sin(2 * pi * f * i / in_rate));
+    }
+
+    std::vector<float> dst((size_t)((double)blocks * out_rate / in_rate) + 16 * cnv.max_output);
+    size_t output = convert_all(cnv, (char*)&src[0], (char*)&dst[0], blocks);
+
+    // The filters' delays and the start-up transient are left out
+    std::vector<double> samples(dst.begin(), dst.begin() + output);
+    return tone_to_residual(samples, output / 5, output - output / 10, out_rate, f, 0.5);
+}
+
+// Signal to noise ratio in dB of a 16-bit conversion of a SNR_TONE tone at SNR_AMPLITUDE of full scale,
+// the noise takes in the images and aliases of the tone, the rounding of the coefficients and of the samples
+static double snr_16bit(long in_rate, long out_rate, ResampleQuality quality)
+{
+    WaveFmt in  = makeWaveFmt(1, 16, in_rate);
+    WaveFmt out = makeWaveFmt(1, 16, out_rate);
+    FormatConverter cnv(in, out, quality);
+
+    const double pi = 3.14159265358979323846;
+    size_t blocks = (size_t)(in_rate * TONE_SECONDS);
+    std::vector<short> src(blocks);
+    for(size_t i = 0; i < blocks; i++)
+    {   src[i] = (short)floor(SNR_AMPLITUDE * 32768 * sin(2 * pi * SNR_TONE * i / in_rate) + 0.5);
+    }
+
+    std::vector<short> dst((size_t)((double)blocks * out_rate / in_rate) + 16 * cnv.max_output);
+    size_t output = convert_all(cnv, (char*)&src[0], (char*)&dst[0], blocks);
+
+    std::vector<double> samples(output);
+    for(size_t i = 0; i < output; i++)
+    {   samples[i] = dst[i] / 32768.0;
+    }
+
+    return tone_to_residual(samples, output / 5, output - output / 10, out_rate, SNR_TONE, SNR_AMPLITUDE);
+}
+
+// Worst attenuation of the tones in the passband, and above the output's Nyquist frequency if it decimates
+static double stopband_attenuation(long in_rate, long out_rate, ResampleQuality quality)
+{
+    double low_nyquist = (in_rate < out_rate ? in_rate : out_rate) / 2.0;
+    double worst = 1e9;
+
+    for(int k = 1; k <= TONE_COUNT; k++)
+    {   double att = tone_attenuation(in_rate, out_rate, quality, 0.7 * low_nyquist * k / TONE_COUNT);
+        worst = att < worst ? att : worst;
+    }
+
+    // The stopband starts past the transition band, a fifth of the way from the output's Nyquist frequency to the input's
+    if(out_rate < in_rate)
+    {   double from = out_rate / 2.0 + 0.2 * (in_rate - out_rate) / 2, to = in_rate / 2.0 - 0.05 * (in_rate - out_rate) / 2;
+        for(int k = 0; k < TONE_COUNT; k++)
+        {   double att = tone_attenuation(in_rate, out_rate, quality, from + (to - from) * k / (TONE_COUNT - 1));
+            worst = att < worst ? att : worst;
+        }
+    }
+
+    return worst;
+}
+
+// Speed of a stereo 16-bit conversion, in multiples of real time
+static double throughput(long in_rate, long out_rate, ResampleQuality quality)
+{
+    WaveFmt in  = makeWaveFmt(2, 16, in_rate);
+    WaveFmt out = makeWaveFmt(2, 16, out_rate);
+    FormatConverter cnv(in, out, quality);
+
+    size_t blocks = in_rate * SPEED_SECONDS;
+    std::vector<short> src(blocks * 2);
+    unsigned seed = 1;
+    for(size_t i = 0; i < src.size(); i++)
+    {   seed = seed * 1103515245 + 12345;
+        src[i] = (short)(seed >> 16);
+    }
+
+    std::vector<short> dst(((size_t)((double)blocks * out_rate / in_rate) + 16 * cnv.max_output) * 2);
+
+    double best = 1e9;
+    for(int run = 0; run < 3; run++)
+    {   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        convert_all(cnv, (char*)&src[0], (char*)&dst[0], blocks);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = secs < best ? secs : best;
+    }
+
+    return SPEED_SECONDS / best;
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    int pair_count = sizeof(rate_pairs) / sizeof(rate_pairs[0]);
+    int failures = 0;
+    double last_macs = 0, last_speed = 0, last_worst = 0, last_snr = 0;
+
+    printf("%-10s %12s %16s %14s %14s\n", "Tier", "MACs/sample", "Throughput (x)", "Stopband (dB)", "16-bit SNR (dB)");
+
+    for(int q = Quality_Fast; q <= Quality_Archival; q++)
+    {
+        ResampleQuality quality = (ResampleQuality)q;
+        double macs = 0, speed = 0, worst = 1e9, snr = 1e9;
+
+        for(int p = 0; p < pair_count; p++)
+        {
+            long in_rate = rate_pairs[p][0], out_rate = rate_pairs[p][1];
+            FormatConverter cnv(makeWaveFmt(2, 16, in_rate), makeWaveFmt(2, 16, out_rate), quality);
+
+            double pair_macs  = macs_per_sample(cnv);
+            double pair_speed = throughput(in_rate, out_rate, quality);
+            double pair_att   = stopband_attenuation(in_rate, out_rate, quality);
+            double pair_snr   = snr_16bit(in_rate, out_rate, quality);
+
+            if(verbose)
+            {   printf("  %-9s %5ld -> %-5ld %8.1f %16.0f %14.1f %14.1f  %s\n", get_quality_preset(quality).name, in_rate, out_rate,
+                       pair_macs, pair_speed, pair_att, pair_snr, cnv.resampler != NULL ? "resampler" : "cascade");
+            }
+
+            macs  += pair_macs / pair_count;
+            speed += pair_speed / pair_count;
+            worst  = pair_att < worst ? pair_att : worst;
+            snr    = pair_snr < snr ? pair_snr : snr;
+        }
+
+        // Each tier must cost more than the one below it, and buy a better stopband and signal to noise ratio,
+        // the tiers at the ceiling of the 16-bit SNR can't measure better than it
+        bool below   = worst < stopband_floors[q] || snr < snr_floors[q];
+        bool ordered = q == Quality_Fast || (macs > last_macs && worst > last_worst && (snr > last_snr || snr >= SNR_CEILING));
+        printf("%-10s %12.1f %16.0f %14.1f %14.1f%s%s\n", get_quality_preset(quality).name, macs, speed, worst, snr,
+               below ? "  below its floor" : "", ordered ? "" : "  no better than the tier below");
+        if(q > Quality_Fast && speed > last_speed)
+        {   printf("%-10s runs faster than the tier below\n", "");
+        }
+        failures += below || !ordered;
+
+        last_macs = macs; last_speed = speed; last_worst = worst; last_snr = snr;
+    }
+
+    return failures != 0;
+}
@@ -5,6 +5,7 @@
 
 #include <cpthread/cpthread.h>
 #include "wave.h"
+#include "samples.h"
 #include "AudioSource.h"
 
 #pragma comment(lib, "Winmm.lib")
@@ -46,9 +47,12 @@ public:
 
 	// List of Audio Sources that the stream is playing
 	// Each source is mixed together when added to the buffers
+	// The source is built in place, as its atomics make it neither copyable nor movable
 	struct AudioNode
 	{	AudioSource source;
 		AudioNode* next;
+
+		AudioNode(WaveFmt fmt, unsigned char flags) : source(fmt, flags), next(NULL) {}
 	};
 
 	AudioNode* head;
@@ -87,7 +91,7 @@ public:
 	void getAudioData(char* buffer, int blocks);
 
 	// Mix n blocks of audio data B into A
-	void mixAudioData(char* A, char* B, int buffer_size, int sample_size);
+	void mixAudioData(char* A, char* B, int buffer_size, SampleType sample_type);
 
 	// Loads n blocks of data from a buffer to the Audio Buffer
 	// Loading starts from the last index, and if there isn't enough space,
@@ -3,57 +3,140 @@
 
 #include <audio-lib/wave.h>
 #include <audio-lib/conversion.h>
+#include <audio-lib/pool.h>
+#include <audio-lib/workers.h>
+#include <audio-lib/wavefile.h>
 #include <cpthread/cpevent.h>
 #include <cpthread/cpmutex.h>
 #include <cpthread/cpthread.h>
 #include <windows.h>
 #include <iostream>
+#include <atomic>
 
 #define AS_FLAG_PERSIST  1
 #define AS_FLAG_BUFFERED 2
 #define AS_FLAG_LOOPED   4
+#define AS_FLAG_LAZY     8
 
 #define MAX_NODE_UNITS 1
 
+// Chunks of the ring of a streaming source, a power of two so the indices wrap around it
+// Each chunk holds up to MAX_NODE_UNITS converter inputs, about 10ms of audio each
+#define STREAM_RING_CHUNKS 64
+// Milliseconds the producer of a streaming source sleeps while the ring is full
+#define STREAM_RING_WAIT   2
+
 #define MAX(a, b)  (a > b ? a : b)
 
+// Releases a buffer an Audio Source took the ownership of, with the context given along with it
+typedef void (*release_fn)(char* data, void* context);
+
 class AudioSource
 {
+	// Buffer added without a copy, which the nodes view instead of holding their own original data
+	// Counts the nodes viewing it, and the adding call while it chops the buffer, and is released with the last
+	struct DataShare
+	{	char* data;				// Bytes of the buffer
+		release_fn release;		// Releases the buffer once no node views it, NULL for borrowed data
+		void* context;			// Argument of the release function
+		std::atomic<size_t> refs;	// Nodes viewing the buffer
+	};
+
+	// Headers and buffers of the nodes come from the process-wide pool, and go back to it once removed
 	struct DataNode
 	{	WaveFmt fmt;			// Wave format of the original data
 
 		char* origin;			// Bytes of the original data
 		size_t orig_len;		// Number of blocks in the original data
+		size_t orig_size;		// Bytes allocated for the original data, kept by the chunks of the ring
+		DataShare* share;		// Buffer the original data is a view of, NULL if the node owns it
 
-		char* processed;		// Bytes of converted data ready for use
+		char* processed;		// Bytes of converted data ready for use, the original data if the formats match
 		size_t proc_len;		// Number of blocks in the processed data
+		size_t proc_size;		// Bytes allocated for the processed data, kept by the chunks of the ring
+		char* spare;			// Buffer reserved for the processed data when added to a lazy source, NULL once converted
 
 		DataNode* next;			// Pointer to the next Node
 	};
 
 	FormatConverter converter;  // Primary data format converter for adding new input
 	WaveFmt audio_fmt;			// Format of the Audio Source
+	ResampleQuality quality;	// Quality tier of the sampling rate conversion of the added data
 
-	thread post_handler;		// Handles data processing after the starting node
-	thread pre_handler;			// Handles data processing from the beginning to the starting node
-	bool   handler_active;		// State of the data handler threads 
-
-	signal insert_sig;			// Event signal to notify the handler of new data added
+	// The data is converted by the process-wide workers, which run a node of the source at a time
+	WorkerTask task;			// Conversion task of the source, submitted whenever data is added
+	std::atomic<bool> converting;	// The primary converter is in use, by a worker or by the playback of a lazy source
 	mutex  proc_mutex;			// Mutex for modifying the processed node pointer
 	DataNode* proc;				// Pointer to the current block of data being processed
 
+	FormatConverter* back_converter;	// Converter of the nodes before the starting node of a reset, NULL if there are none
+	DataNode* back;				// Next node before the starting node to process again
+	DataNode* back_end;			// Starting node of the reset, where the processing of the nodes before it stops
+
 	DataNode* head;				// Start of the Audio Data
 	DataNode* tail;				// End of the Audio Data
 	DataNode* curr;				// Pointer to the current block of data being played
 	size_t    offset;			// Block Offset in the current block of Data
 
+	// Sources that aren't buffered stream through a bounded ring of chunks instead of the list of nodes
+	// The producer adding data, the worker converting it and the playback each advance their own index,
+	// so they only coordinate through the indices and the playback never waits on the other threads
+	DataNode* ring;				// Chunks of a streaming source, NULL if the source is buffered
+	std::atomic<size_t> ring_write;		// Chunks added by the producer
+	std::atomic<size_t> ring_convert;	// Chunks converted by the workers
+	std::atomic<size_t> ring_read;		// Chunks fully taken by the playback
+
+	// A reset of the format is handed to the playback, which rewinds its offset in the chunk it takes, then the holder
+	// of the primary converter converts the chunks again from the first one not taken, so nothing it reads moves under it
+	std::atomic<size_t> reset_request;	// Resets of the format asked for
+	std::atomic<size_t> reset_ack;		// Resets the playback rewound its offset for
+	std::atomic<size_t> reset_done;		// Resets the chunks of the ring were converted again for
+
+	// Streaming sources of a wave file have no producer, the workers add the windows of the mapped file
+	// to the ring as the playback frees its chunks, so only the window of the ring is ever resident
+	// The ring has a single producer, so a streaming source takes either the data of a producer or wave files
+	enum RingFeed { Feed_None, Feed_Producer, Feed_File };
+	std::atomic<int> ring_feed;			// RingFeed of the ring, set by the first data added
+	std::atomic<WaveFile*> file;		// Mapped wave file streamed through the ring, NULL if a producer adds the data
+	DataShare* file_share;		// Share of the mapped file, which the chunks view and release with the last of them
+	size_t file_pos;			// Next block of the file added to the ring
+
 	bool empty_persist : 1;		// Audio Source should not be deleted if it reached the end
 	bool data_buffered : 1;		// Data is left in the buffer after taken (can be rewinded)
 	bool audio_looped : 1;		// Audio source is looped to play indefinitely
+	bool convert_lazy : 1;		// The playback converts the data the workers didn't convert in time
+
+	// Chops the data into nodes, or the chunks of the ring, which copy it or view the shared buffer
+	// Returns false if the ring of a streaming source is fed by wave files
+	bool add_nodes(const char* data, size_t blocks, const WaveFmt &fmt, DataShare* share);
+
+	// Releases the original data of a node, or its view of a shared buffer
+	static void release_origin(DataNode* node);
+	// Releases the processed data of a node, unless it is its original data
+	static void release_processed(DataNode* node);
+	// Drops a view of a shared buffer, releasing the buffer with the last one
+	static void release_share(DataShare* share);
+
+	// Fills a chunk of the ring with n blocks, copied or viewed in the shared buffer
+	static void write_chunk(DataNode* chunk, const char* data, size_t blocks, size_t max_blocks, const WaveFmt &fmt, DataShare* share);
+	// Adds the next windows of the mapped wave file to the free chunks of the ring, starting it over if looped
+	void read_file();
+	// Converts the chunks of the ring again from the first one not taken, once the playback acknowledged a reset
+	void rewind_chunks();
+	// Claims the ring for a RingFeed, returns false if the other kind already feeds it
+	bool claim_feed(int feed);
+
+	// Sets the primary converter up for the data added to a lazy source, unless data before it isn't converted yet,
+	// and returns the bytes of the processed data of its nodes, 0 if they are played from their original data
+	size_t prepare_lazy(const WaveFmt &fmt);
+	// Reserves the buffer of the processed data of a node, so the playback converting it doesn't allocate
+	static void reserve_processed(DataNode* node, size_t bytes);
+	// The primary converter is set up for the node and its buffer is reserved, so converting it neither locks nor allocates
+	bool ready_to_convert(const DataNode* node) const;
 
 public:
 
-	AudioSource(WaveFmt fmt, unsigned char flags = 0);
+	AudioSource(WaveFmt fmt, unsigned char flags = 0, ResampleQuality quality = Quality_Standard);
 
 	~AudioSource();
 
@@ -65,17 +148,54 @@ public:
 
 	// Adds n blocks of data to the end of the Audio Source
 	// The input is chopped into smaller units but doesn't get
-	void add_async(const char* data, size_t blocks, const WaveFmt &fmt);
+	// Streaming sources copy the units into the chunks of the ring, waiting while it is full,
+	// and only take data from a single producer thread
+	// Returns false if the source streams wave files, as its ring has a single producer
+	bool add_async(const char* data, size_t blocks, const WaveFmt &fmt);
+
+	// Adds n blocks of data the Audio Source takes the ownership of, without copying them
+	// The nodes view the buffer, which is released with "release" once the last of them is removed,
+	// or with delete[] if it is NULL. The caller must not change the buffer after handing it over
+	// The release may run on the thread removing the last node, the playback for the sources that aren't buffered
+	// Returns false if the source streams wave files, the buffer is released right away
+	bool add_owned(char* data, size_t blocks, const WaveFmt &fmt, release_fn release = NULL, void* context = NULL);
+
+	// Adds n blocks of data that outlive the Audio Source, static or memory-mapped, without copying them
+	// The nodes view the data, which is never released nor changed by the Audio Source
+	// Returns false if the source streams wave files
+	bool add_borrowed(const char* data, size_t blocks, const WaveFmt &fmt);
+
+	// Adds the data of a wave file mapped in memory, without reading it first
+	// Streaming sources convert windows of the file as the playback frees the chunks of the ring, without a producer,
+	// and start it over if looped. Buffered sources view the whole file in their nodes, and keep it mapped until removed
+	// Returns false if the file can't be mapped or isn't a valid wave, or if a producer adds the data of the streaming source
+	bool add_file(const char* filename);
 
 	// Takes n blocks of data from the Audio Source across Data Nodes
 	// If the Source ran out of data, 0s are returned. If the format of the
 	// next node is different, the Source is paused and 0s are returned
+	// Lazy sources convert the node they need if the workers didn't yet, instead of returning 0s
 	void take(char* buff, size_t blocks);
 
+	// Takes n blocks of data from the converted chunks of the ring of a streaming source
+	// Never waits or allocates, the blocks past the converted chunks are 0s
+	void take_stream(char* buff, size_t blocks);
+
+	// Converts the node the playback needs on the calling thread, the chunk at index of the ring of a
+	// streaming source or the current node, then leaves the following ones to the workers
+	// Never waits nor allocates: returns false if a worker holds the primary converter or the nodes, as it is converting
+	// the node already, or if the node wasn't prepared for the playback when added, so the workers convert it
+	bool convert_on_demand(size_t index);
+
 	// Resets the format and hte filter of the audio source and 
 	// clears all processed data that was converted from the original samples
+	// The playback rewinds the chunk it takes with its next call, and the chunks of the ring are silent until converted again
 	void reset_format(const WaveFmt &fmt);
 
+	// Changes the quality tier of the sampling rate conversion, so voice streams can run
+	// cheaper filters than music. The processed data is converted again with the new tier
+	void set_quality(ResampleQuality quality);
+
 	// Processes a single node's original data with the current Format Converter
 	void process_node(FormatConverter *cnv, DataNode *node);
 
@@ -91,8 +211,7 @@ public:
 	// Only has an effect if the data is buffered
 	void rewind();
 
-	friend THREAD primary_data_processor(void* lparam);
-	friend THREAD secondary_data_processor(void* lparam);
+	friend bool conversion_step(void* lparam);
 };
 
 #endif AUDIOSOURCE_H
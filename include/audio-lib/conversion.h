@@ -3,6 +3,7 @@
 
 #include <audio-lib/wave.h>
 #include <audio-lib/sampling.h>
+#include <ostream>
 
 struct factor
 {	int value;                  // Value of the prime factor
@@ -14,69 +15,225 @@ struct scale
 	int M;                      // Decimation factor
 };
 
+// Named speed/quality trade-offs of the sampling rate conversion, from the cheapest to the most accurate
+enum ResampleQuality { Quality_Fast=0, Quality_Voice=1, Quality_Standard=2, Quality_Mastering=3, Quality_Archival=4 };
+
+// Filter design of a quality tier, for the cascade of Rate Converters and the windowed-sinc resampler
+struct QualityPreset
+{	const char* name;           // Name of the tier
+	int step_taps;              // Taps of an integer step for each unit of its factor
+	int polyphase_taps;         // Taps of a non-integral step for each unit of its larger factor
+	FIRWindow window;           // Window of the steps' filters
+	int cutoff;                 // Cutoff of the steps' filters, in thousandths of the Nyquist frequency
+	bool half_band;             // Steps by 2 are half-band stages, which let aliases into the top of their transition band
+	size_t zero_crossings;      // Zero crossings of the resampler's sinc on each side of its centre
+	double beta;                // Shape parameter of the resampler's Kaiser window
+	int sub_conversions;        // Sub-conversions of each second of input, the buffers of the conversion hold one of them
+};
+
+// Returns the filter design of a quality tier
+const QualityPreset& get_quality_preset(ResampleQuality quality);
+
+// Converter of the channel count and sample type of n "blocks" in a single pass
+typedef void (*format_fn)(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks);
+
+// Matrix mixing the channels of a wave into another channel count, up to MIX_CHANNELS on each side
+// Channels follow the order of the WAVE speaker masks: FL FR FC LFE BL BR SL SR
+struct ChannelMix
+{	int in_channels;            // Channels of the input blocks, 0 if the channels aren't mixed
+	int out_channels;           // Channels of the output blocks
+	float gains[MIX_CHANNELS][MIX_CHANNELS]; // Gain of each input channel (row) into each output channel (column)
+};
+
+// Builds the standard mix between two channel counts, as mono, stereo, quadraphonic, 5.1 and 7.1 layouts
+// Speakers missing from the output are folded into their neighbours at -3dB and the LFE is dropped,
+// then the matrix is scaled down so no output can exceed full scale, other counts map channel to channel
+void get_standard_mix(int in_channels, int out_channels, ChannelMix &mix);
+
+// Mixer of the channels and converter of the sample type of n "blocks" through a matrix, in a single pass
+typedef void (*mix_fn)(const char* src, char* dst, const ChannelMix &mix, size_t blocks);
+
+// Plan of the conversion between two formats, shared by every converter of the
+// same formats through a process-wide cache, and never modified once built
+struct ConversionPlan
+{	WaveFmt in_fmt;             // Input wave's format
+	WaveFmt out_fmt;            // Output wave's format
+	SampleType in_type;         // Type of the input wave's samples
+	SampleType out_type;        // Type of the output wave's samples
+	ResampleQuality quality;    // Quality tier of the sampling rate conversion
+
+	int max_input;              // Maximum number of blocks processed by the sub_conversion
+	int max_output;             // Maximum number of blocks output by the sub_conversion
+	int L;                      // Total Interpolation factor
+	int M;                      // Total Decimation factor
+
+	format_fn format_kernel;    // Fused channel and bit depth conversion, NULL if both formats match or the channels are mixed
+	mix_fn mix_kernel;          // Fused channel mix and bit depth conversion, NULL if the channels aren't mixed
+	ChannelMix mix;             // Matrix of the channel mix, with no channels if they aren't mixed
+	bool resample;              // The sampling rate is converted by the windowed-sinc resampler
+	int step_count;             // Number of sub-steps of the cascade
+	scale* steps;               // Factors of each sub-step of the cascade
+	int* taps;                  // Filter size of each sub-step of the cascade
+	int* cutoffs;               // Cutoff of the filters of each sub-step, in thousandths of the Nyquist frequency they protect
+	bool* half_band;            // Sub-steps of the cascade converting by 2 with a half-band filter
+	int scratch_size;           // Blocks of each intermediate buffer of the cascade
+	int warmup_blocks;          // Input blocks refreshing the filter states before a parallel segment
+	double cost;                // Estimated cost of the sampling rate conversion, in multiply-accumulates per second of output of a channel
+
+	int refs;                   // Number of converters holding the plan
+	ConversionPlan* next;       // Next entry of the cache
+};
+
+// Finds the plan of a conversion in the cache, planning it if no converter holds it yet
+// Channel counts other than mono and stereo are mixed through the standard matrix, unless a custom
+// matrix of the same counts is given, which is also used with counts the fused kernels handle
+// Every acquired plan must be released once, the last release deallocates it
+const ConversionPlan* acquire_conversion_plan(const WaveFmt &in, const WaveFmt &out, ResampleQuality quality = Quality_Standard,
+                                              const ChannelMix* mix = NULL);
+// Removes a holder of the plan, deallocating it with the last one
+void release_conversion_plan(const ConversionPlan* plan);
+// Writes the steps of a plan with their filters and estimated costs, and the cost of the whole conversion
+void print_conversion_plan(std::ostream &out, const ConversionPlan* plan);
+
+// Buffers and filter states of a converter for a plan, kept while the converter
+// works on other formats, so switching back doesn't allocate them again
+struct ConversionState
+{	const ConversionPlan* plan; // Plan the state was built for
+	char* format_ptr;           // Temporary dynamic array for the format conversion's result
+	char* sub_buffers[2];       // Intermediate buffers of the cascade
+	RateConverter* sub_steps;   // Rate Converters of the cascade
+	SincResampler* resampler;   // Windowed-sinc resampler, NULL for the cascade
+	ConversionState* next;      // Next parked state, from the most recently used
+};
+
 class FormatConverter
 {
 public:
+    const ConversionPlan* plan; // Shared plan of the conversion, the members below are copied from it
+    ConversionState* parked;    // States of the plans the converter switched away from
+
     int max_input;              // Maximum number of blocks processed by the sub_conversion
     int max_output;             // Maximum number of blocks output by the sub_conversion
 
     WaveFmt in_fmt;             // Input wave's format
     WaveFmt out_fmt;            // Output wave's format
+    SampleType in_type;         // Type of the input wave's samples
+    SampleType out_type;        // Type of the output wave's samples
+    ResampleQuality quality;    // Quality tier of the sampling rate conversion
 
-    char* channel_ptr;          // Temporary dynamic array for the channel conversion's result
-    char* depth_ptr;            // Temporary dynamic array for the bit depth conversion's result
-    char* rate_ptr;             // Temporary dynamic array for the sampling rate conversion's result
+    format_fn format_kernel;    // Fused channel and bit depth conversion, NULL if both formats match or the channels are mixed
+    mix_fn mix_kernel;          // Fused channel mix and bit depth conversion, NULL if the channels aren't mixed
+    ChannelMix* custom_mix;     // Matrix replacing the standard mix of the formats with its channel counts, NULL for none
+    char* format_ptr;           // Temporary dynamic array for the format conversion's result, if the rate is converted after it
 
     int L;                      // Total Interpolation factor
     int M;                      // Total Decimation factor
 
     int step_count;             // Number of sub-steps for the sampling rate conversion
-    char** sub_buffers;         // Intermediate buffers for sampling rate conversion
+    char* sub_buffers[2];       // Intermediate buffers the steps of the cascade alternate between, the last one outputs to the destination
     RateConverter* sub_steps;   // Smaller increments of Rate Converters to convert the sampling rate of the input
+    SincResampler* resampler;   // Windowed-sinc resampler used instead of the sub-steps, NULL for the cascade
+
+    // Builds the buffers and converters of the current plan
+    void init_state();
+    // Keeps the buffers and converters of the current plan in the parked states
+    void park_state();
+    // Takes the buffers and converters of the current plan out of the parked states
+    // Returns false if there were none
+    bool unpark_state();
+    // Brings the filters back to their state after init, without allocating anything
+    void reset_state();
+    // Deallocates the buffers and converters of the current plan
+    void clear_state();
+
+    int thread_count;           // Number of threads converting long inputs in parallel segments
+    int warmup_blocks;          // Input blocks refreshing the filter states before a parallel segment
+    FormatConverter** workers;  // Converters of the additional threads, each converting a segment
+
+    // Converts the blocks in max_input steps on the calling thread
+    int convert_serial(char* src, char* dst, size_t blocks);
+    // Converts the blocks in segments, the first on the calling thread and the others on the workers
+    int convert_parallel(char* src, char* dst, size_t blocks);
+    // Converts blocks only to bring the filter states up to date, discarding the output
+    // Returns the number of blocks that resulted from the conversion
+    int warm_up(char* src, size_t blocks);
     
 
-    FormatConverter(WaveFmt in, WaveFmt out);
+    FormatConverter(WaveFmt in, WaveFmt out, ResampleQuality quality = Quality_Standard, const ChannelMix* mix = NULL);
     ~FormatConverter();
 
     // Initializes the input/output formats and the required buffers and converters
+    // The plan comes from the cache, and the buffers and converters from the parked
+    // states if the converter already worked on the formats
     void init(WaveFmt in, WaveFmt out);
-    // Deallocates any dynamic arrays that were created
+    // Deallocates any dynamic arrays that were created, including the parked states
     void clear();
 
+    // Changes the quality tier of the sampling rate conversion, initializing the converter again if it differs
+    void set_quality(ResampleQuality quality);
+    // Sets a matrix replacing the standard channel mix, NULL goes back to the standard one
+    // It is kept for later formats, and only used while their channel counts match it
+    void set_channel_mix(const ChannelMix* mix);
+
     // Finds the max input unit block size
     static int find_max_input_size(const WaveFmt &in_fmt);
 
     // Breaks down the conversion of a larger wave to smaller steps
+    // Long waves are split into segments converted in parallel if more threads are set
     // Returns the number of blocks that resulted from the conversion
     int convert(char* src, char* dst, size_t blocks);
 
+    // Sets the number of threads converting long waves, 1 converts on the calling thread only
+    // Each thread converts a segment after warming up its filters on the blocks before it,
+    // so the output is identical to the conversion on a single thread
+    void set_threads(int threads);
+
+    // Advances the position of the sampling rate conversion by n "blocks" without converting them
+    // Returns the number of blocks the conversion would have output
+    size_t skip(size_t blocks);
+    // Copies the position of the sampling rate conversion from another converter of the same formats
+    void copy_position(const FormatConverter &other);
+
     // Converts a wave to another format, which can include different
     // number of channels, nit depth or sampling rate increase or decrease
+    // The channels and bit depth are converted in one pass and the last step writes straight to dst
     // Returns the number of blocks that resulted from the conversion
     int sub_convert(char* src, char* dst, size_t blocks);
 };
 
-// Converts the sample rate of a multi channel 8-bit audio stream
-int convert_sample_rate(const unsigned char* src, unsigned char* dst, size_t blocks, RateConverter &conv);
+// Converts the sample rate of a multi channel audio stream
+template<typename T>
+int convert_sample_rate(const T* src, T* dst, size_t blocks, RateConverter &conv);
+
+
 
-// Converts the sample rate of a multi channel 16-bit audio stream
-int convert_sample_rate(const short* src, short* dst, size_t blocks, RateConverter &conv);
+// Converts samples between types and bit depths through a full scale 32-bit value
+template<typename S, typename D>
+void convert_bit_depth(const S* src, D* dst, size_t samples);
 
+// Changes the channel count and the sample type of a multi channel audio stream in a single pass
+template<typename S, typename D>
+void convert_format(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks);
 
+// Finds the fused channel and bit depth conversion between two sample types
+format_fn find_format_kernel(SampleType in_type, SampleType out_type);
 
-// Moves the samples from unsigned 8-bit to signed 16-bit wave and scales it up
-void bit_depth_8_to_16(const unsigned char* src, short* dst, size_t samples);
+// Mixes the channels of a multi channel audio stream through a matrix and changes the sample type in a single pass
+template<typename S, typename D>
+void mix_format(const char* src, char* dst, const ChannelMix &mix, size_t blocks);
 
-// Scales the signed 16-bit samples down and moves them to an unsigned 8-bit sample wave
-void bit_depth_16_to_8(const short* src, unsigned char* dst, size_t samples);
+// Finds the fused channel mix and bit depth conversion between two sample types
+mix_fn find_mix_kernel(SampleType in_type, SampleType out_type);
 
 
 
 // Duplicates samples to create 2 channels of the same wave
-void mono_to_stereo(const char* src, const char* dst, size_t depth, size_t samples);
+template<typename T>
+void mono_to_stereo(const T* src, T* dst, size_t samples);
 
 // Averages 2 consecutive samples to combines 2 waves into 1
-void stereo_to_mono(const char* src, const char* dst, size_t depth, size_t samples);
+template<typename T>
+void stereo_to_mono(const T* src, T* dst, size_t samples);
 
 
 
@@ -90,6 +247,23 @@ void remove_common_factors(factor* L_factors, const int L_size, factor* M_factor
 // Optimizes the scaling factors L/M bteween two sampling rates so
 // the wave doesn't suffer quality loss during conversion and the
 // conversion is performed as fast as possible with minimized memory usage
+// The converters plan their cascades with plan_scaling_factors, this heuristic is plan_bench's baseline
 void optimize_scaling_factors(scale* scales, int &S_size, factor* L_factors, int L_size, factor* M_factors, int M_size);
 
+// Sizes the filter of a step of the cascade for a quality tier, "band_ratio" is the band of the signal
+// entering the step over the band of its output, the signal's band is at most the one of the cascade's input
+// Returns its taps, and sets whether it is a half-band stage, its cutoff and the coefficients it convolves for each block it outputs
+int size_cascade_step(const scale &step, ResampleQuality quality, double band_ratio, bool &half_band, int &cutoff, double &output_taps);
+
+// Estimated cost of a cascade converting from a sampling rate, in multiply-accumulates per second of
+// output of a channel, where each block a step outputs also counts for the overhead of its call
+double estimate_cascade_cost(const scale* scales, int S_size, long in_rate, ResampleQuality quality);
+
+// Finds the cheapest cascade converting a sampling rate by L/M, scoring every ordering of the divisors
+// of L and M into steps, as long as no step drops below the lower of the input and output rates
+// Decimations between close rates cut off below their Nyquist frequency with longer filters, as the resampler does
+// Ties go to the cascade with the smallest intermediate buffers
+// "scales" must hold a step for each prime factor of L and M, returns the number of steps, 0 if no cascade fits
+int plan_scaling_factors(scale* scales, long in_rate, int L, int M, ResampleQuality quality);
+
 #endif
\ No newline at end of file
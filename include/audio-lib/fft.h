@@ -0,0 +1,35 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+
+// Radix-2 complex FFT of a power of two size, in place on interleaved real and imaginary doubles
+// Used by the overlap-save convolutions of the Rate Converters with long filters
+class FFT
+{
+public:
+	size_t size;			// Number of complex points, a power of two
+	size_t* swaps;			// Pairs of points swapped into bit-reversed order before the butterflies
+	size_t swap_count;		// Number of pairs of points swapped
+	double* roots;			// Roots of unity exp(-pi*i*k/half) of each stage merging transforms of "half" points, interleaved real and imaginary
+
+	// Butterflies of every stage, the inverse transform uses the conjugate roots
+	template<bool INVERSE> void transform(double* data) const;
+
+public:
+	FFT();
+	FFT(size_t size);
+	~FFT();
+
+	// Builds the bit-reversal and the roots for "size" points, rounded up to a power of two
+	void init(size_t size);
+	// Deallocates all dynamic resources
+	void clear();
+
+	// Forward transform of "size" complex points
+	void forward(double* data) const;
+	// Inverse transform of "size" complex points, the result is not divided by the size
+	void inverse(double* data) const;
+};
+
+#endif
@@ -1,23 +1,119 @@
 #ifndef FILTER_H
 #define FILTER_H
 
+#include <stddef.h>
+
 typedef long long llong;
 
+// Windows applied to the sinc of the low pass filters, from the narrowest
+// transition band to the highest stopband attenuation
+enum FIRWindow { Window_Hamming=0, Window_Blackman=1, Window_BlackmanHarris=2 };
+
+// Immutable coefficients of a low pass filter design, shared by every filter of the same design
+// The entries are kept in a process-wide cache keyed by (taps, stop_freq, sample_freq, window)
+struct FIRCoefs
+{	llong* coefs;		// Filter coefficients
+	size_t size;		// Number of filter coefficients
+	int stop_freq;		// Stop frequency of the design
+	int sample_freq;	// Sample frequency of the design
+	FIRWindow window;	// Window of the design
+	int refs;			// Number of filters holding the coefficients
+	FIRCoefs* next;		// Next entry of the cache
+};
+
+// Finds the coefficients of a filter design in the cache, designing them if no filter holds them yet
+// Every acquired entry must be released once, the last release deallocates it
+const FIRCoefs* acquire_fir_coefs(int taps, int stop_freq, int sample_freq, FIRWindow window = Window_Hamming);
+// Adds a holder to coefficients already acquired
+const FIRCoefs* retain_fir_coefs(const FIRCoefs* entry);
+// Removes a holder of the coefficients, deallocating them with the last one
+void release_fir_coefs(const FIRCoefs* entry);
+
 class FIRFilter_i64
 {
 public:
-	llong* coefs;	// Filter coefficients
-	size_t size;	// Number of filter coefficients
+	const llong* coefs;		// Filter coefficients
+	size_t size;			// Number of filter coefficients
+	const FIRCoefs* shared;	// Cache entry holding the coefficients
 
 public:
 	FIRFilter_i64();
-	FIRFilter_i64(int taps, int stop_freq, int sample_freq);
+	FIRFilter_i64(int taps, int stop_freq, int sample_freq, FIRWindow window = Window_Hamming);
 	FIRFilter_i64(const FIRFilter_i64 &other);
 	~FIRFilter_i64();
 
+	FIRFilter_i64& operator=(const FIRFilter_i64 &other);
+
 	// Creates a low pass filter with "taps" number of coefficients
 	// Each coefficient is a 2^32 scaled up 64-bit integer value
-	void init(int taps, int stop_freq, int sample_freq);
+	// Filters of the same design share their coefficients through the cache
+	void init(int taps, int stop_freq, int sample_freq, FIRWindow window = Window_Hamming);
+	// Releases the coefficients of the filter
+	void clear();
+};
+
+// Constant expression sine, the argument is reduced to [-pi, pi] and a Taylor series is summed
+constexpr double cx_sin(double x)
+{
+	const double pi = 3.14159265358979323846;
+	double turns = x / (2 * pi);
+	x -= 2 * pi * (double)(llong)(turns + (turns < 0 ? -0.5 : 0.5));
+
+	double term = x, sum = x;
+	for (int i = 1; i < 30; i++)
+	{	term *= -x * x / ((2 * i) * (2 * i + 1));
+		sum += term;
+	}
+
+	return sum;
+}
+
+// Constant expression cosine
+constexpr double cx_cos(double x)
+{
+	return cx_sin(x + 3.14159265358979323846 / 2);
+}
+
+// Designs a low pass filter with "taps" number of coefficients, at compile time for the specialised
+// converters and at runtime for the others, so both produce the same coefficients
+// Each coefficient is a 2^32 scaled up 64-bit integer value
+// Every window is one at the centre, so the centre coefficient is the sinc's alone
+constexpr void design_lowpass(llong* coefs, int taps, int stop_freq, int sample_freq, FIRWindow window)
+{
+	const float pi = 3.1415f;
+	double ratio = (float)stop_freq / (float)sample_freq;
+
+	for (int i = 0, p = i - taps / 2; i < taps; i++, p++)
+	{
+		double sinc = p == 0 ? 0 : cx_sin(2 * pi * ratio * p) / (pi * p);
+		float  win  = 0;
+		switch(window)
+		{	case Window_Blackman:
+				win = 0.42f + 0.5f * (float)cx_cos((float)(p * 2 * pi / taps)) + 0.08f * (float)cx_cos((float)(p * 4 * pi / taps));
+				break;
+			case Window_BlackmanHarris:
+				win = 0.35875f + 0.48829f * (float)cx_cos((float)(p * 2 * pi / taps)) + 0.14128f * (float)cx_cos((float)(p * 4 * pi / taps)) +
+				      0.01168f * (float)cx_cos((float)(p * 6 * pi / taps));
+				break;
+			default:
+				win = 0.54f + 0.46f * (float)cx_cos((float)(p * 2 * pi / taps));
+				break;
+		}
+		coefs[i] = (llong)(sinc * win * 4294967296);
+	}
+
+	coefs[taps >> 1] = ((llong)(ratio * 4294967296)) << 1;
+}
+
+// Compile time version of FIRFilter_i64::init for filters with a fixed number of taps
+template<size_t TAPS>
+struct FIRTable_i64
+{	llong coefs[TAPS];	// Filter coefficients
+
+	constexpr FIRTable_i64(int stop_freq, int sample_freq, FIRWindow window = Window_Hamming) : coefs()
+	{
+		design_lowpass(coefs, (int)TAPS, stop_freq, sample_freq, window);
+	}
 };
 
 #endif
\ No newline at end of file
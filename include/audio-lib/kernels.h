@@ -0,0 +1,100 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <audio-lib/filter.h>
+
+typedef unsigned char uchar;
+
+// Instruction set levels the FIR kernels are available in
+enum SIMDLevel { SIMD_Scalar=0, SIMD_SSE41=1, SIMD_AVX2=2 };
+
+// Dot product of n filter coefficients and n contiguous samples
+// The 8-bit samples use Q15 coefficients, the 16 and 24-bit samples are widened to 32 bits and use Q31 ones
+typedef int    (*dot_u8_fn) (const short*  coefs, const uchar* samples, size_t n);
+typedef llong  (*dot_i32_fn)(const int*    coefs, const int*   samples, size_t n);
+typedef double (*dot_f64_fn)(const double* coefs, const int*   samples, size_t n);
+typedef float  (*dot_f32_fn)(const float*  coefs, const float* samples, size_t n);
+
+// Dot product of n filter coefficients and the sums of n pairs of contiguous samples, a[i] + b[i]
+// Symmetric filters share a coefficient between the two samples of each pair, so the pairs are
+// added before the multiplication and each one costs a single multiply
+typedef int    (*pair_u8_fn) (const short*  coefs, const uchar* a, const uchar* b, size_t n);
+typedef llong  (*pair_i32_fn)(const int*    coefs, const int*   a, const int*   b, size_t n);
+typedef double (*pair_f64_fn)(const double* coefs, const int*   a, const int*   b, size_t n);
+typedef float  (*pair_f32_fn)(const float*  coefs, const float* a, const float* b, size_t n);
+
+// Table of the multiply-accumulate kernels used by the Rate Converters
+// The integer kernels of every level are bit-exact with the scalar ones,
+// the floating point kernels only differ in the order of the additions
+struct FIRKernels
+{	SIMDLevel  level;		// Instruction set level of the kernels
+	dot_u8_fn  dot_u8;		// Convolution of unsigned 8-bit samples
+	dot_i32_fn dot_i32;		// Convolution of 16 and 24-bit samples widened to 32 bits
+	dot_f64_fn dot_f64;		// Convolution of signed 32-bit samples
+	dot_f32_fn dot_f32;		// Convolution of 32-bit float samples
+
+	pair_u8_fn  pair_u8;	// Symmetric convolution of unsigned 8-bit samples
+	pair_i32_fn pair_i32;	// Symmetric convolution of 16 and 24-bit samples widened to 32 bits
+	pair_f64_fn pair_f64;	// Symmetric convolution of signed 32-bit samples
+	pair_f32_fn pair_f32;	// Symmetric convolution of 32-bit float samples
+};
+
+// Finds the highest instruction set level supported by the CPU and the OS
+// The CPU is only queried once, later calls return the cached result
+SIMDLevel detect_simd_level();
+
+// Returns the kernels of the fastest level supported by the CPU
+const FIRKernels* get_fir_kernels();
+
+// Returns the kernels of a specific level (capped at the supported level)
+const FIRKernels* get_fir_kernels(SIMDLevel level);
+
+// Bit depth conversions of n samples through their full scale 32-bit value, as convert_bit_depth does
+typedef void (*u8_to_i16_fn)(const uchar* src, short* dst, size_t n);
+typedef void (*i16_to_u8_fn)(const short* src, uchar* dst, size_t n);
+
+// Duplication of n mono samples into n stereo blocks
+typedef void (*dup_u8_fn) (const uchar* src, uchar* dst, size_t n);
+typedef void (*dup_i16_fn)(const short* src, short* dst, size_t n);
+typedef void (*dup_i32_fn)(const int*   src, int*   dst, size_t n);
+
+// Average of the 2 samples of n stereo blocks into n mono samples, integers are rounded down
+typedef void (*avg_u8_fn) (const uchar* src, uchar* dst, size_t n);
+typedef void (*avg_i16_fn)(const short* src, short* dst, size_t n);
+typedef void (*avg_i32_fn)(const int*   src, int*   dst, size_t n);
+typedef void (*avg_f32_fn)(const float* src, float* dst, size_t n);
+
+// Input and output channels a mixing matrix can have, the gains of each input channel into the outputs
+// are a row of MIX_CHANNELS floats, so a row fills the vector registers whatever the output count
+#define MIX_CHANNELS 8
+
+// Mix of n blocks of in_channels float samples into n blocks of out_channels ones through a matrix of gains,
+// where gains[i * MIX_CHANNELS + o] is the gain of input channel i into output channel o
+typedef void (*mix_f32_fn)(const float* src, float* dst, const float* gains, size_t in_channels, size_t out_channels, size_t n);
+
+// Table of the channel and bit depth conversion kernels, run on every wave whose format differs from the output's
+// The kernels of every level are bit-exact with the scalar ones
+struct FormatKernels
+{	SIMDLevel    level;		// Instruction set level of the kernels
+	u8_to_i16_fn u8_to_i16;	// Unsigned 8-bit samples to signed 16-bit ones
+	i16_to_u8_fn i16_to_u8;	// Signed 16-bit samples to unsigned 8-bit ones, truncated towards zero
+
+	dup_u8_fn  dup_u8;		// Mono to stereo unsigned 8-bit samples
+	dup_i16_fn dup_i16;		// Mono to stereo signed 16-bit samples
+	dup_i32_fn dup_i32;		// Mono to stereo 32-bit samples, integer or float
+
+	avg_u8_fn  avg_u8;		// Stereo to mono unsigned 8-bit samples
+	avg_i16_fn avg_i16;		// Stereo to mono signed 16-bit samples
+	avg_i32_fn avg_i32;		// Stereo to mono signed 32-bit samples
+	avg_f32_fn avg_f32;		// Stereo to mono 32-bit float samples
+
+	mix_f32_fn mix_f32;		// Matrix of any channel counts up to MIX_CHANNELS, on 32-bit float samples
+};
+
+// Returns the format conversion kernels of the fastest level supported by the CPU
+const FormatKernels* get_format_kernels();
+
+// Returns the format conversion kernels of a specific level (capped at the supported level)
+const FormatKernels* get_format_kernels(SIMDLevel level);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <ostream>
+
+// Process-wide pool of the Data Node headers and sample buffers of the Audio Sources
+// Blocks are sorted in power of two size classes, a released block goes back to the free list of its
+// class and the next request of that class takes it again, so sources streaming the same formats stop
+// allocating from the heap once each class holds the blocks they have in flight
+//  - Release: pushes the block onto the free list with a compare-and-swap, from any thread and without a lock
+//  - Request: takes the whole free list of its class at once under the class's lock, so a block can't be
+//             taken twice, and only allocates from the heap if the class has no free block left
+
+#define POOL_MIN_SHIFT   6      // Smallest size class, 64 bytes
+#define POOL_CLASSES     15     // Number of size classes, up to 1MB, larger blocks bypass the pool
+
+// Counters of the requests and releases of the pool since the start of the process
+struct PoolStats
+{	size_t requests;            // Blocks requested
+	size_t reused;              // Requests served with a released block
+	size_t heap_allocs;         // Requests served from the heap, with a new pooled block or a block too large for the pool
+	size_t releases;            // Blocks released
+	size_t in_use;              // Blocks requested and not released yet
+	size_t pooled_bytes;        // Bytes of the pooled blocks allocated from the heap, in use or free
+};
+
+// Returns a block of at least n bytes, aligned for any sample type
+void* pool_alloc(size_t bytes);
+// Releases a block returned by pool_alloc to its free list, NULL is ignored
+void pool_free(void* ptr);
+
+// Returns the counters of the pool
+PoolStats get_pool_stats();
+// Writes the counters of the pool and the share of the requests it served without the heap
+void print_pool_stats(std::ostream &out);
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <audio-lib/kernels.h>
+#include <math.h>
+
+// Packed little-endian 24-bit signed sample, as stored in 24-bit PCM waves
+struct int24
+{	uchar bytes[3];
+
+	inline operator int() const
+	{	return (int)((unsigned)bytes[0] << 8 | (unsigned)bytes[1] << 16 | (unsigned)bytes[2] << 24) >> 8;
+	}
+
+	inline int24& operator=(int val)
+	{	bytes[0] = (uchar)val;
+		bytes[1] = (uchar)(val >> 8);
+		bytes[2] = (uchar)(val >> 16);
+		return *this;
+	}
+};
+
+// Clamps a value into the range of a sample type
+template<typename V>
+inline V clamp_sample(V val, V low, V high)
+{
+	return val < low ? low : val > high ? high : val;
+}
+
+// Properties of each sample type the converters work with
+//  - delay_t: type of the samples stored in the delay lines of the Rate Converters
+//  - coef_t:  type of the filter coefficients, normalised to a gain of one, as Q15/Q31
+//             fixed-point for the integer samples so outputs only need a rounding shift
+//  - accum_t: type of the accumulator of the convolutions
+template<typename T> struct SampleTraits;
+
+template<> struct SampleTraits<uchar>
+{	typedef uchar delay_t;
+	typedef short coef_t;
+	typedef int   accum_t;
+
+	static inline uchar   silence()                      { return 0x80; }
+	static inline delay_t load(uchar s)                  { return s; }
+	static inline uchar   store(accum_t acc, int shift)  { return (uchar)clamp_sample<int>((acc + (1 << (shift - 1))) >> shift, 0, 255); }
+
+	// Conversion to and from full scale 32-bit samples, used to change the bit depth
+	static inline int     to_int32(uchar s)              { return ((int)s - 128) << 24; }
+	static inline uchar   from_int32(int v)              { return (uchar)(v / (1 << 24) + 128); }
+
+	// Conversion to and from [-1, 1) floats, used by the windowed-sinc resampler
+	static inline float   to_float(uchar s)              { return ((int)s - 128) * (1.0f / 128); }
+	static inline uchar   from_float(float v)            { return (uchar)clamp_sample<int>((int)floorf(v * 128 + 128.5f), 0, 255); }
+};
+
+// 16-bit samples are widened to 32 bits in the delay lines and take the Q31 coefficients of 24-bit ones,
+// as Q15 coefficients round the long rows of the converters to several LSBs away from their filters
+template<> struct SampleTraits<short>
+{	typedef int   delay_t;
+	typedef int   coef_t;
+	typedef llong accum_t;
+
+	static inline short   silence()                      { return 0; }
+	static inline delay_t load(short s)                  { return s; }
+	static inline short   store(accum_t acc, int shift)  { return (short)clamp_sample<llong>((acc + (1ll << (shift - 1))) >> shift, -32768, 32767); }
+
+	static inline int     to_int32(short s)              { return (int)s << 16; }
+	static inline short   from_int32(int v)              { return (short)(v >> 16); }
+
+	static inline float   to_float(short s)              { return s * (1.0f / 32768); }
+	static inline short   from_float(float v)            { return (short)clamp_sample<int>((int)floorf(v * 32768 + 0.5f), -32768, 32767); }
+};
+
+// 24-bit samples are widened to 32 bits in the delay lines, so the kernels read aligned words
+template<> struct SampleTraits<int24>
+{	typedef int   delay_t;
+	typedef int   coef_t;
+	typedef llong accum_t;
+
+	static inline int24   silence()                      { int24 s; s = 0; return s; }
+	static inline delay_t load(int24 s)                  { return (int)s; }
+	static inline int24   store(accum_t acc, int shift)  { int24 s; s = (int)clamp_sample<llong>((acc + (1ll << (shift - 1))) >> shift, -8388608, 8388607); return s; }
+
+	static inline int     to_int32(int24 s)              { return (int)s << 8; }
+	static inline int24   from_int32(int v)              { int24 s; s = v >> 8; return s; }
+
+	static inline float   to_float(int24 s)              { return (int)s * (1.0f / 8388608); }
+	static inline int24   from_float(float v)            { int24 s; s = (int)clamp_sample<double>(floor(v * 8388608.0 + 0.5), -8388608.0, 8388607.0); return s; }
+};
+
+// 32-bit samples times Q31 coefficients could overflow 64-bit accumulators, so they accumulate in doubles
+template<> struct SampleTraits<int>
+{	typedef int    delay_t;
+	typedef double coef_t;
+	typedef double accum_t;
+
+	static inline int     silence()                      { return 0; }
+	static inline delay_t load(int s)                    { return s; }
+	static inline int     store(accum_t acc, int)        { return (int)clamp_sample<double>(floor(acc + 0.5), -2147483648.0, 2147483647.0); }
+
+	static inline int     to_int32(int s)                { return s; }
+	static inline int     from_int32(int v)              { return v; }
+
+	// Floats keep 24 bits of the samples, which is the precision of the resampler for 32-bit waves
+	static inline float   to_float(int s)                { return (float)(s * (1.0 / 2147483648.0)); }
+	static inline int     from_float(float v)            { return (int)clamp_sample<double>(floor(v * 2147483648.0 + 0.5), -2147483648.0, 2147483647.0); }
+};
+
+template<> struct SampleTraits<float>
+{	typedef float delay_t;
+	typedef float coef_t;
+	typedef float accum_t;
+
+	static inline float   silence()                      { return 0; }
+	static inline delay_t load(float s)                  { return s; }
+	static inline float   store(accum_t acc, int)        { return acc; }
+
+	static inline int     to_int32(float s)              { return (int)clamp_sample<double>(floor(s * 2147483648.0 + 0.5), -2147483648.0, 2147483647.0); }
+	static inline float   from_int32(int v)              { return (float)(v * (1.0 / 2147483648.0)); }
+
+	static inline float   to_float(float s)              { return s; }
+	static inline float   from_float(float v)            { return v; }
+};
+
+#endif
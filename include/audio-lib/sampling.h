@@ -1,52 +1,184 @@
 #ifndef SAMPLING_H
 #define SAMPLING_H
 
+#include <audio-lib/fft.h>
 #include <audio-lib/filter.h>
+#include <audio-lib/kernels.h>
+#include <audio-lib/samples.h>
+#include <audio-lib/wave.h>
 
-typedef unsigned char uchar;
+class RateConverter;
+
+// Coefficient tables of a Rate Converter, shared by every converter with the
+// same factors, filter design and sample type through a process-wide cache
+// Half-band tables only keep the nonzero coefficients on one side of the centre,
+// followed by the centre coefficient, for interpolation and decimation by 2
+struct RateTables
+{	size_t L, M, taps;				// Factors and filter size of the converters
+	SampleType type;				// Sample type the coefficients are stored for
+	FIRWindow window;				// Window of the filters
+	int cutoff;						// Cutoff of the filters, in thousandths of the Nyquist frequency they protect
+	bool half_band;					// The filters are half-band, every other coefficient is zero and the others are symmetric
+
+	FIRFilter_i64 inter_filter;		// FIR Filter used for interpolation
+	FIRFilter_i64 decim_filter;		// FIR Filter used for decimation
+
+	void*  inter_coefs;				// Normalised interpolation coefficients regrouped into contiguous rows for each phase, NULL for decimation
+	void*  decim_coefs;				// Normalised decimation coefficients in the coefficient type of the samples, NULL unless decimating
+	int    coef_shift;				// Fraction bits of fixed-point coefficients
+
+	FFT    fft;						// Transform of the overlap-save convolutions, of size 0 for the direct path
+	double* fft_spectra;			// Transforms of the reversed coefficient rows split into limbs, scaled by 1/size
+	int    fft_limbs;				// Limbs each fixed-point coefficient is split into, so the transforms stay exact
+
+	int refs;						// Number of converters holding the tables
+	RateTables* next;				// Next entry of the cache
+};
+
+// Finds the coefficient tables of a converter in the cache, building them if no converter holds them yet
+// Every acquired entry must be released once, the last release deallocates it
+// Half-band tables always cut off at a quarter of the filters' rate, whatever the cutoff asked for
+// Integer steps of 8, 16 and 24-bit samples whose longest blocks of outputs cost less through transforms than
+// through the direct path also get the transforms of their rows, so their converters run overlap-save convolutions
+// With the SIMD kernels of the direct path, it takes about 300 taps for each unit of the factor for 8 and 16-bit
+// interpolations and 130 for 24-bit ones, and more for decimations, far more than the quality tiers' steps have
+const RateTables* acquire_rate_tables(size_t L, size_t M, size_t taps, SampleType type, FIRWindow window = Window_Hamming, int cutoff = 1000, bool half_band = false);
+// Removes a holder of the tables, deallocating them with the last one
+void release_rate_tables(const RateTables* tables);
+
+// Converter of n "blocks" specialised at compile time for the factors and taps of a Rate Converter
+typedef int (*fixed_rate_fn)(RateConverter &cnv, const void* src, void* dst, size_t blocks);
 
 class RateConverter
 {
 public:
 	size_t L, M;					// Interpo(L)ation and Deci(M)ation factors of the conversion
 	size_t num_channels;			// Number of channels of the data beign converted
-	size_t bit_depth;				// Bit Depth of the data being ocnverted
+	SampleType sample_type;			// Type of the samples being converted
 
 	FIRFilter_i64 inter_filter;		// FIR Filter used for interpolation
-	size_t* inter_delay_idxs;		// Indexes of the last data for each channel's interpolation delay line
-	void**  inter_delay_lines;		// Delay lines for each channel to store samples for interpolation
+	size_t inter_delay_idx;			// Index of the oldest sample in the interpolation delay lines
+	size_t inter_phase;				// Phase of the next kept interpolated block (non-integral)
+	void*  inter_delay_lines;		// Mirrored delay lines of each channel side by side, for interpolation
 
 	FIRFilter_i64 decim_filter;		// FIR Filter used for decimation
-	size_t* decim_fractions;		// Fraction count of the samples present for decimation
-	size_t* decim_delay_idxs;		// Indexes of the last data for each channel's decimation delay line
-	void**  decim_delay_lines;		// Delay lines for each channel to store samples for decimation
+	size_t decim_fraction;			// Fraction count of the blocks present for decimation
+	size_t decim_delay_idx;			// Index of the oldest sample in the decimation delay lines
+	void*  decim_delay_lines;		// Mirrored delay lines of each channel side by side, for decimation
+
+	const RateTables* tables;		// Shared coefficient tables of the converter
+	const void* inter_coefs;		// Normalised interpolation coefficients regrouped into contiguous rows for each phase
+	const void* decim_coefs;		// Normalised decimation coefficients in the coefficient type of the samples
+	int coef_shift;					// Fraction bits of fixed-point coefficients, the rounding shift of the outputs
+
+	const FIRKernels* kernels;		// Convolution kernels selected for the CPU
+	fixed_rate_fn fixed_kernel;		// Kernel specialised at compile time for the converter, NULL for the generic path
+
+	size_t inter_size;				// Size of the interpolation delay lines
+	size_t decim_size;				// Size of the decimation delay lines
+	bool half_band;					// The converter is a half-band stage, only the nonzero coefficients are convolved
+	double* fft_buffer;				// Transforms of a pair of channels and their convolutions, NULL for the direct path
 
-	llong* inter_scales; 			// Coefficient scaling values of the L interpolated samples
-	llong  decim_scale; 			// Coefficient scaling values of the decimated samples
+	// Allocates the delay lines for a sample type
+	template<typename T> void init_delay_lines();
+	// Fills the delay lines with the silence of a sample type
+	template<typename T> void silence_delay_lines();
 
 public:
 	RateConverter();
-	RateConverter(size_t L, size_t M, size_t taps, size_t channels, size_t depth);
+	RateConverter(size_t L, size_t M, size_t taps, size_t channels, SampleType type, FIRWindow window = Window_Hamming, int cutoff = 1000, bool half_band = false);
 	~RateConverter();
 
 	// Initializes the filters and buffers for the converter
-	void init(size_t L, size_t M, size_t taps, size_t channels, size_t depth);
+	// The filters are windowed by "window" and cut off at "cutoff" thousandths of the Nyquist frequency
+	// Half-band converters interpolate or decimate by 2 with "taps" = 4k-1 coefficients, of which
+	// only the k pairs around the centre are nonzero, so their convolutions add each pair's samples
+	// first and need about a quarter of the multiplications of the generic ones
+	// Integer interpolation and decimation with long filters convolve blocks of the delay lines
+	// through FFTs (overlap-save), with the same outputs as the direct convolutions
+	void init(size_t L, size_t M, size_t taps, size_t channels, SampleType type, FIRWindow window = Window_Hamming, int cutoff = 1000, bool half_band = false);
 	// Deallocates all dynamic resources
 	void clear();
+	// Brings the converter back to its state after init, without allocating anything
+	void reset();
+
+	// Decimation of n "blocks" from src to dst, all channels in a single pass
+	template<typename T> int decimation(const T* src, T* dst, size_t blocks);
+	// Interpolation of n "blocks" from src to dst, all channels in a single pass
+	template<typename T> int interpolation(const T* src, T* dst, size_t blocks);
+	// Interpolation and Decimation of n "blocks" from src to dst, all channels in a single pass
+	template<typename T> int non_integral(const T* src, T* dst, size_t blocks);
+
+	// Advances the phase of the conversion by n "blocks" without converting them
+	// The delay lines are left as they are, until new blocks refresh them
+	// Returns the number of blocks the conversion would have output
+	size_t skip(size_t blocks);
+};
+
+// Finds a kernel specialised at compile time for the factors, taps, window, cutoff and sample type of a converter
+// Its filters are designed with that cutoff, in thousandths of the Nyquist frequency they protect
+// Returns NULL if there is none, so the converter runs the generic path
+fixed_rate_fn find_fixed_kernel(size_t L, size_t M, size_t taps, FIRWindow window, int cutoff, SampleType type);
+
+// Windowed-sinc resampler for any ratio of sampling rates, including non-integer ratios
+// that change while converting, where the L/M cascade of Rate Converters can't be planned
+// A fractional phase accumulator picks the two nearest phases of a Kaiser windowed sinc table
+// and interpolates between their outputs, so every output block costs the same for any ratio
+class SincResampler
+{
+public:
+	size_t num_channels;			// Number of channels of the data beign converted
+	SampleType sample_type;			// Type of the samples being converted
+
+	double ratio;					// Output sampling rate divided by the input sampling rate
+	llong  step;					// Input blocks advanced per output block, as 32.32 fixed-point
+	llong  position;				// Position of the next output block after the centre of the delay lines, as 32.32 fixed-point
+
+	size_t zero_crossings;			// Zero crossings of the sinc on each side of its centre, at the lowest cutoff
+	double beta;					// Shape parameter of the Kaiser window
+	double cutoff;					// Cutoff frequency of the table, relative to the input Nyquist frequency
+	size_t taps;					// Number of coefficients of each phase
+	float* table;					// Coefficients of every phase (one more than the phase count), normalised to a gain of one
+
+	size_t delay_idx;				// Index of the oldest sample in the delay lines
+	float* delay_lines;				// Mirrored delay lines of each channel side by side
+
+	const FIRKernels* kernels;		// Convolution kernels selected for the CPU
+
+	// Designs the table for a cutoff with "half" coefficients on each side of its centre,
+	// and resizes the delay lines to its taps, keeping the newest samples
+	void design(double cutoff, size_t half);
+
+public:
+	SincResampler();
+	SincResampler(double ratio, size_t channels, SampleType type);
+	~SincResampler();
+
+	// Initializes the table and delay lines for a ratio of output over input sampling rates
+	void init(double ratio, size_t channels, SampleType type, size_t zero_crossings = 32, double beta = 8.0);
+	// Deallocates all dynamic resources
+	void clear();
+	// Silences the delay lines and brings the position back to its start, the table is kept
+	void reset();
+
+	// Changes the ratio between two conversions, the table is only designed again
+	// when the cutoff must drop below the current one or rise far above it
+	// The taps only grow, so the outputs stay continuous across the changes
+	void set_ratio(double ratio);
+	// Largest number of blocks output for n input "blocks"
+	size_t max_output(size_t blocks) const;
+	// Largest number of blocks output for n input "blocks" by a resampler of a ratio
+	static size_t max_output(double ratio, size_t blocks);
+	// Number of coefficients of each phase of the table designed for a ratio
+	static size_t phase_taps(double ratio, size_t zero_crossings = 32);
+
+	// Resampling of n "blocks" from src to dst, all channels in a single pass
+	template<typename T> int process(const T* src, T* dst, size_t blocks);
 
-	// Decimation of n 8-Bit "samples" from src to dst in a wave with some "channels"
-	int decimation(const uchar* src, uchar* dst, size_t channel, size_t samples);
-	// Interpolation of n 8-Bit "samples" from src to dst in a wave with some "channels"
-	int interpolation(const uchar* src, uchar* dst, size_t channel, size_t samples);
-	// Interpolation and Decimation of n 8-Bit "samples" from src to dst in a wave with some "channels"
-	int non_integral(const uchar* src, uchar* dst, size_t channel, size_t samples);
-
-	// Decimation of n 16-Bit "samples" from src to dst in a wave with some "channels"
-	int decimation(const short* src, short* dst, size_t channel, size_t samples);
-	// Interpolation of n 16-Bit "samples" from src to dst in a wave with some "channels"
-	int interpolation(const short* src, short* dst, size_t channel, size_t samples);
-	// Interpolation and Decimation of n 16-Bit "samples" from src to dst in a wave with some "channels"
-	int non_integral(const short* src, short* dst, size_t channel, size_t samples);
+	// Advances the position of the resampler by n "blocks" without converting them
+	// The delay lines are left as they are, until new blocks refresh them
+	// Returns the number of blocks the resampler would have output
+	size_t skip(size_t blocks);
 };
 
 #endif
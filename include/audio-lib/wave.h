@@ -4,13 +4,15 @@
 // Information taken from online at:
 // http://soundfile.sapp.org/doc/WaveFormat/
 
-enum Channel    { _Mono=1,  _Stereo=2 };
-enum SampleSize { _8Bit=8, _16Bit=16  };
+enum Channel     { _Mono=1,  _Stereo=2 };
+enum SampleSize  { _8Bit=8, _16Bit=16, _24Bit=24, _32Bit=32 };
+enum AudioFormat { _PCM=1, _IEEEFloat=3 };
+enum SampleType  { _UInt8, _Int16, _Int24, _Int32, _Float, _Unsupported };
 enum Frequency  { _8kHz=8000, _11kHz=11025, _16kHz=16000, _22kHz=22050, _24kHz=24000, _32kHz=32000, _44kHz=44100, _48kHz=48000, _88kHz=88200, _96kHz=96000};
 
 struct WaveFmt
 {   
-    short audioFormat;                          // PCM = 1 Values other than 1 indicate some form of compression
+    short audioFormat;                          // PCM = 1, IEEE Float = 3, other values indicate some form of compression
     short numChannels;                          // Mono = 1, Stereo = 2, etc
     long  sampleRate;                           // 8000, 44100, etc.
     long  byteRate;                             // SampleRate * NumChannels * BitsPerSample/8
@@ -35,7 +37,10 @@ struct WAVEHeader
 bool operator==(const WaveFmt &a, const WaveFmt &b);
 bool operator!=(const WaveFmt &a, const WaveFmt &b);
 
-WaveFmt makeWaveFmt(short numChannels, short bitsPerSample, long sampleRate);
+WaveFmt makeWaveFmt(short numChannels, short bitsPerSample, long sampleRate, short audioFormat = _PCM);
+
+// Finds the type of the samples in a wave from its format and bit depth
+SampleType getSampleType(const WaveFmt &fmt);
 
 bool isCorrectHeader(WAVEHeader &hdr);
 
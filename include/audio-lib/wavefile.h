@@ -0,0 +1,39 @@
+#ifndef WAVEFILE_H
+#define WAVEFILE_H
+
+#include <audio-lib/wave.h>
+#include <cpthread/cplatforms.h>
+#include <stddef.h>
+#if defined PLATFORM_WINDOWS
+#include <windows.h>
+#endif
+
+// Wave file mapped in memory, which the Audio Sources read without loading it first
+// The chunks of the header are walked for the fmt and data chunks, and the pages of the data region
+// are only read from the disk once the workers convert them, and dropped by the system when it needs them
+class WaveFile
+{
+#if defined PLATFORM_WINDOWS
+	HANDLE file;				// Opened file
+	HANDLE mapping;				// Mapping object of the file
+#endif
+	char* view;					// Mapped bytes of the whole file, NULL if no file is mapped
+	size_t view_size;			// Number of bytes of the file
+
+public:
+	WaveFmt fmt;				// Format of the samples of the file
+	const char* data;			// Data region of the file
+	size_t blocks;				// Number of blocks in the data region
+
+	WaveFile();
+	~WaveFile();
+
+	// Maps the file and validates its header, the chunks other than fmt and data are skipped
+	// Returns false if the file can't be mapped, isn't a wave or its samples are of an unsupported type
+	bool open(const char* filename);
+
+	// Unmaps the file
+	void close();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Process-wide workers converting the data of every Audio Source, instead of threads of each source
+// A source submits its task whenever it has data to convert, and a worker runs the task one bounded
+// step at a time, then puts it back at the end of its queue, so the sources take turns at the workers
+//  - Ordering: a task is queued or running at most once, so a single worker runs its steps at a time,
+//              and the converters of a source see its nodes in order
+//  - Stealing: each worker has its own queue, a worker without tasks takes the oldest task of another
+//  - Idle:     workers wait on a shared signal, set by the submissions and by the workers leaving tasks queued
+
+#define MAX_CONVERSION_WORKERS 8        // Most worker threads, whatever the number of processors
+
+// States of a task between its submissions and the steps of the workers
+enum TaskState
+{	Task_Idle,					// Not queued, nothing left to convert
+	Task_Queued,				// Waiting in the queue of a worker
+	Task_Running,				// A worker runs a step of the task
+	Task_Resubmitted			// A worker runs a step, and the task was submitted again meanwhile
+};
+
+// Work of a source, run by the workers through its step function
+struct WorkerTask
+{	bool (*step)(void* data);			// Converts a bounded part of the work, returns true if there is more to convert
+	void* data;							// Argument of the step function, the source itself
+
+	std::atomic<int> state;				// TaskState of the task
+	std::atomic<bool> cancelled;		// The workers drop the task instead of running its next step
+	WorkerTask* next;					// Next task of the worker queue the task waits in
+
+	WorkerTask(bool (*step)(void*), void* data);
+};
+
+// Queues the task to run its steps until it has nothing left to convert
+// Does nothing if the task is already queued, and runs it again if a worker is running a step
+void submit_task(WorkerTask* task);
+
+// Takes the task out of the workers, waiting for the step a worker runs to finish
+// Once it returns no worker touches the task anymore, until it is submitted again
+void cancel_task(WorkerTask* task);
+
+// Sets the number of worker threads, within 1 and MAX_CONVERSION_WORKERS
+// The workers start with the first submission and run until the process exits, so later calls have no effect
+// By default there is one worker per processor, leaving one to the playback
+void set_conversion_workers(int threads);
+
+// Returns the number of worker threads, started or to be started
+int get_conversion_workers();
+
+#endif
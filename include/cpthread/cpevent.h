@@ -26,19 +26,26 @@ public:
 private:
 	pthread_cond_t cnd;
 	pthread_mutex_t mtx;
-	int timestr;
+	bool flag;
 
 public:
-	inline signal() {	pthread_mutex_init(&mtx, NULL); pthread_cond_init(&cnd, NULL); }
+	inline signal() : flag(false) {	pthread_mutex_init(&mtx, NULL); pthread_cond_init(&cnd, NULL); }
 	inline ~signal() { pthread_mutex_destroy(&mtx); pthread_cond_destroy(&cnd); }
-	inline void set() { pthread_cond_signal(&cnd); }
+	inline void set() { pthread_mutex_lock(&mtx); flag = true; pthread_cond_signal(&cnd); pthread_mutex_unlock(&mtx); }
 	inline void wait(int waitTime =-1) 
 	{
+		//Like the Windows auto-reset events, a set before the wait isn't lost and wakes a single waiter
 		struct timespec t = { 0,0 }; 
 		clock_gettime(CLOCK_REALTIME, &t); 
-		t.tv_sec += waitTime; 
+		t.tv_sec  += waitTime / 1000;
+		t.tv_nsec += (waitTime % 1000) * 1000000;
+		t.tv_sec  += t.tv_nsec / 1000000000;
+		t.tv_nsec %= 1000000000;
 		
-		waitTime != -1 ? pthread_cond_timedwait(&cnd, &mtx, &t) : pthread_cond_wait(&cnd, &mtx); 
+		pthread_mutex_lock(&mtx);
+		while(!flag && (waitTime != -1 ? pthread_cond_timedwait(&cnd, &mtx, &t) : pthread_cond_wait(&cnd, &mtx)) == 0) { }
+		flag = false;
+		pthread_mutex_unlock(&mtx);
 	}
 #endif
 };
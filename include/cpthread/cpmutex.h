@@ -11,6 +11,7 @@
 //A Windows-Unix cross platform encapsulation of mutex locking.
 //The lock is an event on Windows, while a mutex variable on Unix.
 //The lock can be locked/unlocked with interfacing functions.
+//try_lock takes the lock only if it is free, and returns false instead of waiting.
 class mutex
 {
 #if defined PLATFORM_WINDOWS
@@ -20,6 +21,7 @@ private:
 public:
 	inline mutex() : lck(CreateEvent(NULL, false, true, false)) {}
 	inline void lock() { WaitForSingleObject(lck, INFINITE); }
+	inline bool try_lock() { return WaitForSingleObject(lck, 0) == WAIT_OBJECT_0; }
 	inline void unlock() { SetEvent(lck); }
 
 #elif defined PLATFORM_UNIX
@@ -30,6 +32,7 @@ public:
 	inline mutex() {pthread_mutex_init(&lck, NULL); }
 	inline ~mutex() {pthread_mutex_destroy(&lck); }
 	inline void lock() { pthread_mutex_lock(&lck); }
+	inline bool try_lock() { return pthread_mutex_trylock(&lck) == 0; }
 	inline void unlock() { pthread_mutex_unlock(&lck); }
 #endif
 };
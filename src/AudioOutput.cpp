@@ -247,11 +247,11 @@ int AudioOutput::closeDevice()
 AudioSource* AudioOutput::createSource(unsigned char flags)
 {
 	if (head == NULL)
-	{	head = new AudioNode{ AudioSource(supported_fmt, flags), NULL };
+	{	head = new AudioNode(supported_fmt, flags);
 		tail = head;
 	}
 	else
-	{	//tail->next = new AudioNode{ AudioSource(supported_fmt, flags), NULL };
+	{	tail->next = new AudioNode(supported_fmt, flags);
 		tail = tail->next;
 	}
 
@@ -260,8 +260,14 @@ AudioSource* AudioOutput::createSource(unsigned char flags)
 
 int adjustFormat(const unsigned long long supported, const WaveFmt &sample, WaveFmt &adjusted)
 {
-	size_t num_channels_index = sample.numChannels - 1;
-	size_t sample_size_index = (sample.bitsPerSample >> 3) - 1;
+	SampleType sample_type = getSampleType(sample);
+
+	// The device is only probed for 8 and 16-bit formats, so deeper or float
+	// samples it can't play directly are matched against the 16-bit formats
+	// It is only probed in mono and stereo too, surround waves are matched against
+	// the stereo formats and downmixed by the converter of the Audio Source
+	size_t num_channels_index = sample.numChannels > 2 ? 1 : sample.numChannels - 1;
+	size_t sample_size_index = sample_type == _UInt8 ? 0 : 1;
 	size_t frequency_index;
 
 	for(frequency_index=0; FrequencyList[frequency_index] != 0; frequency_index++)
@@ -270,7 +276,7 @@ int adjustFormat(const unsigned long long supported, const WaveFmt &sample, Wave
 		}
 	}
 
-	if(	num_channels_index <= 1 && sample_size_index <= 1 && (sample.bitsPerSample & 7) == 0)
+	if(	num_channels_index <= 1 && sample_type != _Unsupported)
 	{	
         unsigned long long faster_sampling    = supported &  frequencyMasks[frequency_index];
         unsigned long long slower_sampling    = supported & ~frequencyMasks[frequency_index];
@@ -402,44 +408,60 @@ int AudioOutput::setFormat(short channels, short bitsPerSample, long samplesPerS
 void AudioOutput::getAudioData(char* buffer, int blocks)
 {
 	int buffer_bytes = blocks * supported_fmt.blockAlign;
-	int sample_size  = supported_fmt.bitsPerSample >> 3;
+	SampleType sample_type = getSampleType(supported_fmt);
 
 
 	AudioNode* tmp = head;
 	while (tmp != NULL)
 	{	(tmp->source).take(mixer_buffer, blocks);
-		mixAudioData(buffer, mixer_buffer, buffer_bytes, sample_size);
+		mixAudioData(buffer, mixer_buffer, buffer_bytes, sample_type);
 		tmp = tmp->next;
 	}
 }
 
 // Mix n blocks of audio data B into A
-void AudioOutput::mixAudioData(char* A, char* B, int buffer_size, int sample_size)
+void AudioOutput::mixAudioData(char* A, char* B, int buffer_size, SampleType sample_type)
 {
 	long long llA;
 	long long llB;
 	long long accumulator;
+	float fA, fB;
+
+	int sample_size = sample_type == _UInt8 ? 1 :
+					  sample_type == _Int16 ? 2 :
+					  sample_type == _Int24 ? 3 : 4;
 	
 	for(int i = 0; i < buffer_size; i += sample_size)
 	{
-		if(sample_size == 1)
+		if(sample_type == _UInt8)
 		{	llA = ((int)*(uchar*)(A+i)) - 128;
 			llB = ((int)*(uchar*)(B+i)) - 128;
 			accumulator = llA + llB - ((llA*llB) >> 8);
 			*(uchar*)(A+i) = (uchar)accumulator + 128;
 		}
-		else if(sample_size == 2)
+		else if(sample_type == _Int16)
 		{	llA = *(short*)(A+i);
 			llB = *(short*)(B+i);
 			accumulator = llA + llB - ((llA*llB) >> 16);
 			*(short*)(A+i) = (short)accumulator;
 		}
-		else if(sample_size == 4)
+		else if(sample_type == _Int24)
+		{	llA = *(int24*)(A+i);
+			llB = *(int24*)(B+i);
+			accumulator = llA + llB - ((llA*llB) >> 24);
+			*(int24*)(A+i) = (int)accumulator;
+		}
+		else if(sample_type == _Int32)
 		{	llA = *(int*)(A+i);
 			llB = *(int*)(B+i);
 			accumulator = llA + llB - ((llA*llB) >> 32);
 			*(int*)(A+i) = (int)accumulator;
 		}
+		else if(sample_type == _Float)
+		{	fA = *(float*)(A+i);
+			fB = *(float*)(B+i);
+			*(float*)(A+i) = fA + fB - fA*fB;
+		}
 	}
 }
 
@@ -1,73 +1,113 @@
 #include <audio-lib/AudioSource.h>
-
-THREAD primary_data_processor(void* lparam)
+#include <new>
+
+// Converts a node of a source on one of the process-wide workers, which run a single step of a source
+// at a time, in the order of its nodes, then let the other sources take their turn
+//  - Streaming: the next chunk of the ring the producer published, only this step advances the converted
+//               index, so it never holds a lock the producer or the playback could wait on
+//  - Buffered:  the next node from the starting node, then the next node before it after a reset,
+//               with a converter of its own as it follows another sequence of nodes
+//               The nodes of the source's format are skipped, as they are played from their original data
+// Returns true if nodes are left to convert
+bool conversion_step(void* lparam)
 {
 	AudioSource* asrc = (AudioSource*)lparam;
 	AudioSource::DataNode* this_node;
 
-	while(asrc->handler_active)
+	// The playback of a lazy source may hold the primary converter, converting the node it needs
+	if(asrc->converting.exchange(true, std::memory_order_acquire))
+	{	return true;
+	}
+
+	if(asrc->ring != NULL)
 	{
-		asrc->proc_mutex.lock();
-		this_node = asrc->proc;
+		// Wave files are added by the workers instead of a producer
+		if(asrc->file.load(std::memory_order_acquire) != NULL)
+		{	asrc->read_file();
+		}
 
-		if(this_node != NULL)
-		{	
-			// Reset the Format Converter if the new node's format is different 
-			if(	asrc->converter.in_fmt != this_node->fmt)
-			{	asrc->converter.init(this_node->fmt, asrc->audio_fmt);
-			}
+		// After a reset, the chunks are only converted again once the playback stopped taking the old ones,
+		// the playback submits the conversion when it acknowledges the reset
+		asrc->rewind_chunks();
+		if(asrc->reset_done.load(std::memory_order_relaxed) != asrc->reset_request.load(std::memory_order_acquire))
+		{	asrc->converting.store(false, std::memory_order_release);
+			return false;
+		}
 
-			asrc->process_node(&(asrc->converter), this_node);
+		size_t index = asrc->ring_convert.load(std::memory_order_relaxed);
 
-			// Move to the next node for processing it
-			asrc->proc = asrc->proc->next;
-			asrc->proc_mutex.unlock();
+		// If all chunks are converted, wait for the producer to add more
+		if(index == asrc->ring_write.load(std::memory_order_acquire))
+		{	asrc->converting.store(false, std::memory_order_release);
+			return false;
 		}
-		// If all nodes are processed, go to sleep
-		else
-		{	asrc->proc_mutex.unlock();
-			asrc->insert_sig.wait();
+
+		this_node = &asrc->ring[index & (STREAM_RING_CHUNKS - 1)];
+
+		// Reset the Format Converter if the new chunk's format is different
+		if(	asrc->converter.in_fmt != this_node->fmt)
+		{	asrc->converter.init(this_node->fmt, asrc->audio_fmt);
 		}
+
+		asrc->process_node(&(asrc->converter), this_node);
+
+		// Hand the chunk over to the playback
+		asrc->ring_convert.store(++index, std::memory_order_release);
+		asrc->converting.store(false, std::memory_order_release);
+		return index != asrc->ring_write.load(std::memory_order_acquire);
 	}
 
-	return 0;
-}
+	asrc->proc_mutex.lock();
+	this_node = asrc->proc;
 
-THREAD secondary_data_processor(void* lparam)
-{
-	AudioSource* asrc = (AudioSource*)lparam;
-	AudioSource::DataNode* this_node = asrc->head;
-	AudioSource::DataNode* end_node  = asrc->curr;
+	if(this_node != NULL)
+	{	
+		if(this_node->processed == NULL)
+		{
+			// Reset the Format Converter if the new node's format is different 
+			if(	asrc->converter.in_fmt != this_node->fmt)
+			{	asrc->converter.init(this_node->fmt, asrc->audio_fmt);
+			}
 
-	// If the Audio Source starts from the beginning, there is no need
-	// for a secondary data processor, and the thread can quit
-	if(this_node == NULL)
-	{	return 0;
+			asrc->process_node(&(asrc->converter), this_node);
+		}
+
+		// Move to the next node for processing it
+		asrc->proc = asrc->proc->next;
 	}
 
-	// Set up the converter for the secondary processor
-	FormatConverter converter(this_node->fmt, asrc->audio_fmt);
+	bool more = asrc->proc != NULL;
+	asrc->proc_mutex.unlock();
+	asrc->converting.store(false, std::memory_order_release);
 
-	while(asrc->handler_active)
+	// The nodes before the starting node are processed along, until they caught up to it
+	this_node = asrc->back;
+
+	if(this_node != asrc->back_end)
 	{
-		// If the secondary processor caught up to the start of the stream
-		// The thread can quit as it processed all nodes it is responsible for
-		if(this_node == end_node)
-		{	break;
-		}
+		if(this_node->processed == NULL)
+		{
+			if(asrc->back_converter == NULL)
+			{	asrc->back_converter = new FormatConverter(this_node->fmt, asrc->audio_fmt, asrc->quality);
+			}
+			else if(asrc->back_converter->in_fmt != this_node->fmt)
+			{	asrc->back_converter->init(this_node->fmt, asrc->audio_fmt);
+			}
 
-		// Reset the Format Converter if the new node's format is different 
-		if(	converter.in_fmt != this_node->fmt)
-		{	converter.init(this_node->fmt, asrc->audio_fmt);
+			asrc->process_node(asrc->back_converter, this_node);
 		}
 
-		asrc->process_node(&converter, this_node);
-
 		// Move to the next node for processing
-		this_node = this_node->next;
+		asrc->back = this_node->next;
 	}
 
-	return 0;
+	if(asrc->back == asrc->back_end)
+	{	delete asrc->back_converter;
+		asrc->back_converter = NULL;
+		return more;
+	}
+
+	return true;
 }
 
 /*THREAD audio_data_manager(void* lparam)
@@ -105,17 +145,22 @@ THREAD secondary_data_processor(void* lparam)
 	}
 }*/
 
-AudioSource::AudioSource(WaveFmt fmt, unsigned char flags)
-	: audio_fmt(fmt),
+AudioSource::AudioSource(WaveFmt fmt, unsigned char flags, ResampleQuality quality)
+	: audio_fmt(fmt), quality(quality),
 	head(NULL), tail(NULL), curr(NULL), proc(NULL), offset(0),
+	ring(NULL), ring_write(0), ring_convert(0), ring_read(0), reset_request(0), reset_ack(0), reset_done(0),
+	ring_feed(Feed_None), file(NULL), file_share(NULL), file_pos(0),
+	task(conversion_step, this), converting(false), back_converter(NULL), back(NULL), back_end(NULL),
 	empty_persist( (flags & AS_FLAG_PERSIST ) > 0),
 	data_buffered( (flags & AS_FLAG_BUFFERED) > 0),
 	audio_looped ( (flags & AS_FLAG_LOOPED  ) > 0),
-	converter(fmt, fmt)
+	convert_lazy ( (flags & AS_FLAG_LAZY    ) > 0),
+	converter(fmt, fmt, quality)
 {
-	handler_active = true;
-	pre_handler.create(secondary_data_processor, this);
-	post_handler.create(primary_data_processor, this);
+	// Data that isn't kept after it is taken streams through the ring, whose chunks are reused
+	if(!data_buffered)
+	{	ring = new DataNode[STREAM_RING_CHUNKS]();
+	}
 }
 
 AudioSource::~AudioSource()
@@ -141,11 +186,11 @@ void AudioSource::add(const char* data, size_t blocks, const WaveFmt &fmt)
 
 	while(blocks > 0)
 	{
-		this_node = new DataNode{ fmt, NULL, 0, NULL, 0, NULL };
+		this_node = new(pool_alloc(sizeof(DataNode))) DataNode{ fmt, NULL, 0, 0, NULL, NULL, 0, 0, NULL };
 
 		copy_amount = blocks > max_blocks_in ? max_blocks_in : blocks;
 
-		this_node->origin    = new char[copy_amount  * fmt.blockAlign];
+		this_node->origin    = (char*)pool_alloc(copy_amount  * fmt.blockAlign);
 		this_node->orig_len  = copy_amount;
 
 		memcpy(this_node->origin, src, copy_amount * fmt.blockAlign);
@@ -168,10 +213,85 @@ void AudioSource::add(const char* data, size_t blocks, const WaveFmt &fmt)
 
 // Adds n blocks of data to the end of the Audio Source
 // The input is chopped into smaller units but doesn't get
-void AudioSource::add_async(const char* data, size_t blocks, const WaveFmt &fmt)
+bool AudioSource::add_async(const char* data, size_t blocks, const WaveFmt &fmt)
 {
+	return add_nodes(data, blocks, fmt, NULL);
+}
+
+// Releases a buffer handed over without a release function
+static void delete_buffer(char* data, void* context)
+{
+	delete[] data;
+}
+
+// Adds n blocks of data the Audio Source takes the ownership of, without copying them
+// The share holds a view of its own until all nodes are added, so the nodes already taken can't release it
+bool AudioSource::add_owned(char* data, size_t blocks, const WaveFmt &fmt, release_fn release, void* context)
+{
+	DataShare* share = new(pool_alloc(sizeof(DataShare))) DataShare{ data, release != NULL ? release : delete_buffer, context };
+	share->refs.store(1, std::memory_order_relaxed);
+
+	bool added = add_nodes(data, blocks, fmt, share);
+	release_share(share);
+	return added;
+}
+
+// Adds n blocks of data that outlive the Audio Source, static or memory-mapped, without copying them
+bool AudioSource::add_borrowed(const char* data, size_t blocks, const WaveFmt &fmt)
+{
+	DataShare* share = new(pool_alloc(sizeof(DataShare))) DataShare{ (char*)data, NULL, NULL };
+	share->refs.store(1, std::memory_order_relaxed);
+
+	bool added = add_nodes(data, blocks, fmt, share);
+	release_share(share);
+	return added;
+}
+
+// Chops the data into nodes, or the chunks of the ring, which copy it or view the shared buffer
+bool AudioSource::add_nodes(const char* data, size_t blocks, const WaveFmt &fmt, DataShare* share)
+{
+	// The workers are the producer of a ring fed by wave files
+	if(ring != NULL && !claim_feed(Feed_Producer))
+	{	return false;
+	}
+
 	size_t max_blocks_in = FormatConverter::find_max_input_size(fmt) * MAX_NODE_UNITS;	
 	size_t copy_amount;
+
+	// The playback of a lazy source converts the nodes with what is set up here, as it can't wait nor allocate
+	size_t proc_bytes = convert_lazy ? prepare_lazy(fmt) : 0;
+
+	// Streaming sources copy each unit into the next free chunk of the ring, and publish it to the
+	// workers by advancing the added index, the chunks only grow their buffers when needed
+	// Chunks viewing a shared buffer give their own buffer up, and keep their view until reused
+	if(ring != NULL)
+	{
+		size_t index = ring_write.load(std::memory_order_relaxed);
+		DataNode* chunk;
+
+		while(blocks > 0)
+		{
+			// Wait for the playback to free a chunk, submitting the conversion so it doesn't wait too
+			if(index - ring_read.load(std::memory_order_acquire) == STREAM_RING_CHUNKS)
+			{	submit_task(&task);
+				thread::sleep(STREAM_RING_WAIT);
+				continue;
+			}
+
+			chunk = &ring[index & (STREAM_RING_CHUNKS - 1)];
+			copy_amount = blocks > max_blocks_in ? max_blocks_in : blocks;
+
+			write_chunk(chunk, data, copy_amount, max_blocks_in, fmt, share);
+			reserve_processed(chunk, proc_bytes);
+			ring_write.store(++index, std::memory_order_release);
+
+			data   += copy_amount * fmt.blockAlign;
+			blocks -= copy_amount;
+		}
+
+		submit_task(&task);
+		return true;
+	}
 	
 	// Local data and chain pointers
 	char* src = (char*)data;
@@ -184,13 +304,28 @@ void AudioSource::add_async(const char* data, size_t blocks, const WaveFmt &fmt)
 	// Break input into a local chain of smaller nodes
 	while(blocks > 0)
 	{
-		this_node   = new DataNode{ fmt, NULL, 0, NULL, 0, NULL };
+		this_node   = new(pool_alloc(sizeof(DataNode))) DataNode{ fmt, NULL, 0, 0, NULL, NULL, 0, 0, NULL, NULL };
 		copy_amount = blocks > max_blocks_in ? max_blocks_in : blocks;
 
-		this_node->origin   = new char[copy_amount * fmt.blockAlign];
+		if(share != NULL)
+		{	share->refs.fetch_add(1, std::memory_order_relaxed);
+			this_node->origin = src;
+			this_node->share  = share;
+		}
+		else
+		{	this_node->origin = (char*)pool_alloc(copy_amount * fmt.blockAlign);
+			memcpy(this_node->origin, src, copy_amount * fmt.blockAlign);
+		}
+
 		this_node->orig_len = copy_amount;
 
-		memcpy(this_node->origin, src, copy_amount * fmt.blockAlign);
+		// Nodes of the Audio Source's format are played straight from their original data
+		if(fmt == audio_fmt)
+		{	this_node->processed = this_node->origin;
+			this_node->proc_len  = copy_amount;
+		}
+
+		reserve_processed(this_node, proc_bytes);
 		
 		src += copy_amount * fmt.blockAlign;
 		size+= sizeof(DataNode);
@@ -207,7 +342,7 @@ void AudioSource::add_async(const char* data, size_t blocks, const WaveFmt &fmt)
 	}
 
 	// Wait for the main chain to be modifiable, then add the local chain to 
-	// the main chain. If needed, notify the processor thread to wake up
+	// the main chain. If needed, submit the conversion to the workers
 	proc_mutex.lock();
 	
 	if(head == NULL)
@@ -222,10 +357,119 @@ void AudioSource::add_async(const char* data, size_t blocks, const WaveFmt &fmt)
 
 	if(proc == NULL)
 	{	proc = head_node;
-		insert_sig.set();
+		submit_task(&task);
 	}
 
 	proc_mutex.unlock();
+	return true;
+}
+
+// Fills a chunk of the ring with n blocks, copied or viewed in the shared buffer
+// Copies go to the chunk's own buffer, which only grows when needed
+void AudioSource::write_chunk(DataNode* chunk, const char* data, size_t blocks, size_t max_blocks, const WaveFmt &fmt, DataShare* share)
+{
+	// A chunk played from its original data drops the alias before the data is replaced
+	if(chunk->processed == chunk->origin)
+	{	chunk->processed = NULL;
+		chunk->proc_size = 0;
+	}
+
+	if(share != NULL)
+	{	release_origin(chunk);
+		share->refs.fetch_add(1, std::memory_order_relaxed);
+		chunk->origin = (char*)data;
+		chunk->share  = share;
+	}
+	else
+	{	if(chunk->share != NULL || chunk->orig_size < blocks * fmt.blockAlign)
+		{	release_origin(chunk);
+			chunk->orig_size = max_blocks * fmt.blockAlign;
+			chunk->origin    = (char*)pool_alloc(chunk->orig_size);
+		}
+
+		memcpy(chunk->origin, data, blocks * fmt.blockAlign);
+	}
+
+	chunk->fmt      = fmt;
+	chunk->orig_len = blocks;
+}
+
+// Unmaps a wave file once no node views it
+static void close_file(char* data, void* context)
+{
+	delete (WaveFile*)context;
+}
+
+// Adds the data of a wave file mapped in memory, without reading it first
+// Streaming sources hand the file over to the workers, which start adding it with the next step
+bool AudioSource::add_file(const char* filename)
+{
+	WaveFile* wave = new WaveFile();
+	if(!wave->open(filename) || (ring != NULL && !claim_feed(Feed_File)))
+	{	delete wave;
+		return false;
+	}
+
+	DataShare* share = new(pool_alloc(sizeof(DataShare))) DataShare{ (char*)wave->data, close_file, wave };
+	share->refs.store(1, std::memory_order_relaxed);
+
+	if(ring == NULL)
+	{	add_nodes(wave->data, wave->blocks, wave->fmt, share);
+		release_share(share);
+		return true;
+	}
+
+	// The file added before is dropped, its chunks still in the ring are played first
+	cancel_task(&task);
+
+	if(file_share != NULL)
+	{	release_share(file_share);
+	}
+
+	file_share = share;
+	file_pos   = 0;
+	file.store(wave, std::memory_order_release);
+
+	submit_task(&task);
+	return true;
+}
+
+// Adds the next windows of the mapped wave file to the free chunks of the ring, starting it over if looped
+// Only runs on the worker running the source's step, the single producer of the ring
+void AudioSource::read_file()
+{
+	WaveFile* wave = file.load(std::memory_order_relaxed);
+	size_t max_blocks_in = FormatConverter::find_max_input_size(wave->fmt) * MAX_NODE_UNITS;
+	size_t index = ring_write.load(std::memory_order_relaxed);
+	size_t copy_amount;
+
+	// The worker holds the primary converter and sets it up itself, only the buffers are reserved for the playback
+	size_t proc_bytes = 0;
+	if(convert_lazy && wave->fmt != audio_fmt)
+	{	const ConversionPlan* plan = acquire_conversion_plan(wave->fmt, audio_fmt, quality);
+		proc_bytes = plan->max_output * MAX_NODE_UNITS * audio_fmt.blockAlign;
+		release_conversion_plan(plan);
+	}
+
+	while(index - ring_read.load(std::memory_order_acquire) < STREAM_RING_CHUNKS)
+	{
+		if(file_pos == wave->blocks)
+		{	if(!audio_looped || wave->blocks == 0)
+			{	break;
+			}
+
+			file_pos = 0;
+		}
+
+		copy_amount = wave->blocks - file_pos < max_blocks_in ? wave->blocks - file_pos : max_blocks_in;
+
+		write_chunk(&ring[index & (STREAM_RING_CHUNKS - 1)], wave->data + file_pos * wave->fmt.blockAlign,
+		            copy_amount, max_blocks_in, wave->fmt, file_share);
+		reserve_processed(&ring[index & (STREAM_RING_CHUNKS - 1)], proc_bytes);
+		ring_write.store(++index, std::memory_order_release);
+
+		file_pos += copy_amount;
+	}
 }
 
 // Takes n blocks of data from the Audio Source across Data Nodes
@@ -236,8 +480,25 @@ void AudioSource::take(char* buff, size_t blocks)
 	size_t copy_amount;
 	char *copy_from, *copy_to;
 
+	if(ring != NULL)
+	{	take_stream(buff, blocks);
+		return;
+	}
+
+	// A reset of the format plays the current node again from its start
+	size_t request = reset_request.load(std::memory_order_acquire);
+	if(request != reset_ack.load(std::memory_order_relaxed))
+	{	offset = 0;
+		reset_ack.store(request, std::memory_order_release);
+	}
+
 	for (copy_to = buff; blocks > 0; copy_to += copy_amount)
 	{
+		// Lazy sources don't wait for the workers to convert the node they need
+		if (convert_lazy && curr != NULL && curr->processed == NULL)
+		{	convert_on_demand(0);
+		}
+
 		// Case where there is no more data or the data is unconverted
 		if (curr == NULL || curr->processed == NULL)
 		{
@@ -279,15 +540,160 @@ void AudioSource::take(char* buff, size_t blocks)
 	}
 }
 
+// Takes n blocks of data from the converted chunks of the ring of a streaming source
+// Each chunk is handed back to the producer once fully taken, by advancing the taken index
+// Never waits or allocates, the blocks past the converted chunks are 0s
+void AudioSource::take_stream(char* buff, size_t blocks)
+{
+	size_t index = ring_read.load(std::memory_order_relaxed);
+	size_t copy_amount;
+	DataNode* chunk;
+
+	// A reset of the format rewinds the chunk being taken, and hands the chunks to the workers to convert again
+	size_t request = reset_request.load(std::memory_order_acquire);
+	if(request != reset_ack.load(std::memory_order_relaxed))
+	{	offset = 0;
+		reset_ack.store(request, std::memory_order_release);
+		submit_task(&task);
+	}
+
+	// The chunks converted before the reset are never played, the blocks are 0s until they are converted again
+	if(reset_done.load(std::memory_order_acquire) != request)
+	{	memset(buff, audio_fmt.bitsPerSample == 8 ? 0x80 : 0, blocks * audio_fmt.blockAlign);
+		return;
+	}
+
+	while(blocks > 0)
+	{
+		// Case where the workers haven't converted the next chunk yet, and lazy sources can't either
+		if(index == ring_convert.load(std::memory_order_acquire) &&
+		   (!convert_lazy || index == ring_write.load(std::memory_order_acquire) || !convert_on_demand(index)))
+		{	memset(buff, audio_fmt.bitsPerSample == 8 ? 0x80 : 0, blocks * audio_fmt.blockAlign);
+			return;
+		}
+
+		chunk = &ring[index & (STREAM_RING_CHUNKS - 1)];
+		copy_amount = chunk->proc_len - offset < blocks ? chunk->proc_len - offset : blocks;
+
+		memcpy(buff, chunk->processed + offset * audio_fmt.blockAlign, copy_amount * audio_fmt.blockAlign);
+		buff   += copy_amount * audio_fmt.blockAlign;
+		blocks -= copy_amount;
+		offset += copy_amount;
+
+		// Case where the chunk is fully consumed
+		if(offset == chunk->proc_len)
+		{	offset = 0;
+			ring_read.store(++index, std::memory_order_release);
+
+			// The workers add the next windows of a wave file once half of the ring is free
+			if(file.load(std::memory_order_acquire) != NULL && ring_write.load(std::memory_order_acquire) - index == STREAM_RING_CHUNKS / 2)
+			{	submit_task(&task);
+			}
+		}
+	}
+}
+
+// Converts the node the playback needs on the calling thread, the chunk at index of the ring of a
+// streaming source or the current node, with the primary converter as it is the next node of its sequence
+// The workers go on with the following nodes, and the nodes before the starting node of a reset
+// are left to them, as their converter is only used by the workers
+// Never waits nor allocates: the nodes are only converted if the converter and their buffer were set up when
+// they were added, and the nodes of a buffered source only if no worker holds them, the others are left to the workers
+bool AudioSource::convert_on_demand(size_t index)
+{
+	if(converting.exchange(true, std::memory_order_acquire))
+	{	return false;
+	}
+
+	bool converted = false;
+
+	if(ring != NULL)
+	{
+		// A worker may have converted the chunk before the converter was free
+		rewind_chunks();
+		if(index != ring_convert.load(std::memory_order_relaxed))
+		{	converted = true;
+		}
+		else if(ready_to_convert(&ring[index & (STREAM_RING_CHUNKS - 1)]))
+		{	process_node(&converter, &ring[index & (STREAM_RING_CHUNKS - 1)]);
+			ring_convert.store(index + 1, std::memory_order_release);
+			converted = true;
+		}
+	}
+	else if(proc_mutex.try_lock())
+	{
+		if(proc == curr && ready_to_convert(curr))
+		{	process_node(&converter, curr);
+			proc = curr->next;
+		}
+
+		converted = curr->processed != NULL;
+		proc_mutex.unlock();
+	}
+
+	converting.store(false, std::memory_order_release);
+	return converted;
+}
+
+// Sets the primary converter up for the data added to a lazy source, and returns the bytes of the processed data of its nodes
+// The converter is left to the workers if data of another format isn't converted yet, they set it up once they reach the data
+size_t AudioSource::prepare_lazy(const WaveFmt &fmt)
+{
+	if(fmt == audio_fmt)
+	{	return 0;
+	}
+
+	const ConversionPlan* plan = acquire_conversion_plan(fmt, audio_fmt, quality);
+	size_t bytes = plan->max_output * MAX_NODE_UNITS * audio_fmt.blockAlign;
+	release_conversion_plan(plan);
+
+	// The workers and the playback only hold the converter for a node
+	while(converting.exchange(true, std::memory_order_acquire))
+	{	thread::sleep(0);
+	}
+
+	bool pending = ring != NULL ? ring_convert.load(std::memory_order_relaxed) != ring_write.load(std::memory_order_relaxed) : proc != NULL;
+	if(!pending && converter.in_fmt != fmt)
+	{	converter.init(fmt, audio_fmt);
+	}
+
+	converting.store(false, std::memory_order_release);
+	return bytes;
+}
+
+// Reserves the buffer of the processed data of a node, the chunks of the ring keep theirs if it is large enough
+// The node is either free or not published yet, so no other thread reads its processed data
+void AudioSource::reserve_processed(DataNode* node, size_t bytes)
+{
+	if(node->proc_size < bytes)
+	{	if(node->processed != node->origin)
+		{	pool_free(node->processed);
+		}
+		pool_free(node->spare);
+
+		node->processed = NULL;
+		node->spare     = (char*)pool_alloc(bytes);
+		node->proc_size = bytes;
+	}
+}
+
+// The primary converter is set up for the node and its buffer is reserved, the nodes of the source's format need neither
+bool AudioSource::ready_to_convert(const DataNode* node) const
+{
+	return node->fmt == audio_fmt || (converter.in_fmt == node->fmt && converter.out_fmt == audio_fmt &&
+	                                  node->proc_size >= (size_t)converter.max_output * MAX_NODE_UNITS * audio_fmt.blockAlign);
+}
 
 // Clears all the data from the Audio Source
-// Stops all the processing threads and clears all resources, then resets pointers
+// Takes the conversion out of the workers and clears all resources, then resets pointers
 void AudioSource::clear()
 {
-	handler_active = false;
-	insert_sig.set();
-	pre_handler.join();
-	post_handler.join();
+	cancel_task(&task);
+
+	delete back_converter;
+	back_converter = NULL;
+	back     = NULL;
+	back_end = NULL;
 	
 	DataNode* tmp = head;
 	DataNode* nxt = NULL;
@@ -296,15 +702,9 @@ void AudioSource::clear()
 	{
 		nxt = tmp->next;
 
-		if(tmp->origin == NULL)
-		{	delete[] tmp->origin;
-		}
-
-		if(tmp->processed == NULL)
-		{	delete[] tmp->processed;
-		}
-
-		delete tmp;
+		release_processed(tmp);
+		release_origin(tmp);
+		pool_free(tmp);
 		tmp = nxt;
 	}
 
@@ -312,59 +712,186 @@ void AudioSource::clear()
 	tail = NULL;
 	curr = NULL;
 	offset = 0;
+
+	if(ring != NULL)
+	{	for(size_t i = 0; i < STREAM_RING_CHUNKS; i++)
+		{	release_processed(&ring[i]);
+			release_origin(&ring[i]);
+		}
+
+		delete[] ring;
+		ring = NULL;
+
+		if(file_share != NULL)
+		{	release_share(file_share);
+			file.store(NULL);
+			file_share = NULL;
+			file_pos   = 0;
+		}
+
+		ring_write.store(0);
+		ring_convert.store(0);
+		ring_read.store(0);
+	}
 }
 
 // Resets the format of the audio source
-// Stops all the processing threads and clears all processed data (converted)
-// Sets the start of the primary data processor to the current node and
-// restarts the conversion from the beginning (with the new target format)
+// Takes the conversion out of the workers and clears all processed data (converted)
+// Sets the start of the primary conversion to the current node, processes the nodes
+// before it after the ones being played, and resubmits the conversion (with the new target format)
 void AudioSource::reset_format(const WaveFmt &fmt)
 {
-	handler_active = false;
-	insert_sig.set();
-	pre_handler.join();
-	post_handler.join();
+	cancel_task(&task);
+
+	// The playback of a lazy source may be converting a node with the primary converter
+	while(converting.exchange(true, std::memory_order_acquire))
+	{	thread::sleep(0);
+	}
 
 	audio_fmt = fmt;
+	converter.quality = quality;
 	converter.init(fmt, fmt);
+	converting.store(false, std::memory_order_release);
+
+	proc_mutex.lock();
 
 	DataNode* tmp = head;
 	DataNode* nxt = NULL;
 
 	while (tmp != NULL)
 	{	
-		if(tmp->processed != NULL)
-		{	delete[] tmp->processed;
-			tmp->processed = NULL;
-			tmp->proc_len  = 0;
+		release_processed(tmp);
+
+		// Nodes of the new format are played straight from their original data
+		if(tmp->fmt == fmt)
+		{	tmp->processed = tmp->origin;
+			tmp->proc_len  = tmp->orig_len;
 		}
 
 		tmp = tmp->next;
 	}
 
-	proc   = curr;
-	offset = 0;
+	proc = curr;
+	proc_mutex.unlock();
+
+	delete back_converter;
+	back_converter = NULL;
+	back     = head;
+	back_end = curr;
+
+	// The playback rewinds its offset with its next take, then the chunks of the ring that weren't taken
+	// yet are converted again from the oldest one
+	reset_request.fetch_add(1, std::memory_order_release);
 
-	handler_active = true;
-	pre_handler.create(secondary_data_processor, this);
-	post_handler.create(primary_data_processor, this);
+	submit_task(&task);
+}
+
+// Claims the ring for a RingFeed, the first data added decides the feed for the life of the source
+bool AudioSource::claim_feed(int feed)
+{
+	int current = Feed_None;
+	return ring_feed.compare_exchange_strong(current, feed) || current == feed;
+}
+
+// Converts the chunks of the ring again from the first one not taken, once the playback acknowledged a reset
+// Only called by the holder of the primary converter, the single writer of the converted index, and the
+// playback doesn't take chunks until it is done, so the taken index doesn't move meanwhile
+void AudioSource::rewind_chunks()
+{
+	size_t ack = reset_ack.load(std::memory_order_acquire);
+	if(ack != reset_done.load(std::memory_order_relaxed))
+	{	ring_convert.store(ring_read.load(std::memory_order_acquire), std::memory_order_release);
+		reset_done.store(ack, std::memory_order_release);
+	}
+}
+
+// Changes the quality tier of the sampling rate conversion
+// The processed data is cleared and converted again with the new tier
+void AudioSource::set_quality(ResampleQuality quality)
+{
+	this->quality = quality;
+	reset_format(audio_fmt);
 }
 
 // Processes a single node's original data with the current Format Converter
+// Nodes of the Audio Source's format aren't copied, their processed data is their original data
 void AudioSource::process_node(FormatConverter *cnv, DataNode *node)
 {
+	if(audio_fmt == node->fmt)
+	{	if(node->processed != node->origin)
+		{	pool_free(node->processed);
+			pool_free(node->spare);
+			node->processed = node->origin;
+			node->spare     = NULL;
+			node->proc_size = 0;
+		}
+
+		node->proc_len = node->orig_len;
+		return;
+	}
+
+	// A chunk of the ring played from its original data gets a buffer of its own again
+	if(node->processed == node->origin)
+	{	node->processed = NULL;
+	}
+
 	size_t max_blocks_out = cnv->max_output * MAX_NODE_UNITS;
-	char* buffer = new char[max_blocks_out * audio_fmt.blockAlign];
+	char* buffer = node->processed != NULL ? node->processed : node->spare;
 
-	if(audio_fmt == node->fmt)
-	{	node->proc_len = node->orig_len;
-		memcpy(	buffer, node->origin, node->orig_len * audio_fmt.blockAlign);
+	// The chunks of the ring keep their buffer for the next data, unless it is too small
+	if(node->proc_size < max_blocks_out * audio_fmt.blockAlign)
+	{	pool_free(buffer);
+		node->proc_size = max_blocks_out * audio_fmt.blockAlign;
+		buffer = (char*)pool_alloc(node->proc_size);
+	}
+
+	node->proc_len  = cnv->convert( node->origin, buffer, node->orig_len);
+	node->processed = buffer;
+	node->spare     = NULL;
+}
+
+// Releases the original data of a node, or its view of a shared buffer
+void AudioSource::release_origin(DataNode* node)
+{
+	if(node->share != NULL)
+	{	release_share(node->share);
 	}
 	else
-	{	node->proc_len = cnv->convert( node->origin, buffer, node->orig_len);
+	{	pool_free(node->origin);
 	}
 
-	node->processed = buffer;
+	node->origin    = NULL;
+	node->orig_size = 0;
+	node->share     = NULL;
+}
+
+// Releases the processed data of a node, unless it is its original data
+// Must be called before releasing the original data, which it compares the processed data to
+void AudioSource::release_processed(DataNode* node)
+{
+	if(node->processed != node->origin)
+	{	pool_free(node->processed);
+	}
+	pool_free(node->spare);
+
+	node->processed = NULL;
+	node->spare     = NULL;
+	node->proc_len  = 0;
+	node->proc_size = 0;
+}
+
+// Drops a view of a shared buffer, releasing the buffer with the last one
+// The nodes may be removed on other threads than the one that added them, the last one sees all the views
+void AudioSource::release_share(DataShare* share)
+{
+	if(share->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{	if(share->release != NULL)
+		{	share->release(share->data, share->context);
+		}
+
+		share->~DataShare();
+		pool_free(share);
+	}
 }
 
 // Removes the nodes of of audio data up till the current current 
@@ -377,9 +904,9 @@ void AudioSource::remove()
 	while (tmp != curr)
 	{
 		nxt = tmp->next;
-		delete[] tmp->origin;
-		delete[] tmp->processed;
-		delete tmp;
+		release_processed(tmp);
+		release_origin(tmp);
+		pool_free(tmp);
 		tmp = nxt;
 	}
 
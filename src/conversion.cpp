@@ -1,138 +1,819 @@
 #include <audio-lib/conversion.h>
 #include <audio-lib/primes.h>
+#include <cpthread/cpmutex.h>
+#include <cpthread/cpthread.h>
 #include <string.h>
 #include <math.h>
 
 #define MIN(a, b) a < b ? a : b
 #define MAX(a, b) a > b ? a : b
 
-FormatConverter::FormatConverter(WaveFmt in, WaveFmt out) :
-    sub_steps(NULL), sub_buffers(NULL),
-    channel_ptr(NULL), depth_ptr(NULL), rate_ptr(NULL)
+// Estimated costs of converting the sampling rate, in nanoseconds for each block of a channel, measured on
+// stereo 16-bit conversions of every tier, the planned cascades against the resampler of the same ratios
+// Cascade steps convolve their phases with the SIMD or specialised kernels, so each block they output mostly
+// costs its call, the windowed-sinc resampler interpolates two long phases for every block
+#define CASCADE_BLOCK_COST   14.0  // Each block output by a step of the cascade
+#define CASCADE_TAP_COST     0.1   // Each coefficient convolved by a step of the cascade
+#define RESAMPLER_BLOCK_COST 20.0  // Each block output by the windowed-sinc resampler
+#define RESAMPLER_TAP_COST   0.22  // Each coefficient of a phase of the windowed-sinc resampler
+
+// Widths of the transition bands of the windows, relative to the band of a step, for one tap per unit of its factor,
+// up to the attenuations of their tiers, 50dB for Hamming, 70dB for Blackman and 105dB for Blackman-Harris
+// A decimation's transition band may span TRANSITION_SHARE of the band between its output's and its input's
+// Nyquist frequencies, the frequencies it lets through past that share fold back into the band
+// Decimations between close rates cut off at CLOSE_RATE_CUTOFF, the rolloff of the windowed-sinc resampler
+static const double window_transitions[] = { 3.3, 5.5, 7.8 };
+#define TRANSITION_SHARE     0.2
+#define CLOSE_RATE_CUTOFF    900
+
+// Parallel conversion is only worth its warm-up and threads for long waves, each segment
+// must span many times the warm-up of the filters and many sub-conversions
+#define SEGMENT_WARMUPS      16    // Minimum warm-ups spanned by each parallel segment
+#define SEGMENT_STEPS        10    // Minimum sub-conversions of max_input blocks in each parallel segment
+
+// Blocks whose channels are changed at a time before their type, so the samples are still in the L1 cache
+#define FORMAT_CHUNK_BLOCKS  512
+// Blocks mixed at a time through the float chunks, up to MIX_CHANNELS samples each
+#define MIX_CHUNK_BLOCKS     128
+
+// Speakers of the standard channel layouts, in the order of the WAVE speaker masks
+enum Speaker { Speaker_FL=0, Speaker_FR=1, Speaker_FC=2, Speaker_LFE=3, Speaker_BL=4, Speaker_BR=5, Speaker_SL=6, Speaker_SR=7 };
+
+// Speaker mask of the layout of each channel count, 0 for counts without a standard layout
+//  mono: FC, stereo: FL FR, quadraphonic: FL FR BL BR, 5.1: FL FR FC LFE BL BR, 7.1: FL FR FC LFE BL BR SL SR
+static const unsigned speaker_layouts[MIX_CHANNELS + 1] = { 0, 0x04, 0x03, 0, 0x33, 0, 0x3F, 0, 0xFF };
+
+// Gain of a speaker folded into a neighbour missing from the output layout
+#define FOLD_GAIN            0.70710678f
+
+// Filter designs of the quality tiers, with the worst attenuations quality_bench measures and enforces
+// Each tier costs more taps than the one below it and measures better, in stopband and in 16-bit SNR
+// Fast trades the stopband for the fewest taps, about 25dB, its images and aliases are audible on full-band music
+// Voice trades the top of the band for a 45dB stopband, as speech has little energy there,
+// and a half-band filter can't cut off below the Nyquist frequency, so its steps are full-band ones
+// Standard keeps 60dB, the half-band stages need 28 taps per unit with a Blackman window to keep it,
+// Mastering keeps 100dB
+// Archival is for offline batch conversion, its integer steps are long enough to convolve through FFTs,
+// whose cost barely grows with the taps, in sub-conversions of 100ms that are long enough for the transforms
+static const QualityPreset quality_presets[] =
+{   // name          step  poly  window                 cutoff  half-band  zero crossings  beta   sub-conversions
+    { "Fast",        12,   12,   Window_Hamming,         900,   true,      12,             6.0,   100 },
+    { "Voice",       16,   16,   Window_Blackman,        850,   false,     16,             7.0,   100 },
+    { "Standard",    28,   28,   Window_Blackman,       1000,   true,      32,             8.0,   100 },
+    { "Mastering",   48,   48,   Window_BlackmanHarris,  950,   true,      64,            10.0,   100 },
+    { "Archival",   512,  512,   Window_BlackmanHarris,  980,   false,    128,            14.0,    10 },
+};
+
+// Returns the filter design of a quality tier
+const QualityPreset& get_quality_preset(ResampleQuality quality)
 {
+    return quality_presets[quality];
+}
+
+// Converters keep the states of the last few formats they switched away from,
+// so queues alternating between a few formats don't allocate on every switch
+#define MAX_PARKED_STATES    8
+
+static ConversionPlan* plans_head = NULL;  // Entries of the conversion plan cache
+static mutex           plans_lock;         // Lock of the cache, converters are created from many threads
+
+// Adds the gain of an input channel into a speaker of the output layout
+// Returns false if the output layout doesn't have the speaker
+static bool fold_speaker(float* gains, const int* out_index, int speaker, float gain)
+{
+    if(out_index[speaker] < 0)
+    {   return false;
+    }
+
+    gains[out_index[speaker]] += gain;
+    return true;
+}
+
+// Builds the standard mix between two channel counts, as mono, stereo, quadraphonic, 5.1 and 7.1 layouts
+// Speakers missing from the output are folded into their neighbours at -3dB and the LFE is dropped,
+// then the matrix is scaled down so no output can exceed full scale, other counts map channel to channel
+void get_standard_mix(int in_channels, int out_channels, ChannelMix &mix)
+{
+    memset(&mix, 0, sizeof(ChannelMix));
+    if(in_channels < 1 || in_channels > MIX_CHANNELS || out_channels < 1 || out_channels > MIX_CHANNELS)
+    {   return;
+    }
+
+    mix.in_channels  = in_channels;
+    mix.out_channels = out_channels;
+
+    unsigned in_mask  = speaker_layouts[in_channels];
+    unsigned out_mask = speaker_layouts[out_channels];
+    if(in_mask == 0 || out_mask == 0)
+    {   for(int i = 0; i < in_channels && i < out_channels; i++)
+        {   mix.gains[i][i] = 1.0f;
+        }
+        return;
+    }
+
+    // Speaker of each input channel, and output channel of each speaker
+    int in_speaker[MIX_CHANNELS];
+    int out_index[MIX_CHANNELS];
+    for(int speaker = 0, i = 0, o = 0; speaker < MIX_CHANNELS; speaker++)
+    {   if(in_mask & (1u << speaker))
+        {   in_speaker[i++] = speaker;
+        }
+        out_index[speaker] = out_mask & (1u << speaker) ? o++ : -1;
+    }
+
+    // The layouts have their left and right speakers in pairs, so a side is folded to the same side
+    for(int i = 0; i < in_channels; i++)
+    {
+        int speaker = in_speaker[i];
+        int side    = speaker & 1;
+        float* gains = mix.gains[i];
+
+        if(fold_speaker(gains, out_index, speaker, 1.0f))
+        {   continue;
+        }
+
+        switch(speaker)
+        {   case Speaker_FL:
+            case Speaker_FR:
+                fold_speaker(gains, out_index, Speaker_FC, FOLD_GAIN);
+                break;
+            case Speaker_FC:
+                fold_speaker(gains, out_index, Speaker_FL, FOLD_GAIN);
+                fold_speaker(gains, out_index, Speaker_FR, FOLD_GAIN);
+                break;
+            case Speaker_BL:
+            case Speaker_BR:
+                fold_speaker(gains, out_index, Speaker_SL + side, 1.0f) ||
+                fold_speaker(gains, out_index, Speaker_FL + side, FOLD_GAIN) ||
+                fold_speaker(gains, out_index, Speaker_FC, FOLD_GAIN);
+                break;
+            case Speaker_SL:
+            case Speaker_SR:
+                fold_speaker(gains, out_index, Speaker_BL + side, 1.0f) ||
+                fold_speaker(gains, out_index, Speaker_FL + side, FOLD_GAIN) ||
+                fold_speaker(gains, out_index, Speaker_FC, FOLD_GAIN);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Inputs at full scale and in phase add up to the sum of the gains of an output
+    float loudest = 0;
+    for(int o = 0; o < out_channels; o++)
+    {   float sum = 0;
+        for(int i = 0; i < in_channels; i++)
+        {   sum += mix.gains[i][o];
+        }
+        loudest = MAX(loudest, sum);
+    }
+
+    if(loudest > 1.0f)
+    {   for(int i = 0; i < in_channels; i++)
+        {   for(int o = 0; o < out_channels; o++)
+            {   mix.gains[i][o] /= loudest;
+            }
+        }
+    }
+}
+
+// Chooses the matrix mixing the channels of a conversion, with no channels if the fused kernels convert them
+// A custom matrix is only used if its channel counts match the formats
+static void select_channel_mix(const WaveFmt &in, const WaveFmt &out, const ChannelMix* custom, ChannelMix &mix)
+{
+    if(custom != NULL && custom->in_channels == in.numChannels && custom->out_channels == out.numChannels &&
+       custom->in_channels >= 1 && custom->in_channels <= MIX_CHANNELS && custom->out_channels >= 1 && custom->out_channels <= MIX_CHANNELS)
+    {   mix = *custom;
+    }
+    else if(in.numChannels != out.numChannels && (in.numChannels > 2 || out.numChannels > 2))
+    {   get_standard_mix(in.numChannels, out.numChannels, mix);
+    }
+    else
+    {   memset(&mix, 0, sizeof(ChannelMix));
+    }
+}
+
+// Compares the channel counts and the gains within them of two matrices
+static bool same_channel_mix(const ChannelMix &a, const ChannelMix &b)
+{
+    if(a.in_channels != b.in_channels || a.out_channels != b.out_channels)
+    {   return false;
+    }
+
+    for(int i = 0; i < a.in_channels; i++)
+    {   for(int o = 0; o < a.out_channels; o++)
+        {   if(a.gains[i][o] != b.gains[i][o])
+            {   return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Estimated cost of a step outputting "rate" blocks per second, in multiply-accumulates per second
+// The call for each block costs about as much as CASCADE_BLOCK_COST / CASCADE_TAP_COST coefficients
+static inline double estimate_step_cost(double rate, double output_taps)
+{
+    return rate * (output_taps + CASCADE_BLOCK_COST / CASCADE_TAP_COST);
+}
+
+// Estimated cost of the windowed-sinc resampler for a ratio, in multiply-accumulates of the cascade per second of output
+// Its timings are counted in the coefficients of the cascade that would take as long
+static double estimate_resampler_cost(double ratio, long out_rate, ResampleQuality quality)
+{
+    size_t phase_taps = SincResampler::phase_taps(ratio, get_quality_preset(quality).zero_crossings);
+    return out_rate * (RESAMPLER_BLOCK_COST + RESAMPLER_TAP_COST * phase_taps) / CASCADE_TAP_COST;
+}
+
+// Plans the cheapest cascade of Rate Converters of a conversion
+// Returns false if the cascade can't be planned, or if it is estimated to cost more than the windowed-sinc resampler
+static bool plan_cascade(ConversionPlan* plan)
+{
+    const WaveFmt &in_fmt  = plan->in_fmt;
+    const WaveFmt &out_fmt = plan->out_fmt;
+
+    // Factorizing the input sample rate and the output sample rate,
+    // Then dropping common factors to get a L/M fraction for conversion
+    // A prime factor above the largest known prime can't be factored
+    int in_fsize  = get_prime_factors(in_fmt.sampleRate, 0);
+    int out_fsize = get_prime_factors(out_fmt.sampleRate, 0);
+    if(in_fsize < 0 || out_fsize < 0)
+    {   int divisor = in_fmt.sampleRate, rest = out_fmt.sampleRate, tmp;
+        while(rest != 0)
+        {   tmp = divisor % rest;
+            divisor = rest;
+            rest = tmp;
+        }
+
+        plan->L = out_fmt.sampleRate / divisor;
+        plan->M = in_fmt.sampleRate / divisor;
+        return false;
+    }
+
+    factor* in_factors = new factor[in_fsize];
+    get_prime_factors(in_fmt.sampleRate, in_factors);
+
+    factor* out_factors = new factor[out_fsize];
+    get_prime_factors(out_fmt.sampleRate, out_factors);
+
+    remove_common_factors(out_factors, out_fsize, in_factors, in_fsize);
+
+    // Get the total number of factors to set the size of sub steps
+    // Each step takes at least one of them, so there can't be more steps than factors
+    int fcount = 0;
+    for(int i = 0; i < in_fsize; i++)
+    {   plan->M *= (int)pow(in_factors[i].value, in_factors[i].count);
+        fcount += in_factors[i].count;
+    }
+
+    for(int i = 0; i < out_fsize; i++)
+    {   plan->L *= (int)pow(out_factors[i].value, out_factors[i].count);
+        fcount += out_factors[i].count;
+    }
+
+    delete[] in_factors;
+    delete[] out_factors;
+
+    // Generate the cheapest series of L/M fractions to convert the sampling rate,
+    // the resampler takes the conversion if it is estimated to be cheaper
+    scale* pairs = new scale[fcount];
+    int pair_count = plan_scaling_factors(pairs, in_fmt.sampleRate, plan->L, plan->M, plan->quality);
+
+    double ratio = (double)out_fmt.sampleRate / in_fmt.sampleRate;
+    double cost  = estimate_cascade_cost(pairs, pair_count, in_fmt.sampleRate, plan->quality);
+    if(pair_count == 0 || cost > estimate_resampler_cost(ratio, out_fmt.sampleRate, plan->quality))
+    {   delete[] pairs;
+        return false;
+    }
+
+    int* taps = new int[pair_count];
+    int* cutoffs = new int[pair_count];
+    bool* half_band = new bool[pair_count];
+    double output_taps, rate = in_fmt.sampleRate, next_rate;
+    for(int i = 0; i < pair_count; i++)
+    {   next_rate = rate * pairs[i].L / pairs[i].M;
+        taps[i] = size_cascade_step(pairs[i], plan->quality, (MIN(rate, in_fmt.sampleRate)) / next_rate, half_band[i], cutoffs[i], output_taps);
+        rate = next_rate;
+    }
+
+    plan->step_count = pair_count;
+    plan->steps      = pairs;
+    plan->taps       = taps;
+    plan->cutoffs    = cutoffs;
+    plan->half_band  = half_band;
+    plan->cost       = cost;
+
+    // Only the outputs of the steps before the last one need buffers,
+    // and each one is free again once the next step converted it
+    int buffer_size = plan->max_input;
+    for(int i = 0; i < pair_count; i++)
+    {   buffer_size = (buffer_size * pairs[i].L / pairs[i].M) + 1;
+        if(i < pair_count-1)
+        {   plan->scratch_size = MAX(plan->scratch_size, buffer_size);
+        }
+    }
+
+    plan->max_output = buffer_size;
+
+    // Each step refreshes its delay lines from its last taps input blocks, which must all
+    // be outputs of up to date steps before it, so the warm-up adds up the input blocks
+    // each step needs, seen from the input of the cascade, plus one for the rounding
+    double in_blocks = 1;
+    for(int i = 0; i < pair_count; i++)
+    {   plan->warmup_blocks += (int)ceil((taps[i] + 1) * in_blocks) + 1;
+        in_blocks *= (double)pairs[i].M / pairs[i].L;
+    }
+
+    return true;
+}
+
+// Plans the conversion between two formats
+static ConversionPlan* build_conversion_plan(const WaveFmt &in, const WaveFmt &out, ResampleQuality quality, const ChannelMix &mix)
+{
+    ConversionPlan* plan = new ConversionPlan;
+    plan->in_fmt   = in;
+    plan->out_fmt  = out;
+    plan->in_type  = getSampleType(in);
+    plan->out_type = getSampleType(out);
+    plan->quality  = quality;
+
+    // Maximum number of blocks processed by a converter
+    int sub_conversions = get_quality_preset(quality).sub_conversions;
+    plan->max_input  = in.sampleRate/sub_conversions;
+    plan->max_output = out.sampleRate/sub_conversions;
+    if(in.sampleRate % sub_conversions != 0)
+    {   plan->max_input++;
+        plan->max_output++;
+    }
+
+    plan->L = 1;  // Interpolation factor
+    plan->M = 1;  // Decimation factor
+
+    // The channels and bit depth are converted together, straight to the destination
+    // if the rate stays the same, or into the first input of the rate conversion
+    plan->format_kernel = NULL;
+    plan->mix_kernel    = NULL;
+    plan->mix           = mix;
+    if(mix.in_channels != 0)
+    {   plan->mix_kernel = find_mix_kernel(plan->in_type, plan->out_type);
+    }
+    else if(in.numChannels != out.numChannels || plan->in_type != plan->out_type)
+    {   plan->format_kernel = find_format_kernel(plan->in_type, plan->out_type);
+    }
+
+    plan->resample      = false;
+    plan->step_count    = 0;
+    plan->steps         = NULL;
+    plan->taps          = NULL;
+    plan->cutoffs       = NULL;
+    plan->half_band     = NULL;
+    plan->scratch_size  = 0;
+    plan->warmup_blocks = 0;
+    plan->cost          = 0;
+    plan->refs          = 0;
+
+    // Rates the planner can't factor, and cascades costing more than a single
+    // windowed-sinc resampler, are converted by the resampler in one step
+    if(in.sampleRate != out.sampleRate && !plan_cascade(plan))
+    {   double ratio = (double)out.sampleRate / in.sampleRate;
+        plan->resample   = true;
+        plan->max_output = SincResampler::max_output(ratio, plan->max_input);
+        plan->cost       = estimate_resampler_cost(ratio, out.sampleRate, quality);
+
+        // The phases interpolated for an output span one block more than the taps
+        plan->warmup_blocks = SincResampler::phase_taps(ratio, get_quality_preset(quality).zero_crossings) + 2;
+    }
+
+    return plan;
+}
+
+// Finds the plan of a conversion in the cache, planning it if no converter holds it yet
+// Channel counts other than mono and stereo are mixed through the standard matrix, unless a custom
+// matrix of the same counts is given, which is also used with counts the fused kernels handle
+// Every acquired plan must be released once, the last release deallocates it
+const ConversionPlan* acquire_conversion_plan(const WaveFmt &in, const WaveFmt &out, ResampleQuality quality, const ChannelMix* mix)
+{
+    ChannelMix selected;
+    select_channel_mix(in, out, mix, selected);
+
+    plans_lock.lock();
+
+    ConversionPlan* entry = plans_head;
+    while(entry != NULL)
+    {   if(entry->in_fmt == in && entry->out_fmt == out && entry->quality == quality && same_channel_mix(entry->mix, selected))
+        {   break;
+        }
+        entry = entry->next;
+    }
+
+    // The plan is built under the lock, so concurrent requests don't build it twice
+    if(entry == NULL)
+    {   entry = build_conversion_plan(in, out, quality, selected);
+        entry->next = plans_head;
+        plans_head = entry;
+    }
+
+    entry->refs++;
+    plans_lock.unlock();
+
+    return entry;
+}
+
+// Removes a holder of the plan, deallocating it with the last one
+void release_conversion_plan(const ConversionPlan* plan)
+{
+    plans_lock.lock();
+
+    ConversionPlan* owned = (ConversionPlan*)plan;
+    if(--owned->refs == 0)
+    {
+        ConversionPlan** link = &plans_head;
+        while(*link != owned)
+        {   link = &(*link)->next;
+        }
+        *link = owned->next;
+
+        delete[] owned->steps;
+        delete[] owned->taps;
+        delete[] owned->cutoffs;
+        delete[] owned->half_band;
+        delete owned;
+    }
+
+    plans_lock.unlock();
+}
+
+// Writes the steps of a plan with their filters and estimated costs, and the cost of the whole conversion
+void print_conversion_plan(std::ostream &out, const ConversionPlan* plan)
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out.setf(std::ios::fixed, std::ios::floatfield);
+    out.precision(2);
+
+    out << plan->in_fmt.sampleRate << " Hz " << plan->in_fmt.numChannels << "ch " << plan->in_fmt.bitsPerSample << "-bit -> "
+        << plan->out_fmt.sampleRate << " Hz " << plan->out_fmt.numChannels << "ch " << plan->out_fmt.bitsPerSample << "-bit, "
+        << get_quality_preset(plan->quality).name << " quality\n";
+
+    if(plan->mix_kernel != NULL)
+    {   out << "  channels mixed through a " << plan->mix.in_channels << "x" << plan->mix.out_channels << " matrix\n";
+    }
+
+    if(plan->in_fmt.sampleRate == plan->out_fmt.sampleRate)
+    {   out << "  no rate conversion\n";
+    }
+    else if(plan->resample)
+    {   out << "  L/M = " << plan->L << "/" << plan->M << ", windowed-sinc resampler, "
+            << SincResampler::phase_taps((double)plan->out_fmt.sampleRate / plan->in_fmt.sampleRate,
+                                         get_quality_preset(plan->quality).zero_crossings) << " taps per phase\n";
+    }
+    else
+    {   out << "  L/M = " << plan->L << "/" << plan->M << ", " << plan->step_count << " steps\n";
+
+        double rate = plan->in_fmt.sampleRate, next_rate;
+        double output_taps;
+        bool   half_band;
+        int    cutoff;
+        for(int i = 0; i < plan->step_count; i++)
+        {   next_rate = rate * plan->steps[i].L / plan->steps[i].M;
+            size_cascade_step(plan->steps[i], plan->quality, (MIN(rate, plan->in_fmt.sampleRate)) / next_rate, half_band, cutoff, output_taps);
+            rate = next_rate;
+            out << "  step " << i+1 << ": " << plan->steps[i].L << "/" << plan->steps[i].M << ", "
+                << plan->taps[i] << " taps" << (plan->half_band[i] ? " (half-band)" : "") << ", cutoff " << plan->cutoffs[i] << ", "
+                << output_taps << " MACs per output, " << rate << " Hz out, "
+                << estimate_step_cost(rate, output_taps) / 1e6 << " MMAC/s\n";
+        }
+
+        out << "  scratch " << plan->scratch_size << " blocks, warm-up " << plan->warmup_blocks << " blocks\n";
+    }
+
+    out << "  estimated cost " << plan->cost / 1e6 << " MMAC/s per channel\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// Deallocates a parked state and releases its plan
+static void delete_state(ConversionState* state)
+{
+    delete[] state->format_ptr;
+    delete[] state->sub_buffers[0];
+    delete[] state->sub_buffers[1];
+    delete[] state->sub_steps;
+    delete state->resampler;
+
+    release_conversion_plan(state->plan);
+    delete state;
+}
+
+FormatConverter::FormatConverter(WaveFmt in, WaveFmt out, ResampleQuality quality, const ChannelMix* mix) :
+    plan(NULL), parked(NULL), quality(quality),
+    format_kernel(NULL), mix_kernel(NULL), custom_mix(NULL), format_ptr(NULL),
+    sub_buffers(), sub_steps(NULL), resampler(NULL),
+    thread_count(1), warmup_blocks(0), workers(NULL)
+{
+    if(mix != NULL)
+    {   custom_mix = new ChannelMix(*mix);
+    }
+
     init(in, out);
 }
 
 FormatConverter::~FormatConverter()
 {
     clear();
+    delete custom_mix;
 }
 
 // Initializes the input/output formats and the required buffers and converters
+// The plan comes from the cache, and the buffers and converters from the parked
+// states if the converter already worked on the formats
 void FormatConverter::init(WaveFmt in, WaveFmt out)
 {
-    clear();
+    const ConversionPlan* next = acquire_conversion_plan(in, out, quality, custom_mix);
 
-    in_fmt  = in;
-    out_fmt = out;
+    // The same formats only need the filters back to their initial state
+    if(next == plan)
+    {   release_conversion_plan(next);
+        reset_state();
+    }
+    else
+    {
+        if(plan != NULL)
+        {   park_state();
+        }
 
-    // Maximum number of blocks processed by a converter
-    max_input  = in.sampleRate/100;
-    max_output = out.sampleRate/100;
-    if(in.sampleRate % 100 != 0)
-    {   max_input++;
-        max_output++;
+        plan = next;
+
+        in_fmt     = plan->in_fmt;
+        out_fmt    = plan->out_fmt;
+        in_type    = plan->in_type;
+        out_type   = plan->out_type;
+        max_input  = plan->max_input;
+        max_output = plan->max_output;
+        L          = plan->L;
+        M          = plan->M;
+
+        format_kernel = plan->format_kernel;
+        mix_kernel    = plan->mix_kernel;
+        step_count    = plan->step_count;
+        warmup_blocks = plan->warmup_blocks;
+
+        if(unpark_state())
+        {   reset_state();
+        }
+        else
+        {   init_state();
+        }
     }
 
-    L = 1;  // Interpolation factor
-    M = 1;  // Decimation factor
+    // The workers follow the formats, quality and channel mix of the converter
+    if(workers != NULL)
+    {   for(int i = 0; i < thread_count-1; i++)
+        {   delete workers[i]->custom_mix;
+            workers[i]->custom_mix = custom_mix != NULL ? new ChannelMix(*custom_mix) : NULL;
+            workers[i]->quality    = quality;
+            workers[i]->init(in, out);
+        }
+    }
+    else if(thread_count > 1)
+    {   set_threads(thread_count);
+    }
+}
 
-    // Allocate space for the channel conversion's output
-    if(in_fmt.numChannels != out_fmt.numChannels)
-    {   channel_ptr = new char[max_input * in_fmt.bitsPerSample/8 * out_fmt.numChannels ];
+// Builds the buffers and converters of the current plan
+void FormatConverter::init_state()
+{
+    if(in_fmt.sampleRate == out_fmt.sampleRate)
+    {   return;
     }
 
-    // Allocate space for the bit depth conversion's output
-    if(in_fmt.bitsPerSample != out_fmt.bitsPerSample)
-    {   depth_ptr = new char[max_input * out_fmt.byteRate];
+    if(format_kernel != NULL || mix_kernel != NULL)
+    {   format_ptr = new char[max_input * out_fmt.blockAlign];
     }
 
-    // Set up Sample Rate Converters
-    if(in_fmt.sampleRate != out_fmt.sampleRate)
+    const QualityPreset &preset = get_quality_preset(quality);
+
+    if(plan->resample)
+    {   resampler = new SincResampler;
+        resampler->init((double)out_fmt.sampleRate / in_fmt.sampleRate, out_fmt.numChannels, out_type, preset.zero_crossings, preset.beta);
+        return;
+    }
+
+    // Create a series or Rate Converters to handle the conversion
+    sub_steps = new RateConverter[step_count];
+    for(int i = 0; i < step_count; i++)
     {   
-        // Factorizing the input sample rate and the output sample rate,
-        // Then dropping common factors to get a L/M fraction for conversion
-        int in_fsize = get_prime_factors(in.sampleRate, 0);
-        factor* in_factors = new factor[in_fsize];
-        get_prime_factors(in.sampleRate, in_factors);
+        sub_steps[i].init(plan->steps[i].L, plan->steps[i].M, plan->taps[i], out_fmt.numChannels, out_type,
+                          preset.window, plan->cutoffs[i], plan->half_band[i]);
+
+        // The steps of the most common conversions have kernels specialised at compile time,
+        // their coefficients are designed at compile time with the filters of the Standard tier
+        if(!plan->half_band[i])
+        {   sub_steps[i].fixed_kernel = find_fixed_kernel(plan->steps[i].L, plan->steps[i].M, plan->taps[i], preset.window,
+                                                          plan->cutoffs[i], out_type);
+        }
+    }
 
-        int out_fsize = get_prime_factors(out.sampleRate, 0);
-        factor* out_factors = new factor[out_fsize];
-        get_prime_factors(out.sampleRate, out_factors);
+    for(int i = 0; i < 2 && i < step_count-1; i++)
+    {   sub_buffers[i] = new char[plan->scratch_size * out_fmt.blockAlign];
+    }
+}
 
-        remove_common_factors(out_factors, out_fsize, in_factors, in_fsize);
+// Keeps the buffers and converters of the current plan in the parked states
+// Only the most recently used states are kept, the oldest one is deallocated
+void FormatConverter::park_state()
+{
+    ConversionState* state = new ConversionState;
+    state->plan           = plan;
+    state->format_ptr     = format_ptr;
+    state->sub_buffers[0] = sub_buffers[0];
+    state->sub_buffers[1] = sub_buffers[1];
+    state->sub_steps      = sub_steps;
+    state->resampler      = resampler;
+    state->next           = parked;
+    parked = state;
+
+    plan           = NULL;
+    format_ptr     = NULL;
+    sub_buffers[0] = NULL;
+    sub_buffers[1] = NULL;
+    sub_steps      = NULL;
+    resampler      = NULL;
+
+    int count = 1;
+    while(state->next != NULL && count < MAX_PARKED_STATES)
+    {   state = state->next;
+        count++;
+    }
 
-        // Get the total number of factors to set the size of sub steps
-        // The maximum number of sub steps can't exceed the number of factors
-        int in_fcount  = 0;
-        for(int i = 0; i < in_fsize; i++)
-        {   M *= (int)pow(in_factors[i].value, in_factors[i].count);
-            in_fcount += in_factors[i].count;
-        }
+    if(state->next != NULL)
+    {   delete_state(state->next);
+        state->next = NULL;
+    }
+}
 
-        int out_fcount  = 0;
-        for(int i = 0; i < out_fsize; i++)
-        {   L *= (int)pow(out_factors[i].value, out_factors[i].count);
-            out_fcount += out_factors[i].count;
-        }
+// Takes the buffers and converters of the current plan out of the parked states
+// Returns false if there were none
+bool FormatConverter::unpark_state()
+{
+    ConversionState** link = &parked;
+    while(*link != NULL && (*link)->plan != plan)
+    {   link = &(*link)->next;
+    }
+
+    if(*link == NULL)
+    {   return false;
+    }
 
-        step_count = MAX(in_fcount, out_fcount);
-        scale* pairs = new scale[step_count];
+    ConversionState* state = *link;
+    *link = state->next;
 
-        // Generate the series of L/M fractions to covnert the sampling rate
-        // Create a series or Rate Converters to handle the conversion
-        optimize_scaling_factors(pairs, step_count, out_factors, out_fsize, in_factors, in_fsize);
-        sub_steps   = new RateConverter[step_count];
-        sub_buffers = new char*[step_count];
+    format_ptr     = state->format_ptr;
+    sub_buffers[0] = state->sub_buffers[0];
+    sub_buffers[1] = state->sub_buffers[1];
+    sub_steps      = state->sub_steps;
+    resampler      = state->resampler;
 
-        int tap_count;
-        int buffer_size  = max_input;
-        int default_data = out.bitsPerSample == 8 ? 0x80 : 0;
-        for(int i = 0; i < step_count; i++)
-        {   
-            tap_count = (pairs[i].M * 3) | 1;
-            sub_steps[i].init(pairs[i].L, pairs[i].M, tap_count, out_fmt.numChannels, out_fmt.bitsPerSample);
-            
-            buffer_size = (buffer_size * pairs[i].L / pairs[i].M) + 1;
-            sub_buffers[i] = new char[buffer_size * out_fmt.blockAlign];
-            memset(sub_buffers[i], default_data, buffer_size * out_fmt.blockAlign);
-        }
+    // The converter already holds the plan, the parked state's hold is dropped
+    release_conversion_plan(state->plan);
+    delete state;
+
+    return true;
+}
 
-        max_output = buffer_size;
-        rate_ptr = new char[max_output * out_fmt.blockAlign];
+// Brings the filters back to their state after init, without allocating anything
+void FormatConverter::reset_state()
+{
+    for(int i = 0; i < step_count; i++)
+    {   sub_steps[i].reset();
+    }
 
-        delete[] in_factors;
-        delete[] out_factors;
-        delete[] pairs;
+    if(resampler != NULL)
+    {   resampler->reset();
     }
 }
 
-// Deallocates any dynamic arrays that were created
+// Deallocates the buffers and converters of the current plan
+void FormatConverter::clear_state()
+{
+    if(format_ptr != NULL)
+    {   delete[] format_ptr;
+        format_ptr = NULL;
+    }
+
+    for(int i = 0; i < 2; i++)
+    {   delete[] sub_buffers[i];
+        sub_buffers[i] = NULL;
+    }
+
+    if(sub_steps != NULL)
+    {   delete[] sub_steps;
+        sub_steps = NULL;
+    }
+
+    if(resampler != NULL)
+    {   delete resampler;
+        resampler = NULL;
+    }
+}
+
+// Deallocates any dynamic arrays that were created, including the parked states
 void FormatConverter::clear()
 {
-    if(channel_ptr != NULL)
-    {   delete[] channel_ptr;
-        channel_ptr = NULL;
+    clear_state();
+
+    if(plan != NULL)
+    {   release_conversion_plan(plan);
+        plan = NULL;
     }
 
-    if(depth_ptr != NULL)
-    {   delete[] depth_ptr;
-        depth_ptr = NULL;
+    while(parked != NULL)
+    {   ConversionState* next = parked->next;
+        delete_state(parked);
+        parked = next;
     }
 
-    if(rate_ptr != NULL)
-    {   for(int i = 0; i < step_count; i++)
-        {   delete[] sub_buffers[i];
+    // The thread count is kept, so init creates the workers again
+    if(workers != NULL)
+    {   for(int i = 0; i < thread_count-1; i++)
+        {   delete workers[i];
         }
 
-        delete[] rate_ptr;
-        rate_ptr = NULL;
+        delete[] workers;
+        workers = NULL;
+    }
+}
 
-        delete[] sub_steps;
-        sub_steps = NULL;
+// Changes the quality tier of the sampling rate conversion, initializing the converter again if it differs
+void FormatConverter::set_quality(ResampleQuality quality)
+{
+    if(this->quality != quality)
+    {   this->quality = quality;
+        init(in_fmt, out_fmt);
+    }
+}
+
+// Sets a matrix replacing the standard channel mix, NULL goes back to the standard one
+// It is kept for later formats, and only used while their channel counts match it
+void FormatConverter::set_channel_mix(const ChannelMix* mix)
+{
+    delete custom_mix;
+    custom_mix = mix != NULL ? new ChannelMix(*mix) : NULL;
+
+    init(in_fmt, out_fmt);
+}
+
+// Sets the number of threads converting long waves, 1 converts on the calling thread only
+// Each additional thread converts its segments with a worker converter of the same formats
+void FormatConverter::set_threads(int threads)
+{
+    if(workers != NULL)
+    {   for(int i = 0; i < thread_count-1; i++)
+        {   delete workers[i];
+        }
+
+        delete[] workers;
+        workers = NULL;
+    }
 
-        delete[] sub_buffers;
-        sub_buffers= NULL;
+    thread_count = MAX(threads, 1);
+    if(thread_count > 1)
+    {   workers = new FormatConverter*[thread_count-1];
+        for(int i = 0; i < thread_count-1; i++)
+        {   workers[i] = new FormatConverter(in_fmt, out_fmt, quality, custom_mix);
+        }
+    }
+}
+
+// Advances the position of the sampling rate conversion by n "blocks" without converting them
+// The delay lines are left as they are, until new blocks refresh them
+// Returns the number of blocks the conversion would have output
+size_t FormatConverter::skip(size_t blocks)
+{
+    if(resampler != NULL)
+    {   return resampler->skip(blocks);
+    }
+
+    for(int i = 0; i < step_count; i++)
+    {   blocks = sub_steps[i].skip(blocks);
+    }
+
+    return blocks;
+}
+
+// Copies the position of the sampling rate conversion from another converter of the same formats
+// Only the phase counters are copied, the delay lines are refreshed by warming up the converter
+void FormatConverter::copy_position(const FormatConverter &other)
+{
+    if(resampler != NULL)
+    {   resampler->position = other.resampler->position;
+    }
+
+    for(int i = 0; i < step_count; i++)
+    {   sub_steps[i].inter_phase    = other.sub_steps[i].inter_phase;
+        sub_steps[i].decim_fraction = other.sub_steps[i].decim_fraction;
     }
 }
 
@@ -149,8 +830,21 @@ int FormatConverter::find_max_input_size(const WaveFmt &in_fmt)
 }
 
 // Breaks down the conversion of a larger wave to smaller steps
+// Long waves are split into segments converted in parallel if more threads are set
 // Returns the number of blocks that resulted from the conversion
 int FormatConverter::convert(char* src, char* dst, size_t blocks)
+{
+    size_t min_segment = MAX(SEGMENT_WARMUPS * warmup_blocks, SEGMENT_STEPS * max_input);
+    if(thread_count > 1 && blocks >= thread_count * min_segment)
+    {   return convert_parallel(src, dst, blocks);
+    }
+
+    return convert_serial(src, dst, blocks);
+}
+
+// Converts the blocks in max_input steps on the calling thread
+// Returns the number of blocks that resulted from the conversion
+int FormatConverter::convert_serial(char* src, char* dst, size_t blocks)
 {
     int step_size  = 0;
     int total_size = 0;
@@ -169,190 +863,480 @@ int FormatConverter::convert(char* src, char* dst, size_t blocks)
         }
 
         total_size += step_size;
-        dst += step_size;
+        dst += step_size * out_fmt.blockAlign;
+    }
+
+    return total_size;
+}
+
+// Converts blocks only to bring the filter states up to date, discarding the output
+// Returns the number of blocks that resulted from the conversion
+int FormatConverter::warm_up(char* src, size_t blocks)
+{
+    char* scratch = new char[max_output * out_fmt.blockAlign];
+    int total_size = 0;
+
+    while(blocks > 0)
+    {
+        size_t step = MIN(blocks, (size_t)max_input);
+        total_size += sub_convert(src, scratch, step);
+        src += step * in_fmt.blockAlign;
+        blocks -= step;
+    }
+
+    delete[] scratch;
+    return total_size;
+}
+
+// Segment of a wave converted by a worker thread
+struct ConversionTask
+{   FormatConverter* cnv;       // Worker converter, starting at the position of the wave's start
+    char*  src;                 // Input wave
+    char*  dst;                 // Output wave, the segment's blocks are written at their final offset
+    size_t start;               // First input block of the segment
+    size_t blocks;              // Number of input blocks of the segment
+    int    offset;              // First output block of the segment
+    int    count;               // Number of output blocks of the segment
+};
+
+// Converts a segment after skipping to the warm-up blocks before it and refreshing the filters over them
+// The skipped and warm-up outputs add up to the offset of the segment in the output wave
+static THREAD convert_segment(void* lparam)
+{
+    ConversionTask* task = (ConversionTask*)lparam;
+    FormatConverter* cnv = task->cnv;
+
+    size_t warmup = cnv->warmup_blocks;
+    size_t before = task->start - warmup;
+
+    task->offset  = (int)cnv->skip(before);
+    task->offset += cnv->warm_up(task->src + before * cnv->in_fmt.blockAlign, warmup);
+    task->count   = cnv->convert_serial(task->src + task->start * cnv->in_fmt.blockAlign,
+                                        task->dst + task->offset * cnv->out_fmt.blockAlign, task->blocks);
+    return 0;
+}
+
+// Converts the blocks in segments, the first on the calling thread and the others on the workers
+// The channel and bit depth conversions hold no state, and the filters only depend on the last
+// blocks they were given, so warming up each worker on the blocks before its segment, from the
+// position this converter is at, makes its output identical to the conversion on a single thread
+// Returns the number of blocks that resulted from the conversion
+int FormatConverter::convert_parallel(char* src, char* dst, size_t blocks)
+{
+    ConversionTask* tasks = new ConversionTask[thread_count];
+    thread* threads = new thread[thread_count];
+
+    for(int i = 0; i < thread_count; i++)
+    {   size_t start = blocks * i / thread_count;
+        tasks[i] = ConversionTask{i == 0 ? this : workers[i-1], src, dst, start, blocks * (i+1) / thread_count - start, 0, 0};
+    }
+
+    // The workers start from the position of this converter, before it moves on with the first segment
+    for(int i = 1; i < thread_count; i++)
+    {   workers[i-1]->copy_position(*this);
+        threads[i].create(convert_segment, &tasks[i]);
+    }
+
+    tasks[0].count = convert_serial(src, dst, tasks[0].blocks);
+
+    for(int i = 1; i < thread_count; i++)
+    {   threads[i].join();
     }
 
+    // Bring this converter to the end of the wave, as if it had converted every segment
+    size_t warmup = warmup_blocks;
+    size_t before = blocks - warmup;
+    skip(before - tasks[0].blocks);
+    warm_up(src + before * in_fmt.blockAlign, warmup);
+
+    int total_size = tasks[thread_count-1].offset + tasks[thread_count-1].count;
+
+    delete[] tasks;
+    delete[] threads;
+
     return total_size;
 }
 
 // Converts a wave to another format, which can include different
 // number of channels, nit depth or sampling rate increase or decrease
+// The channels and bit depth are converted in one pass, and the last step writes
+// straight to dst, so the blocks are only copied when the formats are identical
 // Returns the number of blocks that resulted from the conversion
 int FormatConverter::sub_convert(char* src, char* dst, size_t blocks)
 {
-    char *channel_res, *depth_res, *rate_res;
     int output_blocks = blocks;
+    bool convert_rate = in_fmt.sampleRate != out_fmt.sampleRate;
 
-    // Change channel count if there is a mismatch
-    if( in_fmt.numChannels != out_fmt.numChannels)
-    {
-        channel_res = channel_ptr;
-        if(in_fmt.numChannels == 1)
-        {   mono_to_stereo((char*)src, (char*)channel_res, in_fmt.bitsPerSample, blocks);
-        }
-        else if(in_fmt.numChannels == 2)
-        {   stereo_to_mono((char*)src, (char*)channel_res, in_fmt.bitsPerSample, blocks);
-        }
+    // Change channel count and bit depth if there is a mismatch, mixing the channels through the plan's matrix
+    char* rate_src = src;
+    if(mix_kernel != NULL)
+    {   rate_src = convert_rate ? format_ptr : dst;
+        mix_kernel(src, rate_src, plan->mix, blocks);
     }
-    else
-    {   channel_res = src;
+    else if(format_kernel != NULL)
+    {   rate_src = convert_rate ? format_ptr : dst;
+        format_kernel(src, rate_src, in_fmt.numChannels, out_fmt.numChannels, blocks);
     }
 
-    // Change bit depth if there is a mismatch
-    if( in_fmt.bitsPerSample != out_fmt.bitsPerSample)
-    {
-        depth_res = depth_ptr;
-        if(in_fmt.bitsPerSample == 8)
-        {   bit_depth_8_to_16((uchar*)channel_res, (short*)depth_res, blocks * out_fmt.numChannels);
+    if(!convert_rate)
+    {   if(rate_src == src)
+        {   memcpy(dst, src, blocks * out_fmt.blockAlign);
         }
-        else if(in_fmt.bitsPerSample == 16)
-        {   bit_depth_16_to_8((short*)channel_res, (uchar*)depth_res, blocks * out_fmt.numChannels);
-        }
-    }
-    else
-    {   depth_res = channel_res;
+
+        return output_blocks;
     }
 
-    // Change Sampling Frequency if there is a mismatch
-    if( in_fmt.sampleRate != out_fmt.sampleRate)
-    {
-        char* sub_src;
-        char* sub_dst = depth_res;
-
-        for(int i = 0; i < step_count; i++)
-        {
-            sub_src = sub_dst;
-            sub_dst = sub_buffers[i];
-
-            switch(out_fmt.bitsPerSample)
-            {   case 8:
-                    output_blocks = convert_sample_rate(
-                        (uchar*)sub_src, 
-                        (uchar*)sub_dst, 
-                        output_blocks, 
-                        sub_steps[i]
-                    );
-                    break;
-                case 16:
-                    output_blocks = convert_sample_rate(
-                        (short*)sub_src, 
-                        (short*)sub_dst, 
-                        output_blocks, 
-                        sub_steps[i]
-                    );
-                    break;
-            }
+    // The windowed-sinc resampler converts the whole ratio in a single step
+    if(resampler != NULL)
+    {   switch(out_type)
+        {   case _UInt8:   output_blocks = resampler->process((uchar*)rate_src, (uchar*)dst, output_blocks); break;
+            case _Int16:   output_blocks = resampler->process((short*)rate_src, (short*)dst, output_blocks); break;
+            case _Int24:   output_blocks = resampler->process((int24*)rate_src, (int24*)dst, output_blocks); break;
+            case _Int32:   output_blocks = resampler->process((int*)rate_src, (int*)dst, output_blocks);     break;
+            case _Float:   output_blocks = resampler->process((float*)rate_src, (float*)dst, output_blocks); break;
+            default: break;
         }
-
-        rate_res = sub_dst;
     }
-    else
+
+    // Change Sampling Frequency through the cascade, alternating between the intermediate buffers
+    char* sub_src;
+    char* sub_dst = rate_src;
+    for(int i = 0; i < step_count; i++)
     {
-        rate_res = depth_res;
+        sub_src = sub_dst;
+        sub_dst = i == step_count-1 ? dst : sub_buffers[i & 1];
+
+        switch(out_type)
+        {   case _UInt8:
+                output_blocks = convert_sample_rate((uchar*)sub_src, (uchar*)sub_dst, output_blocks, sub_steps[i]);
+                break;
+            case _Int16:
+                output_blocks = convert_sample_rate((short*)sub_src, (short*)sub_dst, output_blocks, sub_steps[i]);
+                break;
+            case _Int24:
+                output_blocks = convert_sample_rate((int24*)sub_src, (int24*)sub_dst, output_blocks, sub_steps[i]);
+                break;
+            case _Int32:
+                output_blocks = convert_sample_rate((int*)sub_src, (int*)sub_dst, output_blocks, sub_steps[i]);
+                break;
+            case _Float:
+                output_blocks = convert_sample_rate((float*)sub_src, (float*)sub_dst, output_blocks, sub_steps[i]);
+                break;
+            default:
+                break;
+        }
     }
 
-    memcpy(dst, rate_res, output_blocks * out_fmt.blockAlign);
     return output_blocks;
 }
 
-// Converts the sample rate of a multi channel 8-bit audio stream
+// Converts the sample rate of a multi channel audio stream
+// All channels are converted together in a single pass over the input
 // Returns the number of blocks extracted
-int convert_sample_rate(const uchar* src, uchar* dst, size_t blocks, RateConverter &cnv)
+template<typename T>
+int convert_sample_rate(const T* src, T* dst, size_t blocks, RateConverter &cnv)
 {
     int ret = 0;
 
-    if(cnv.L > 1 && cnv.M > 1)
-    {   for(size_t j = 0; j < cnv.num_channels; j++)
-        {   ret = cnv.non_integral((uchar*)src, (uchar*)dst, j, blocks);
-        }
+    if(cnv.fixed_kernel != NULL)
+    {   ret = cnv.fixed_kernel(cnv, src, dst, blocks);
+    }
+    else if(cnv.L > 1 && cnv.M > 1)
+    {   ret = cnv.non_integral(src, dst, blocks);
     }
     else if(cnv.L > 1)
-    {   for(size_t j = 0; j < cnv.num_channels; j++)
-        {   ret = cnv.interpolation((uchar*)src, (uchar*)dst, j, blocks);
-        }
+    {   ret = cnv.interpolation(src, dst, blocks);
     }
     else if(cnv.M > 1)
-    {   for(size_t j = 0; j < cnv.num_channels; j++)
-        {   ret = cnv.decimation((uchar*)src, (uchar*)dst, j, blocks);
-        }
+    {   ret = cnv.decimation(src, dst, blocks);
     }
 
     return ret;
 }
 
-// Converts the sample rate of a multi channel 16-bit audio stream
-// Returns the number of blocks extracted
-int convert_sample_rate(const short* src, short* dst, size_t blocks, RateConverter &cnv)
+// Conversion of n samples between two types through a full scale 32-bit value
+// The common pairs of types have dispatched kernels, the others are converted one sample at a time
+template<typename S, typename D>
+struct DepthConvert
+{   static inline void run(const FormatKernels*, const S* src, D* dst, size_t n)
+    {   for(size_t i = 0; i < n; i++)
+        {   dst[i] = SampleTraits<D>::from_int32(SampleTraits<S>::to_int32(src[i]));
+        }
+    }
+};
+
+template<>
+struct DepthConvert<uchar, short>
+{   static inline void run(const FormatKernels* k, const uchar* src, short* dst, size_t n) { k->u8_to_i16(src, dst, n); }
+};
+
+template<>
+struct DepthConvert<short, uchar>
+{   static inline void run(const FormatKernels* k, const short* src, uchar* dst, size_t n) { k->i16_to_u8(src, dst, n); }
+};
+
+// Conversion of n samples in the fused format conversion, identical types are copied as they are
+template<typename S, typename D>
+struct SampleConvert : DepthConvert<S, D>
+{   static const bool identity = false;
+};
+
+template<typename T>
+struct SampleConvert<T, T>
+{   static const bool identity = true;
+    static inline void run(const FormatKernels*, const T* src, T* dst, size_t n) { memcpy(dst, src, n * sizeof(T)); }
+};
+
+// Converts samples between types and bit depths through a full scale 32-bit value
+// Lower depths are scaled up into the high bits, higher depths drop their low bits
+template<typename S, typename D>
+void convert_bit_depth(const S* src, D* dst, size_t samples)
 {
-    int ret = 0;
+    DepthConvert<S, D>::run(get_format_kernels(), src, dst, samples);
+}
 
-    if(cnv.L > 1 && cnv.M > 1)
-    {   for(size_t j = 0; j < cnv.num_channels; j++)
-        {   ret = cnv.non_integral((short*)src, (short*)dst, j, blocks);
-        }
+// Duplication of n mono samples into stereo blocks, the dispatched kernels
+// only see the width of the samples, 24-bit samples are copied one at a time
+template<typename T>
+static inline void duplicate(const FormatKernels*, const T* src, T* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {   dst[(i<<1)] = dst[(i<<1) + 1] = src[i];
     }
-    else if(cnv.L > 1)
-    {   for(size_t j = 0; j < cnv.num_channels; j++)
-        {   ret = cnv.interpolation((short*)src, (short*)dst, j, blocks);
+}
+
+static inline void duplicate(const FormatKernels* k, const uchar* src, uchar* dst, size_t n) { k->dup_u8(src, dst, n); }
+static inline void duplicate(const FormatKernels* k, const short* src, short* dst, size_t n) { k->dup_i16(src, dst, n); }
+static inline void duplicate(const FormatKernels* k, const int* src, int* dst, size_t n)     { k->dup_i32(src, dst, n); }
+static inline void duplicate(const FormatKernels* k, const float* src, float* dst, size_t n) { k->dup_i32((const int*)src, (int*)dst, n); }
+
+// Average of two samples of each type
+static inline int24 average(int24 a, int24 b) { int24 s; s = ((int)a + (int)b) >> 1; return s; }
+
+// Average of the 2 samples of n stereo blocks, 24-bit samples are averaged one block at a time
+template<typename T>
+static inline void average(const FormatKernels*, const T* src, T* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {   dst[i] = average(src[(i<<1)], src[(i<<1) + 1]);
+    }
+}
+
+static inline void average(const FormatKernels* k, const uchar* src, uchar* dst, size_t n) { k->avg_u8(src, dst, n); }
+static inline void average(const FormatKernels* k, const short* src, short* dst, size_t n) { k->avg_i16(src, dst, n); }
+static inline void average(const FormatKernels* k, const int* src, int* dst, size_t n)     { k->avg_i32(src, dst, n); }
+static inline void average(const FormatKernels* k, const float* src, float* dst, size_t n) { k->avg_f32(src, dst, n); }
+
+// Duplicates samples to create 2 channels of the same wave
+template<typename T>
+void mono_to_stereo(const T* src, T* dst, size_t samples)
+{
+    duplicate(get_format_kernels(), src, dst, samples);
+}
+
+// Averages 2 consecutive samples to combines 2 waves into 1
+template<typename T>
+void stereo_to_mono(const T* src, T* dst, size_t samples)
+{
+    average(get_format_kernels(), src, dst, samples);
+}
+
+// Maps the channels of n blocks one to one while converting their type, the outputs without an input are silent
+// Used for the channel counts the mixing matrices can't hold, as get_standard_mix maps the counts without a layout
+template<typename S, typename D>
+static void map_channels(const FormatKernels* k, const S* in, D* out, size_t in_channels, size_t out_channels, size_t blocks)
+{
+    size_t kept = MIN(in_channels, out_channels);
+    for(size_t i = 0; i < blocks; i++)
+    {   SampleConvert<S, D>::run(k, in, out, kept);
+        for(size_t c = kept; c < out_channels; c++)
+        {   out[c] = SampleTraits<D>::silence();
         }
+
+        in  += in_channels;
+        out += out_channels;
     }
-    else if(cnv.M > 1)
-    {   for(size_t j = 0; j < cnv.num_channels; j++)
-        {   ret = cnv.decimation((short*)src, (short*)dst, j, blocks);
+}
+
+// Changes the channel count and the sample type of a multi channel audio stream in a single pass
+// Channels are duplicated or averaged in the source type, as the separate conversions did,
+// then the samples are converted to the destination type, a chunk at a time so they are still cached
+// Other channel counts, beyond the matrices, are mapped one to one
+template<typename S, typename D>
+void convert_format(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks)
+{
+    const FormatKernels* k = get_format_kernels();
+    const S* in = (const S*)src;
+    D* out = (D*)dst;
+
+    if(in_channels == out_channels)
+    {   SampleConvert<S, D>::run(k, in, out, blocks * in_channels);
+        return;
+    }
+
+    if(in_channels + out_channels != 3)
+    {   map_channels(k, in, out, in_channels, out_channels, blocks);
+        return;
+    }
+
+    // Without a change of type, the channels are written straight to the destination
+    S chunk[FORMAT_CHUNK_BLOCKS * 2];
+    for(size_t done = 0; done < blocks; done += FORMAT_CHUNK_BLOCKS)
+    {
+        size_t count = MIN(FORMAT_CHUNK_BLOCKS, blocks - done);
+        S* channels = SampleConvert<S, D>::identity ? (S*)(out + done * out_channels) : chunk;
+
+        if(in_channels == 1)
+        {   duplicate(k, in + done, channels, count);
+        }
+        else
+        {   average(k, in + (done<<1), channels, count);
+        }
+
+        if(!SampleConvert<S, D>::identity)
+        {   SampleConvert<S, D>::run(k, chunk, out + done * out_channels, count * out_channels);
         }
     }
+}
 
-    return ret;
+// Fused conversions from a source type to every destination type
+template<typename S>
+static format_fn find_format_kernel_from(SampleType out_type)
+{
+    switch(out_type)
+    {   case _UInt8:   return convert_format<S, uchar>;
+        case _Int16:   return convert_format<S, short>;
+        case _Int24:   return convert_format<S, int24>;
+        case _Int32:   return convert_format<S, int>;
+        case _Float:   return convert_format<S, float>;
+        default:       return NULL;
+    }
 }
 
-// Moves the samples from unsigned 8-bit to signed 16-bit wave and scales it up
-void bit_depth_8_to_16(const uchar* src, short* dst, size_t samples)
+// Finds the fused channel and bit depth conversion between two sample types
+format_fn find_format_kernel(SampleType in_type, SampleType out_type)
 {
-    for(size_t i = 0; i < samples; i++)
-    {   dst[i] = ((short)((char)(src[i] - 128))) << 8;
+    switch(in_type)
+    {   case _UInt8:   return find_format_kernel_from<uchar>(out_type);
+        case _Int16:   return find_format_kernel_from<short>(out_type);
+        case _Int24:   return find_format_kernel_from<int24>(out_type);
+        case _Int32:   return find_format_kernel_from<int>(out_type);
+        case _Float:   return find_format_kernel_from<float>(out_type);
+        default:       return NULL;
     }
 }
 
-// Scales the samples down and moves them from signed to unsigned wave
-void bit_depth_16_to_8(const short* src, uchar* dst, size_t samples)
+// Samples of a chunk as floats for the mix, float samples are mixed where they are
+template<typename T>
+static inline const float* load_floats(const T* src, float* chunk, size_t n)
 {
-    for(size_t i = 0; i < samples; i++)
-    {   dst[i] = ((char)(src[i] / 256)) + 128;
+    for(size_t i = 0; i < n; i++)
+    {   chunk[i] = SampleTraits<T>::to_float(src[i]);
     }
+    return chunk;
 }
 
-// Duplicates samples to create 2 channels of the same wave
-void mono_to_stereo(const char* src, const char* dst, size_t depth, size_t samples)
+static inline const float* load_floats(const float* src, float*, size_t) { return src; }
+
+// Destination of the mix of a chunk, float samples are mixed straight into the output
+template<typename T>
+static inline float* mix_target(T*, float* chunk) { return chunk; }
+
+static inline float* mix_target(float* dst, float*) { return dst; }
+
+// Mixed samples of a chunk back to the output type, rounded and clamped to its range
+template<typename T>
+static inline void store_floats(const float* chunk, T* dst, size_t n)
 {
-    for(size_t i = 0; i < samples; i++)
-    {
-        if(depth == 8)
-        {   *((uchar*)dst + (i<<1))     = *((uchar*)src + i);
-            *((uchar*)dst + (i<<1) + 1) = *((uchar*)src + i);
-        }
-        else if (depth == 16)
-        {   *((short*)dst + (i<<1))     = *((short*)src + i);
-            *((short*)dst + (i<<1) + 1) = *((short*)src + i);
-        }
+    for(size_t i = 0; i < n; i++)
+    {   dst[i] = SampleTraits<T>::from_float(chunk[i]);
     }
 }
 
-// Averages 2 consecutive samples to combines 2 waves into 1
-void stereo_to_mono(const char* src, const char* dst, size_t depth, size_t samples)
+static inline void store_floats(const float*, float*, size_t) {}
+
+// Mixes the channels of a multi channel audio stream through a matrix and changes the sample type in a single pass
+// The samples are mixed as floats, a chunk at a time so they are still cached, which keeps 24 bits of 32-bit samples
+template<typename S, typename D>
+void mix_format(const char* src, char* dst, const ChannelMix &mix, size_t blocks)
 {
-    for(size_t i = 0, sum = 0; i < samples; i++)
+    const FormatKernels* k = get_format_kernels();
+    const S* in = (const S*)src;
+    D* out = (D*)dst;
+
+    size_t in_channels  = mix.in_channels;
+    size_t out_channels = mix.out_channels;
+
+    float in_chunk[MIX_CHUNK_BLOCKS * MIX_CHANNELS];
+    float out_chunk[MIX_CHUNK_BLOCKS * MIX_CHANNELS];
+    for(size_t done = 0; done < blocks; done += MIX_CHUNK_BLOCKS)
     {
-        if(depth == 8)
-        {   sum = *((uchar*)src + (i<<1)) + (int)*((uchar*)src + (i<<1) + 1);
-            *((uchar*)dst + i) = (uchar)(sum >> 2);
-        }
-        else if (depth == 16)
-        {   sum = *((short*)src + (i<<1)) + (int)*((short*)src + (i<<1) + 1);
-            *((short*)dst + i) = (short)(sum >> 2);
-        }
+        size_t count = MIN(MIX_CHUNK_BLOCKS, blocks - done);
+        const float* samples = load_floats(in + done * in_channels, in_chunk, count * in_channels);
+        float* mixed = mix_target(out + done * out_channels, out_chunk);
+
+        k->mix_f32(samples, mixed, mix.gains[0], in_channels, out_channels, count);
+        store_floats(mixed, out + done * out_channels, count * out_channels);
+    }
+}
+
+// Fused channel mixes from a source type to every destination type
+template<typename S>
+static mix_fn find_mix_kernel_from(SampleType out_type)
+{
+    switch(out_type)
+    {   case _UInt8:   return mix_format<S, uchar>;
+        case _Int16:   return mix_format<S, short>;
+        case _Int24:   return mix_format<S, int24>;
+        case _Int32:   return mix_format<S, int>;
+        case _Float:   return mix_format<S, float>;
+        default:       return NULL;
     }
 }
 
+// Finds the fused channel mix and bit depth conversion between two sample types
+mix_fn find_mix_kernel(SampleType in_type, SampleType out_type)
+{
+    switch(in_type)
+    {   case _UInt8:   return find_mix_kernel_from<uchar>(out_type);
+        case _Int16:   return find_mix_kernel_from<short>(out_type);
+        case _Int24:   return find_mix_kernel_from<int24>(out_type);
+        case _Int32:   return find_mix_kernel_from<int>(out_type);
+        case _Float:   return find_mix_kernel_from<float>(out_type);
+        default:       return NULL;
+    }
+}
+
+// Instantiate the conversion helpers for every supported sample type
+#define INSTANTIATE_DEPTH(S) \
+    template void convert_bit_depth<S, uchar>(const S* src, uchar* dst, size_t samples); \
+    template void convert_bit_depth<S, short>(const S* src, short* dst, size_t samples); \
+    template void convert_bit_depth<S, int24>(const S* src, int24* dst, size_t samples); \
+    template void convert_bit_depth<S, int>(const S* src, int* dst, size_t samples); \
+    template void convert_bit_depth<S, float>(const S* src, float* dst, size_t samples); \
+    template void convert_format<S, uchar>(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks); \
+    template void convert_format<S, short>(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks); \
+    template void convert_format<S, int24>(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks); \
+    template void convert_format<S, int>(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks); \
+    template void convert_format<S, float>(const char* src, char* dst, size_t in_channels, size_t out_channels, size_t blocks); \
+    template void mix_format<S, uchar>(const char* src, char* dst, const ChannelMix &mix, size_t blocks); \
+    template void mix_format<S, short>(const char* src, char* dst, const ChannelMix &mix, size_t blocks); \
+    template void mix_format<S, int24>(const char* src, char* dst, const ChannelMix &mix, size_t blocks); \
+    template void mix_format<S, int>(const char* src, char* dst, const ChannelMix &mix, size_t blocks); \
+    template void mix_format<S, float>(const char* src, char* dst, const ChannelMix &mix, size_t blocks);
+
+#define INSTANTIATE_HELPERS(T) \
+    template int convert_sample_rate<T>(const T* src, T* dst, size_t blocks, RateConverter &cnv); \
+    template void mono_to_stereo<T>(const T* src, T* dst, size_t samples); \
+    template void stereo_to_mono<T>(const T* src, T* dst, size_t samples); \
+    INSTANTIATE_DEPTH(T)
+
+INSTANTIATE_HELPERS(uchar)
+INSTANTIATE_HELPERS(short)
+INSTANTIATE_HELPERS(int24)
+INSTANTIATE_HELPERS(int)
+INSTANTIATE_HELPERS(float)
+
 // Finds the prime factors and their count of an integer value
 // If called with factors=NULL, returns the space needed to store the result
 int get_prime_factors(size_t value, factor* factors)
@@ -424,6 +1408,7 @@ void remove_common_factors(factor* L_factors, const int L_size, factor* M_factor
 // Optimizes the scaling factors L/M bteween two sampling rates so
 // the wave doesn't suffer quality loss during conversion and the
 // conversion is performed as fast as possible with minimized memory usage
+// The converters plan their cascades with plan_scaling_factors, this heuristic is plan_bench's baseline
 void optimize_scaling_factors(scale* scales, int &S_size, factor* L_factors, int L_size, factor* M_factors, int M_size)
 {
 	size_t L_product=1;
@@ -529,4 +1514,233 @@ void optimize_scaling_factors(scale* scales, int &S_size, factor* L_factors, int
 	}
 
 	S_size = S_newsize;
-}
\ No newline at end of file
+}
+
+// Sizes the filter of a step of the cascade for a quality tier, "band_ratio" is the band of the signal
+// entering the step over the band of its output, the signal's band is at most the one of the cascade's input
+// Returns its taps, and sets whether it is a half-band stage, its cutoff and the coefficients it convolves for each block it outputs
+int size_cascade_step(const scale &step, ResampleQuality quality, double band_ratio, bool &half_band, int &cutoff, double &output_taps)
+{
+    const QualityPreset &preset = get_quality_preset(quality);
+
+    // Polyphase (non-integral) steps spread the taps across the L phases and
+    // replace two filters, so they are sized by the larger factor
+    // Integer steps are sized by their only factor, interpolation spreads them across its L phases
+    int taps_per_unit = step.L > 1 && step.M > 1 ? preset.polyphase_taps : preset.step_taps;
+    half_band = preset.half_band && step.L * step.M == 2;
+    cutoff    = preset.cutoff;
+
+    // A decimation must reach its stopband within TRANSITION_SHARE of the band between the Nyquist frequencies
+    // of its output and of the signal, the tier's filters can't between close rates, so those cut off at
+    // CLOSE_RATE_CUTOFF with enough taps per unit to reach it, and never as half-band stages
+    double transition = window_transitions[preset.window];
+    double limit = 1 + TRANSITION_SHARE * (band_ratio - 1);
+    if(band_ratio > 1 && cutoff / 1000.0 + transition / taps_per_unit > limit)
+    {   cutoff        = MIN(cutoff, CLOSE_RATE_CUTOFF);
+        taps_per_unit = MAX(taps_per_unit, (int)ceil(transition / (limit - cutoff / 1000.0)));
+        half_band     = false;
+    }
+
+    int taps = ((MAX(step.L, step.M)) * taps_per_unit) | 1;
+
+    // Steps by 2 are half-band stages of 4k-1 taps, only their k pairs around the centre are nonzero
+    // Decimation convolves the pairs and the centre for each output, interpolation
+    // convolves them once for two outputs, as the other one only meets the centre tap
+    output_taps = (double)taps / step.L;
+    if(half_band)
+    {   int pair_taps = (taps + 1) >> 2;
+        taps        = (pair_taps << 2) - 1;
+        output_taps = (double)(pair_taps + 1) / step.L;
+    }
+
+    return taps;
+}
+
+// Estimated cost of a cascade converting from a sampling rate, in multiply-accumulates per second of
+// output of a channel, where each block a step outputs also counts for the overhead of its call
+double estimate_cascade_cost(const scale* scales, int S_size, long in_rate, ResampleQuality quality)
+{
+    double rate = in_rate, next_rate;
+    double cost = 0;
+    double output_taps;
+    bool   half_band;
+    int    cutoff;
+    for(int i = 0; i < S_size; i++)
+    {   next_rate = rate * scales[i].L / scales[i].M;
+        size_cascade_step(scales[i], quality, (MIN(rate, in_rate)) / next_rate, half_band, cutoff, output_taps);
+        cost += estimate_step_cost(next_rate, output_taps);
+        rate = next_rate;
+    }
+
+    return cost;
+}
+
+// Node of the search of the cheapest cascade, for the conversion left once
+// the steps before it took their factors out of L and M
+struct CascadeNode
+{   double cost;                // Estimated cost of the cheapest cascade of the rest, negative until searched
+    double peak;                // Highest intermediate rate of that cascade, its buffers grow with it
+    scale step;                 // Factors of the first step of that cascade
+};
+
+// State of the search of the cheapest cascade, with a node for each pair of divisors of L and M
+struct CascadeSearch
+{   ResampleQuality quality;    // Quality tier sizing the filters
+    double in_rate;             // Input sampling rate of the cascade
+    double min_rate;            // Lowest rate the steps may output, below it the band of the signal is lost
+    int L, M;                   // Total factors of the cascade
+    int* L_divisors;            // Divisors of L in increasing order
+    int* M_divisors;            // Divisors of M in increasing order
+    int L_count, M_count;       // Number of divisors of L and M
+    CascadeNode* nodes;         // Nodes of the search, by the indices of the factors left of L and M
+};
+
+// Lists the divisors of a value in increasing order
+// If called with divisors=NULL, returns the space needed to store the result
+static int list_divisors(int value, int* divisors)
+{
+    int count = 0;
+    for(int i = 1; i <= value; i++)
+    {   if(value % i == 0)
+        {   if(divisors != NULL)
+            {   divisors[count] = i;
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// Finds the index of a divisor in the list of divisors
+static int find_divisor(const int* divisors, int count, int value)
+{
+    int low = 0, high = count-1, mid;
+    while(low < high)
+    {   mid = (low + high) >> 1;
+        if(divisors[mid] < value)
+        {   low = mid + 1;
+        }
+        else
+        {   high = mid;
+        }
+    }
+
+    return low;
+}
+
+// Finds the cheapest cascade converting the rest of L and M, after the steps that took the others
+// The cheapest cascade of the rest doesn't depend on the steps before it, so each node is searched once
+static const CascadeNode& search_cascade(CascadeSearch &search, int L_idx, int M_idx)
+{
+    CascadeNode &node = search.nodes[L_idx * search.M_count + M_idx];
+    if(node.cost >= 0)
+    {   return node;
+    }
+
+    int rest_L = search.L_divisors[L_idx];
+    int rest_M = search.M_divisors[M_idx];
+    double rate = search.in_rate * (search.L / rest_L) / (search.M / rest_M);
+
+    node.cost = HUGE_VAL;
+    node.peak = 0;
+    node.step = scale{rest_L, rest_M};
+
+    // Every step takes a divisor of the rest of L and one of the rest of M
+    double output_taps, cost, peak, next_rate;
+    bool half_band;
+    int cutoff;
+    for(int i = 0; i <= L_idx; i++)
+    {   int step_L = search.L_divisors[i];
+        if(rest_L % step_L != 0)
+        {   continue;
+        }
+
+        for(int j = 0; j <= M_idx; j++)
+        {   int step_M = search.M_divisors[j];
+            if(rest_M % step_M != 0 || (step_L == 1 && step_M == 1))
+            {   continue;
+            }
+
+            next_rate = rate * step_L / step_M;
+            if(next_rate < search.min_rate * (1 - 1e-9))
+            {   continue;
+            }
+
+            // An interpolation step needs at least a coefficient for each of its L phases
+            scale step = scale{step_L, step_M};
+            if(size_cascade_step(step, search.quality, (MIN(rate, search.in_rate)) / next_rate, half_band, cutoff, output_taps) < step_L)
+            {   continue;
+            }
+
+            int next_L = find_divisor(search.L_divisors, search.L_count, rest_L / step_L);
+            int next_M = find_divisor(search.M_divisors, search.M_count, rest_M / step_M);
+            const CascadeNode &next = search_cascade(search, next_L, next_M);
+
+            // The output of the last step goes to the destination, the others to the intermediate buffers
+            cost = estimate_step_cost(next_rate, output_taps) + next.cost;
+            peak = (next_L == 0 && next_M == 0) ? 0 : MAX(next_rate, next.peak);
+
+            // Orderings of the same steps add up the same costs in other orders, so costs
+            // only differing by the rounding are ties, going to the smallest buffers
+            if(cost < node.cost * (1 - 1e-9) || (cost <= node.cost * (1 + 1e-9) && peak < node.peak))
+            {   node.cost = cost;
+                node.peak = peak;
+                node.step = step;
+            }
+        }
+    }
+
+    return node;
+}
+
+// Finds the cheapest cascade converting a sampling rate by L/M, scoring every ordering of the divisors
+// of L and M into steps, as long as no step drops below the lower of the input and output rates
+// Decimations between close rates cut off below their Nyquist frequency with longer filters, as the resampler does
+// Ties go to the cascade with the smallest intermediate buffers
+// "scales" must hold a step for each prime factor of L and M, returns the number of steps, 0 if no cascade fits
+int plan_scaling_factors(scale* scales, long in_rate, int L, int M, ResampleQuality quality)
+{
+    CascadeSearch search;
+    search.quality  = quality;
+    search.in_rate  = in_rate;
+    search.min_rate = MIN((double)in_rate, (double)in_rate * L / M);
+    search.L = L;
+    search.M = M;
+
+    search.L_count = list_divisors(L, NULL);
+    search.M_count = list_divisors(M, NULL);
+    search.L_divisors = new int[search.L_count];
+    search.M_divisors = new int[search.M_count];
+    list_divisors(L, search.L_divisors);
+    list_divisors(M, search.M_divisors);
+
+    int node_count = search.L_count * search.M_count;
+    search.nodes = new CascadeNode[node_count];
+    for(int i = 0; i < node_count; i++)
+    {   search.nodes[i].cost = -1;
+    }
+
+    // The conversion is done once nothing is left of L and M
+    search.nodes[0].cost = 0;
+    search.nodes[0].peak = 0;
+    search.nodes[0].step = scale{1, 1};
+
+    const CascadeNode &whole = search_cascade(search, search.L_count-1, search.M_count-1);
+
+    // Following the first step of each node from the whole conversion to its end
+    int S_size = 0;
+    int L_idx = search.L_count-1, M_idx = search.M_count-1;
+    while(whole.cost < HUGE_VAL && (L_idx != 0 || M_idx != 0))
+    {   const scale &step = search.nodes[L_idx * search.M_count + M_idx].step;
+        scales[S_size++] = step;
+        L_idx = find_divisor(search.L_divisors, search.L_count, search.L_divisors[L_idx] / step.L);
+        M_idx = find_divisor(search.M_divisors, search.M_count, search.M_divisors[M_idx] / step.M);
+    }
+
+    delete[] search.L_divisors;
+    delete[] search.M_divisors;
+    delete[] search.nodes;
+
+    return S_size;
+}
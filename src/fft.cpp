@@ -0,0 +1,110 @@
+#include <audio-lib/fft.h>
+#include <math.h>
+
+FFT::FFT() : size(0), swaps(NULL), swap_count(0), roots(NULL)
+{
+}
+
+FFT::FFT(size_t size) : size(0), swaps(NULL), swap_count(0), roots(NULL)
+{
+	init(size);
+}
+
+FFT::~FFT()
+{
+	clear();
+}
+
+// Builds the bit-reversal and the roots for "size" points, rounded up to a power of two
+void FFT::init(size_t size)
+{
+	clear();
+
+	int bits = 0;
+	while(((size_t)1 << bits) < size)
+	{	bits++;
+	}
+	this->size = (size_t)1 << bits;
+
+	// Each pair is only swapped once, from the lower index
+	swaps = new size_t[this->size];
+	for(size_t i = 0; i < this->size; i++)
+	{	size_t reversed = 0;
+		for(int b = 0; b < bits; b++)
+		{	reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+
+		if(i < reversed)
+		{	swaps[swap_count++] = i;
+			swaps[swap_count++] = reversed;
+		}
+	}
+	swap_count >>= 1;
+
+	// The stage merging transforms of "half" points reads its "half" roots from offset half-1
+	const double pi = 3.14159265358979323846;
+	roots = new double[this->size > 1 ? (this->size - 1) << 1 : 2];
+	for(size_t half = 1; half < this->size; half <<= 1)
+	{	for(size_t k = 0; k < half; k++)
+		{	roots[2 * (half - 1 + k)]     = cos(pi * k / half);
+			roots[2 * (half - 1 + k) + 1] = -sin(pi * k / half);
+		}
+	}
+}
+
+// Deallocates all dynamic resources
+void FFT::clear()
+{
+	delete[] swaps;
+	delete[] roots;
+
+	size = 0;
+	swaps = NULL;
+	swap_count = 0;
+	roots = NULL;
+}
+
+// Butterflies of every stage, the inverse transform uses the conjugate roots
+template<bool INVERSE>
+void FFT::transform(double* data) const
+{
+	for(size_t i = 0; i < swap_count; i++)
+	{	size_t a = swaps[2 * i] << 1, b = swaps[2 * i + 1] << 1;
+		double re = data[a], im = data[a + 1];
+		data[a]     = data[b];
+		data[a + 1] = data[b + 1];
+		data[b]     = re;
+		data[b + 1] = im;
+	}
+
+	// Each stage merges transforms of "half" points into transforms of twice as many
+	for(size_t half = 1; half < size; half <<= 1)
+	{	const double* w = roots + 2 * (half - 1);
+		for(size_t start = 0; start < size; start += half << 1)
+		{	double* a = data + (start << 1);
+			double* b = a + (half << 1);
+			for(size_t k = 0; k < half; k++)
+			{	double wr = w[2 * k];
+				double wi = INVERSE ? -w[2 * k + 1] : w[2 * k + 1];
+				double re = b[2 * k] * wr - b[2 * k + 1] * wi;
+				double im = b[2 * k] * wi + b[2 * k + 1] * wr;
+				b[2 * k]     = a[2 * k] - re;
+				b[2 * k + 1] = a[2 * k + 1] - im;
+				a[2 * k]     += re;
+				a[2 * k + 1] += im;
+			}
+		}
+	}
+}
+
+// Forward transform of "size" complex points
+void FFT::forward(double* data) const
+{
+	transform<false>(data);
+}
+
+// Inverse transform of "size" complex points, the result is not divided by the size
+void FFT::inverse(double* data) const
+{
+	transform<true>(data);
+}
@@ -1,56 +1,124 @@
 #include <audio-lib/filter.h>
 #include <string.h>
-#include <math.h>
+#include <cpthread/cpmutex.h>
 
-#define MATH_PI 3.1415f
-#define SINC(fc, n) sin((2 * MATH_PI * fc * n)) / (MATH_PI * n)
-#define HAMM(N, n)  0.54f + 0.46f * cos(n * 2 * MATH_PI / N)
+static FIRCoefs* cache_head = NULL;	// Entries of the filter coefficient cache
+static mutex      cache_lock;			// Lock of the cache, filters are created from many threads
+
+// Finds the coefficients of a filter design in the cache, designing them if no filter holds them yet
+// Every acquired entry must be released once, the last release deallocates it
+const FIRCoefs* acquire_fir_coefs(int taps, int stop_freq, int sample_freq, FIRWindow window)
+{
+	cache_lock.lock();
+
+	FIRCoefs* entry = cache_head;
+	while(entry != NULL)
+	{	if(entry->size == (size_t)taps && entry->stop_freq == stop_freq && entry->sample_freq == sample_freq && entry->window == window)
+		{	break;
+		}
+		entry = entry->next;
+	}
+
+	// The design is done under the lock, so concurrent requests don't design it twice
+	if(entry == NULL)
+	{	entry = new FIRCoefs{ new llong[taps], (size_t)taps, stop_freq, sample_freq, window, 0, cache_head };
+		design_lowpass(entry->coefs, taps, stop_freq, sample_freq, window);
+		cache_head = entry;
+	}
+
+	entry->refs++;
+	cache_lock.unlock();
+
+	return entry;
+}
+
+// Adds a holder to coefficients already acquired
+const FIRCoefs* retain_fir_coefs(const FIRCoefs* entry)
+{
+	cache_lock.lock();
+	((FIRCoefs*)entry)->refs++;
+	cache_lock.unlock();
+
+	return entry;
+}
+
+// Removes a holder of the coefficients, deallocating them with the last one
+void release_fir_coefs(const FIRCoefs* entry)
+{
+	cache_lock.lock();
+
+	FIRCoefs* owned = (FIRCoefs*)entry;
+	if(--owned->refs == 0)
+	{
+		FIRCoefs** link = &cache_head;
+		while(*link != owned)
+		{	link = &(*link)->next;
+		}
+		*link = owned->next;
+
+		delete[] owned->coefs;
+		delete owned;
+	}
+
+	cache_lock.unlock();
+}
 
 FIRFilter_i64::FIRFilter_i64() :
-	coefs(NULL), size(0)
+	coefs(NULL), size(0), shared(NULL)
 {
 }
 
-FIRFilter_i64::FIRFilter_i64(int taps, int stop_freq, int sample_freq):
-	coefs(NULL), size(0)
+FIRFilter_i64::FIRFilter_i64(int taps, int stop_freq, int sample_freq, FIRWindow window):
+	coefs(NULL), size(0), shared(NULL)
 {	
-	init(taps, stop_freq, sample_freq);
+	init(taps, stop_freq, sample_freq, window);
 }
 
 FIRFilter_i64::FIRFilter_i64(const FIRFilter_i64 &other):
-	coefs(new llong[other.size]), size(other.size)
-
-{	
-	memcpy(coefs, other.coefs, sizeof(llong) * size);
+	coefs(other.coefs), size(other.size),
+	shared(other.shared != NULL ? retain_fir_coefs(other.shared) : NULL)
+{
 }
 
 FIRFilter_i64::~FIRFilter_i64()
 {
-	if(coefs != NULL)
-	{	delete[] coefs;
+	clear();
+}
+
+FIRFilter_i64& FIRFilter_i64::operator=(const FIRFilter_i64 &other)
+{
+	if(shared != other.shared)
+	{	clear();
+
+		coefs  = other.coefs;
+		size   = other.size;
+		shared = other.shared != NULL ? retain_fir_coefs(other.shared) : NULL;
 	}
+
+	return *this;
 }
 
 // Creates a low pass filter with "taps" number of coefficients
 // Each coefficient is a 2^32 scaled up 64-bit integer value
-void FIRFilter_i64::init(int taps, int stop_freq, int sample_freq)
+// Filters of the same design share their coefficients through the cache
+void FIRFilter_i64::init(int taps, int stop_freq, int sample_freq, FIRWindow window)
 {
-	if(coefs != NULL)
-	{	delete[] coefs;
-	}
-	
-	size = taps;
-	coefs = new llong[size];
+	const FIRCoefs* entry = acquire_fir_coefs(taps, stop_freq, sample_freq, window);
+	clear();
 
-	double ratio = (float)stop_freq / (float)sample_freq;
-	double f_coef;
+	shared = entry;
+	coefs  = entry->coefs;
+	size   = entry->size;
+}
 
-	for (int i = 0, p = i - size / 2; i < (int)size; i++, p++)
-	{
-		f_coef  = SINC(ratio, p);
-		f_coef *= HAMM(size, p);
-		coefs[i] = (llong)(f_coef * 4294967296);
+// Releases the coefficients of the filter
+void FIRFilter_i64::clear()
+{
+	if(shared != NULL)
+	{	release_fir_coefs(shared);
 	}
 
-	coefs[size >> 1] = ((llong)(ratio * 4294967296)) << 1;
-}
\ No newline at end of file
+	shared = NULL;
+	coefs  = NULL;
+	size   = 0;
+}
@@ -0,0 +1,968 @@
+#include <audio-lib/kernels.h>
+
+#if defined _M_X64 || defined __x86_64__
+#define KERNELS_X86
+#include <immintrin.h>
+
+#if defined _MSC_VER
+#include <intrin.h>
+#define CPUID(info, leaf) __cpuidex(info, leaf, 0)
+#define XGETBV() _xgetbv(0)
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define CPUID(info, leaf) __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3])
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+static inline unsigned long long XGETBV()
+{
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+}
+#endif
+#endif
+
+// Scalar convolution of unsigned 8-bit samples
+static int dot_u8_scalar(const short* coefs, const uchar* samples, size_t n)
+{
+	int acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+// Scalar convolution of 16 and 24-bit samples widened to 32 bits
+static llong dot_i32_scalar(const int* coefs, const int* samples, size_t n)
+{
+	llong acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += (llong)coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+// Scalar convolution of signed 32-bit samples
+static double dot_f64_scalar(const double* coefs, const int* samples, size_t n)
+{
+	double acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+// Scalar convolution of 32-bit float samples
+static float dot_f32_scalar(const float* coefs, const float* samples, size_t n)
+{
+	float acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+// Scalar symmetric convolution of unsigned 8-bit samples
+static int pair_u8_scalar(const short* coefs, const uchar* a, const uchar* b, size_t n)
+{
+	int acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += coefs[i] * (a[i] + b[i]);
+	}
+
+	return acc;
+}
+
+// Scalar symmetric convolution of 16 and 24-bit samples widened to 32 bits
+static llong pair_i32_scalar(const int* coefs, const int* a, const int* b, size_t n)
+{
+	llong acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += (llong)coefs[i] * (a[i] + b[i]);
+	}
+
+	return acc;
+}
+
+// Scalar symmetric convolution of signed 32-bit samples, their sums can exceed 32 bits
+static double pair_f64_scalar(const double* coefs, const int* a, const int* b, size_t n)
+{
+	double acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += coefs[i] * ((double)a[i] + b[i]);
+	}
+
+	return acc;
+}
+
+// Scalar symmetric convolution of 32-bit float samples
+static float pair_f32_scalar(const float* coefs, const float* a, const float* b, size_t n)
+{
+	float acc = 0;
+	for (size_t i = 0; i < n; i++)
+	{	acc += coefs[i] * (a[i] + b[i]);
+	}
+
+	return acc;
+}
+
+// Scalar conversion of unsigned 8-bit samples to signed 16-bit ones
+static void u8_to_i16_scalar(const uchar* src, short* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[i] = (short)(((int)src[i] - 128) << 8);
+	}
+}
+
+// Scalar conversion of signed 16-bit samples to unsigned 8-bit ones, the division truncates towards zero
+static void i16_to_u8_scalar(const short* src, uchar* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[i] = (uchar)(src[i] / 256 + 128);
+	}
+}
+
+// Scalar duplication of mono samples
+static void dup_u8_scalar(const uchar* src, uchar* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[(i<<1)] = dst[(i<<1) + 1] = src[i];
+	}
+}
+
+static void dup_i16_scalar(const short* src, short* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[(i<<1)] = dst[(i<<1) + 1] = src[i];
+	}
+}
+
+static void dup_i32_scalar(const int* src, int* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[(i<<1)] = dst[(i<<1) + 1] = src[i];
+	}
+}
+
+// Scalar average of stereo samples
+static void avg_u8_scalar(const uchar* src, uchar* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[i] = (uchar)(((int)src[(i<<1)] + src[(i<<1) + 1]) >> 1);
+	}
+}
+
+static void avg_i16_scalar(const short* src, short* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[i] = (short)(((int)src[(i<<1)] + src[(i<<1) + 1]) >> 1);
+	}
+}
+
+static void avg_i32_scalar(const int* src, int* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[i] = (int)(((llong)src[(i<<1)] + src[(i<<1) + 1]) >> 1);
+	}
+}
+
+static void avg_f32_scalar(const float* src, float* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{	dst[i] = (src[(i<<1)] + src[(i<<1) + 1]) * 0.5f;
+	}
+}
+
+// Scalar mix through a matrix of gains, each output adds its inputs in order, starting from zero
+static void mix_f32_scalar(const float* src, float* dst, const float* gains, size_t in_channels, size_t out_channels, size_t n)
+{
+	for (size_t b = 0; b < n; b++, src += in_channels, dst += out_channels)
+	{	for (size_t o = 0; o < out_channels; o++)
+		{	float acc = 0.0f;
+			for (size_t i = 0; i < in_channels; i++)
+			{	acc += src[i] * gains[i * MIX_CHANNELS + o];
+			}
+			dst[o] = acc;
+		}
+	}
+}
+
+#if defined KERNELS_X86
+
+// The Q15 kernels of the 8-bit samples multiply pairs of 16-bit coefficients and widened samples
+// into 32-bit lanes with madd, normalised coefficients keep every partial sum within the 32-bit range
+
+TARGET_SSE41 static inline int hsum_sse41(__m128i acc)
+{
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc);
+}
+
+// Each 8-tap step of the kernels below is a madd whose sum is added to an accumulator, the
+// latency of that addition chain is longer than the madd's, so the main loop runs 4 steps on
+// independent accumulators and only adds them up once, before the 8-tap steps of the tail
+TARGET_SSE41 static inline __m128i madd_u8_sse41(const short* coefs, const uchar* samples)
+{
+	return _mm_madd_epi16(_mm_loadu_si128((const __m128i*)coefs), _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)samples)));
+}
+
+// Sums of 8-bit pairs fit in 16 bits, so they are added before the madd
+TARGET_SSE41 static inline __m128i pair_madd_u8_sse41(const short* coefs, const uchar* a, const uchar* b)
+{
+	__m128i s = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)a)),
+							  _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)b)));
+	return _mm_madd_epi16(_mm_loadu_si128((const __m128i*)coefs), s);
+}
+
+TARGET_SSE41 static inline __m128i sum4_sse41(__m128i acc0, __m128i acc1, __m128i acc2, __m128i acc3)
+{
+	return _mm_add_epi32(_mm_add_epi32(acc0, acc1), _mm_add_epi32(acc2, acc3));
+}
+
+TARGET_SSE41 static int dot_u8_sse41(const short* coefs, const uchar* samples, size_t n)
+{
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+	__m128i acc2 = _mm_setzero_si128();
+	__m128i acc3 = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{	acc0 = _mm_add_epi32(acc0, madd_u8_sse41(coefs + i,      samples + i));
+		acc1 = _mm_add_epi32(acc1, madd_u8_sse41(coefs + i + 8,  samples + i + 8));
+		acc2 = _mm_add_epi32(acc2, madd_u8_sse41(coefs + i + 16, samples + i + 16));
+		acc3 = _mm_add_epi32(acc3, madd_u8_sse41(coefs + i + 24, samples + i + 24));
+	}
+
+	acc0 = sum4_sse41(acc0, acc1, acc2, acc3);
+	for (; i + 8 <= n; i += 8)
+	{	acc0 = _mm_add_epi32(acc0, madd_u8_sse41(coefs + i, samples + i));
+	}
+
+	int sum = hsum_sse41(acc0);
+	for (; i < n; i++)
+	{	sum += coefs[i] * samples[i];
+	}
+
+	return sum;
+}
+
+TARGET_SSE41 static int pair_u8_sse41(const short* coefs, const uchar* a, const uchar* b, size_t n)
+{
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+	__m128i acc2 = _mm_setzero_si128();
+	__m128i acc3 = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{	acc0 = _mm_add_epi32(acc0, pair_madd_u8_sse41(coefs + i,      a + i,      b + i));
+		acc1 = _mm_add_epi32(acc1, pair_madd_u8_sse41(coefs + i + 8,  a + i + 8,  b + i + 8));
+		acc2 = _mm_add_epi32(acc2, pair_madd_u8_sse41(coefs + i + 16, a + i + 16, b + i + 16));
+		acc3 = _mm_add_epi32(acc3, pair_madd_u8_sse41(coefs + i + 24, a + i + 24, b + i + 24));
+	}
+
+	acc0 = sum4_sse41(acc0, acc1, acc2, acc3);
+	for (; i + 8 <= n; i += 8)
+	{	acc0 = _mm_add_epi32(acc0, pair_madd_u8_sse41(coefs + i, a + i, b + i));
+	}
+
+	int sum = hsum_sse41(acc0);
+	for (; i < n; i++)
+	{	sum += coefs[i] * (a[i] + b[i]);
+	}
+
+	return sum;
+}
+
+// The AVX2 Q15 kernels fold their 8 lanes to 4 and finish with one 8-tap SSE step,
+// so filters of 16n + 8 or more taps don't run 8 of their taps through the scalar tail
+TARGET_AVX2 static inline __m128i fold_avx2(__m256i acc)
+{
+	return _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+}
+
+TARGET_AVX2 static int dot_u8_avx2(const short* coefs, const uchar* samples, size_t n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	__m256i s;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	s = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(samples + i)));
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(coefs + i)), s));
+	}
+
+	__m128i acc4 = fold_avx2(acc);
+	if (i + 8 <= n)
+	{	acc4 = _mm_add_epi32(acc4, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(coefs + i)),
+												  _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(samples + i)))));
+		i += 8;
+	}
+
+	int sum = hsum_sse41(acc4);
+	for (; i < n; i++)
+	{	sum += coefs[i] * samples[i];
+	}
+
+	return sum;
+}
+
+TARGET_AVX2 static int pair_u8_avx2(const short* coefs, const uchar* a, const uchar* b, size_t n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	__m256i s;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	s = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i))),
+							 _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i))));
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(coefs + i)), s));
+	}
+
+	int sum = hsum_sse41(fold_avx2(acc));
+	for (; i < n; i++)
+	{	sum += coefs[i] * (a[i] + b[i]);
+	}
+
+	return sum;
+}
+
+// The Q31 kernel widens 4 coefficients and samples to 64-bit lanes for the signed 32x32-bit multiplication
+TARGET_AVX2 static llong dot_i32_avx2(const int* coefs, const int* samples, size_t n)
+{
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	__m256i c, s;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	c = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(coefs + i)));
+		s = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(samples + i)));
+		acc0 = _mm256_add_epi64(acc0, _mm256_mul_epi32(c, s));
+
+		c = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(coefs + i + 4)));
+		s = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(samples + i + 4)));
+		acc1 = _mm256_add_epi64(acc1, _mm256_mul_epi32(c, s));
+	}
+
+	acc0 = _mm256_add_epi64(acc0, acc1);
+	__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+	sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+	llong acc = _mm_cvtsi128_si64(sum);
+	for (; i < n; i++)
+	{	acc += (llong)coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+TARGET_AVX2 static double dot_f64_avx2(const double* coefs, const int* samples, size_t n)
+{
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	__m256d s;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	s = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(samples + i)));
+		acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(coefs + i), s));
+
+		s = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(samples + i + 4)));
+		acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(coefs + i + 4), s));
+	}
+
+	__m256d sum4 = _mm256_add_pd(acc0, acc1);
+	__m128d sum = _mm_add_pd(_mm256_castpd256_pd128(sum4), _mm256_extractf128_pd(sum4, 1));
+	double acc = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+	for (; i < n; i++)
+	{	acc += coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+TARGET_AVX2 static float dot_f32_avx2(const float* coefs, const float* samples, size_t n)
+{
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(coefs + i),     _mm256_loadu_ps(samples + i)));
+		acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(coefs + i + 8), _mm256_loadu_ps(samples + i + 8)));
+	}
+
+	__m256 sum8 = _mm256_add_ps(acc0, acc1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	float acc = _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+	for (; i < n; i++)
+	{	acc += coefs[i] * samples[i];
+	}
+
+	return acc;
+}
+
+// Sums of 16 and 24-bit pairs fit in 32 bits, so they are added before being widened
+TARGET_AVX2 static llong pair_i32_avx2(const int* coefs, const int* a, const int* b, size_t n)
+{
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	__m256i c, s;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	c = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(coefs + i)));
+		s = _mm256_cvtepi32_epi64(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+		acc0 = _mm256_add_epi64(acc0, _mm256_mul_epi32(c, s));
+
+		c = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(coefs + i + 4)));
+		s = _mm256_cvtepi32_epi64(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(a + i + 4)), _mm_loadu_si128((const __m128i*)(b + i + 4))));
+		acc1 = _mm256_add_epi64(acc1, _mm256_mul_epi32(c, s));
+	}
+
+	acc0 = _mm256_add_epi64(acc0, acc1);
+	__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+	sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+	llong acc = _mm_cvtsi128_si64(sum);
+	for (; i < n; i++)
+	{	acc += (llong)coefs[i] * (a[i] + b[i]);
+	}
+
+	return acc;
+}
+
+TARGET_AVX2 static double pair_f64_avx2(const double* coefs, const int* a, const int* b, size_t n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	__m256d s;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{	s = _mm256_add_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(a + i))),
+						  _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(b + i))));
+		acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(coefs + i), s));
+	}
+
+	__m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+	double res = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+	for (; i < n; i++)
+	{	res += coefs[i] * ((double)a[i] + b[i]);
+	}
+
+	return res;
+}
+
+TARGET_AVX2 static float pair_f32_avx2(const float* coefs, const float* a, const float* b, size_t n)
+{
+	__m256 acc = _mm256_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(coefs + i),
+											   _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))));
+	}
+
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	float res = _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+	for (; i < n; i++)
+	{	res += coefs[i] * (a[i] + b[i]);
+	}
+
+	return res;
+}
+
+
+// The format kernels only move and add samples, so they run at the speed of the memory
+// Bytes are widened by unpacking them into the high byte of 16-bit lanes, and narrowed by a
+// signed pack of the truncated quotient, both around the 0x80 bias of the unsigned samples
+// Averages are rounded down as (a & b) + ((a ^ b) >> 1), which can't overflow
+
+TARGET_SSE41 static void u8_to_i16_sse41(const uchar* src, short* dst, size_t n)
+{
+	__m128i bias = _mm_set1_epi8((char)0x80);
+	__m128i zero = _mm_setzero_si128();
+	__m128i s;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), bias);
+		_mm_storeu_si128((__m128i*)(dst + i),     _mm_unpacklo_epi8(zero, s));
+		_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(zero, s));
+	}
+
+	u8_to_i16_scalar(src + i, dst + i, n - i);
+}
+
+// Negative samples are raised by 255 before the arithmetic shift, so it truncates towards zero
+TARGET_SSE41 static inline __m128i quotient_256_sse41(__m128i s)
+{
+	return _mm_srai_epi16(_mm_add_epi16(s, _mm_and_si128(_mm_srai_epi16(s, 15), _mm_set1_epi16(255))), 8);
+}
+
+TARGET_SSE41 static void i16_to_u8_sse41(const short* src, uchar* dst, size_t n)
+{
+	__m128i bias = _mm_set1_epi8((char)0x80);
+	__m128i a, b;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	a = quotient_256_sse41(_mm_loadu_si128((const __m128i*)(src + i)));
+		b = quotient_256_sse41(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi16(a, b), bias));
+	}
+
+	i16_to_u8_scalar(src + i, dst + i, n - i);
+}
+
+TARGET_SSE41 static void dup_u8_sse41(const uchar* src, uchar* dst, size_t n)
+{
+	__m128i s;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	s = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + (i<<1)),      _mm_unpacklo_epi8(s, s));
+		_mm_storeu_si128((__m128i*)(dst + (i<<1) + 16), _mm_unpackhi_epi8(s, s));
+	}
+
+	dup_u8_scalar(src + i, dst + (i<<1), n - i);
+}
+
+TARGET_SSE41 static void dup_i16_sse41(const short* src, short* dst, size_t n)
+{
+	__m128i s;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	s = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + (i<<1)),     _mm_unpacklo_epi16(s, s));
+		_mm_storeu_si128((__m128i*)(dst + (i<<1) + 8), _mm_unpackhi_epi16(s, s));
+	}
+
+	dup_i16_scalar(src + i, dst + (i<<1), n - i);
+}
+
+TARGET_SSE41 static void dup_i32_sse41(const int* src, int* dst, size_t n)
+{
+	__m128i s;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{	s = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + (i<<1)),     _mm_unpacklo_epi32(s, s));
+		_mm_storeu_si128((__m128i*)(dst + (i<<1) + 4), _mm_unpackhi_epi32(s, s));
+	}
+
+	dup_i32_scalar(src + i, dst + (i<<1), n - i);
+}
+
+// Each 16-bit lane holds a block, whose two bytes are added after splitting them
+TARGET_SSE41 static inline __m128i avg_u8_blocks_sse41(__m128i s)
+{
+	return _mm_srli_epi16(_mm_add_epi16(_mm_and_si128(s, _mm_set1_epi16(0xFF)), _mm_srli_epi16(s, 8)), 1);
+}
+
+TARGET_SSE41 static void avg_u8_sse41(const uchar* src, uchar* dst, size_t n)
+{
+	__m128i a, b;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	a = avg_u8_blocks_sse41(_mm_loadu_si128((const __m128i*)(src + (i<<1))));
+		b = avg_u8_blocks_sse41(_mm_loadu_si128((const __m128i*)(src + (i<<1) + 16)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+	}
+
+	avg_u8_scalar(src + (i<<1), dst + i, n - i);
+}
+
+// Each 32-bit lane holds a block, the madd adds up its two samples
+TARGET_SSE41 static void avg_i16_sse41(const short* src, short* dst, size_t n)
+{
+	__m128i ones = _mm_set1_epi16(1);
+	__m128i a, b;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	a = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(src + (i<<1))), ones), 1);
+		b = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(src + (i<<1) + 8)), ones), 1);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+	}
+
+	avg_i16_scalar(src + (i<<1), dst + i, n - i);
+}
+
+// 32-bit samples are split into the left and right channels of 4 blocks by shuffles
+TARGET_SSE41 static void avg_i32_sse41(const int* src, int* dst, size_t n)
+{
+	__m128 a, b;
+	__m128i l, r;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{	a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(src + (i<<1))));
+		b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(src + (i<<1) + 4)));
+		l = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		r = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi32(_mm_and_si128(l, r), _mm_srai_epi32(_mm_xor_si128(l, r), 1)));
+	}
+
+	avg_i32_scalar(src + (i<<1), dst + i, n - i);
+}
+
+TARGET_SSE41 static void avg_f32_sse41(const float* src, float* dst, size_t n)
+{
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 a, b;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{	a = _mm_loadu_ps(src + (i<<1));
+		b = _mm_loadu_ps(src + (i<<1) + 4);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+		                                             _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), half));
+	}
+
+	avg_f32_scalar(src + (i<<1), dst + i, n - i);
+}
+
+// The mix kernels broadcast each input sample over the row of its gains, adding the rows in the scalar order
+// without fused multiply-adds, so each output is a chain of dependent additions, and several blocks are mixed at
+// once to overlap their chains. Whole vectors are stored, the lanes past the output channels of a block are
+// overwritten by the next one, so only the last blocks, where the vectors wouldn't fit, are mixed by the scalar kernel
+TARGET_SSE41 static void mix_f32_sse41(const float* src, float* dst, const float* gains, size_t in_channels, size_t out_channels, size_t n)
+{
+	__m128 s0, s1, lo0, lo1, hi0, hi1, row;
+	const float* a;
+	size_t b = 0, i;
+
+	if (out_channels <= 4)
+	{	for (; (b + 1) * out_channels + 4 <= n * out_channels; b += 2)
+		{	lo0 = lo1 = _mm_setzero_ps();
+			a = src + b * in_channels;
+			for (i = 0; i < in_channels; i++)
+			{	row = _mm_loadu_ps(gains + i * MIX_CHANNELS);
+				lo0 = _mm_add_ps(lo0, _mm_mul_ps(_mm_set1_ps(a[i]), row));
+				lo1 = _mm_add_ps(lo1, _mm_mul_ps(_mm_set1_ps(a[in_channels + i]), row));
+			}
+			_mm_storeu_ps(dst + b * out_channels, lo0);
+			_mm_storeu_ps(dst + (b + 1) * out_channels, lo1);
+		}
+	}
+	else
+	{	for (; (b + 1) * out_channels + 8 <= n * out_channels; b += 2)
+		{	lo0 = lo1 = hi0 = hi1 = _mm_setzero_ps();
+			a = src + b * in_channels;
+			for (i = 0; i < in_channels; i++)
+			{	s0  = _mm_set1_ps(a[i]);
+				s1  = _mm_set1_ps(a[in_channels + i]);
+				row = _mm_loadu_ps(gains + i * MIX_CHANNELS);
+				lo0 = _mm_add_ps(lo0, _mm_mul_ps(s0, row));
+				lo1 = _mm_add_ps(lo1, _mm_mul_ps(s1, row));
+				row = _mm_loadu_ps(gains + i * MIX_CHANNELS + 4);
+				hi0 = _mm_add_ps(hi0, _mm_mul_ps(s0, row));
+				hi1 = _mm_add_ps(hi1, _mm_mul_ps(s1, row));
+			}
+			_mm_storeu_ps(dst + b * out_channels, lo0);
+			_mm_storeu_ps(dst + b * out_channels + 4, hi0);
+			_mm_storeu_ps(dst + (b + 1) * out_channels, lo1);
+			_mm_storeu_ps(dst + (b + 1) * out_channels + 4, hi1);
+		}
+	}
+
+	mix_f32_scalar(src + b * in_channels, dst + b * out_channels, gains, in_channels, out_channels, n - b);
+}
+
+// The AVX2 format kernels widen with the zero extensions, which don't cross the 128-bit lanes,
+// and put the quadwords of the lane-wise packs and shuffles back in order with a permute
+#define ORDER_QUADS _MM_SHUFFLE(3, 1, 2, 0)
+
+TARGET_AVX2 static void u8_to_i16_avx2(const uchar* src, short* dst, size_t n)
+{
+	__m256i bias = _mm256_set1_epi16(128);
+	__m256i s;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	s = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_slli_epi16(_mm256_sub_epi16(s, bias), 8));
+	}
+
+	u8_to_i16_scalar(src + i, dst + i, n - i);
+}
+
+TARGET_AVX2 static inline __m256i quotient_256_avx2(__m256i s)
+{
+	return _mm256_srai_epi16(_mm256_add_epi16(s, _mm256_and_si256(_mm256_srai_epi16(s, 15), _mm256_set1_epi16(255))), 8);
+}
+
+TARGET_AVX2 static void i16_to_u8_avx2(const short* src, uchar* dst, size_t n)
+{
+	__m256i bias = _mm256_set1_epi8((char)0x80);
+	__m256i a, b;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{	a = quotient_256_avx2(_mm256_loadu_si256((const __m256i*)(src + i)));
+		b = quotient_256_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 16)));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(_mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), ORDER_QUADS), bias));
+	}
+
+	i16_to_u8_scalar(src + i, dst + i, n - i);
+}
+
+TARGET_AVX2 static void dup_u8_avx2(const uchar* src, uchar* dst, size_t n)
+{
+	__m256i s;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	s = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+		_mm256_storeu_si256((__m256i*)(dst + (i<<1)), _mm256_or_si256(s, _mm256_slli_epi16(s, 8)));
+	}
+
+	dup_u8_scalar(src + i, dst + (i<<1), n - i);
+}
+
+TARGET_AVX2 static void dup_i16_avx2(const short* src, short* dst, size_t n)
+{
+	__m256i s;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	s = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+		_mm256_storeu_si256((__m256i*)(dst + (i<<1)), _mm256_or_si256(s, _mm256_slli_epi32(s, 16)));
+	}
+
+	dup_i16_scalar(src + i, dst + (i<<1), n - i);
+}
+
+TARGET_AVX2 static void dup_i32_avx2(const int* src, int* dst, size_t n)
+{
+	__m256i s;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{	s = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(src + i)));
+		_mm256_storeu_si256((__m256i*)(dst + (i<<1)), _mm256_or_si256(s, _mm256_slli_epi64(s, 32)));
+	}
+
+	dup_i32_scalar(src + i, dst + (i<<1), n - i);
+}
+
+TARGET_AVX2 static inline __m256i avg_u8_blocks_avx2(__m256i s)
+{
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_and_si256(s, _mm256_set1_epi16(0xFF)), _mm256_srli_epi16(s, 8)), 1);
+}
+
+TARGET_AVX2 static void avg_u8_avx2(const uchar* src, uchar* dst, size_t n)
+{
+	__m256i a, b;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{	a = avg_u8_blocks_avx2(_mm256_loadu_si256((const __m256i*)(src + (i<<1))));
+		b = avg_u8_blocks_avx2(_mm256_loadu_si256((const __m256i*)(src + (i<<1) + 32)));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), ORDER_QUADS));
+	}
+
+	avg_u8_scalar(src + (i<<1), dst + i, n - i);
+}
+
+TARGET_AVX2 static void avg_i16_avx2(const short* src, short* dst, size_t n)
+{
+	__m256i ones = _mm256_set1_epi16(1);
+	__m256i a, b;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{	a = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(src + (i<<1))), ones), 1);
+		b = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(src + (i<<1) + 16)), ones), 1);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), ORDER_QUADS));
+	}
+
+	avg_i16_scalar(src + (i<<1), dst + i, n - i);
+}
+
+TARGET_AVX2 static void avg_i32_avx2(const int* src, int* dst, size_t n)
+{
+	__m256 a, b;
+	__m256i l, r;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	a = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(src + (i<<1))));
+		b = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(src + (i<<1) + 8)));
+		l = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		r = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		l = _mm256_add_epi32(_mm256_and_si256(l, r), _mm256_srai_epi32(_mm256_xor_si256(l, r), 1));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(l, ORDER_QUADS));
+	}
+
+	avg_i32_scalar(src + (i<<1), dst + i, n - i);
+}
+
+TARGET_AVX2 static void avg_f32_avx2(const float* src, float* dst, size_t n)
+{
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 a, b, m;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{	a = _mm256_loadu_ps(src + (i<<1));
+		b = _mm256_loadu_ps(src + (i<<1) + 8);
+		m = _mm256_mul_ps(_mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+		                                _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), half);
+		_mm256_storeu_ps(dst + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(m), ORDER_QUADS)));
+	}
+
+	avg_f32_scalar(src + (i<<1), dst + i, n - i);
+}
+
+// Up to 4 output channels fit half a vector, so each vector mixes two blocks, one in each 128-bit lane
+TARGET_AVX2 static inline __m256 pair_blocks_avx2(const float* a, size_t in_channels)
+{
+	return _mm256_blend_ps(_mm256_broadcast_ss(a), _mm256_broadcast_ss(a + in_channels), 0xF0);
+}
+
+TARGET_AVX2 static void mix_f32_avx2(const float* src, float* dst, const float* gains, size_t in_channels, size_t out_channels, size_t n)
+{
+	__m256 acc0, acc1, row;
+	const float* a;
+	size_t b = 0, i;
+
+	if (out_channels <= 4)
+	{	for (; (b + 3) * out_channels + 4 <= n * out_channels; b += 4)
+		{	acc0 = acc1 = _mm256_setzero_ps();
+			a = src + b * in_channels;
+			for (i = 0; i < in_channels; i++)
+			{	row  = _mm256_broadcast_ps((const __m128*)(gains + i * MIX_CHANNELS));
+				acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(pair_blocks_avx2(a + i, in_channels), row));
+				acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(pair_blocks_avx2(a + 2 * in_channels + i, in_channels), row));
+			}
+			_mm_storeu_ps(dst + b * out_channels, _mm256_castps256_ps128(acc0));
+			_mm_storeu_ps(dst + (b + 1) * out_channels, _mm256_extractf128_ps(acc0, 1));
+			_mm_storeu_ps(dst + (b + 2) * out_channels, _mm256_castps256_ps128(acc1));
+			_mm_storeu_ps(dst + (b + 3) * out_channels, _mm256_extractf128_ps(acc1, 1));
+		}
+	}
+	else
+	{	for (; (b + 1) * out_channels + 8 <= n * out_channels; b += 2)
+		{	acc0 = acc1 = _mm256_setzero_ps();
+			a = src + b * in_channels;
+			for (i = 0; i < in_channels; i++)
+			{	row  = _mm256_loadu_ps(gains + i * MIX_CHANNELS);
+				acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_broadcast_ss(a + i), row));
+				acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_broadcast_ss(a + in_channels + i), row));
+			}
+			_mm256_storeu_ps(dst + b * out_channels, acc0);
+			_mm256_storeu_ps(dst + (b + 1) * out_channels, acc1);
+		}
+	}
+
+	mix_f32_scalar(src + b * in_channels, dst + b * out_channels, gains, in_channels, out_channels, n - b);
+}
+#endif
+
+static const FIRKernels kernel_table[] = {
+	{ SIMD_Scalar, dot_u8_scalar, dot_i32_scalar, dot_f64_scalar, dot_f32_scalar,
+	               pair_u8_scalar, pair_i32_scalar, pair_f64_scalar, pair_f32_scalar },
+#if defined KERNELS_X86
+	// Two 64-bit lanes don't outrun the scalar multiplier, so SSE4.1 keeps the scalar 32 and 64-bit kernels
+	{ SIMD_SSE41,  dot_u8_sse41,  dot_i32_scalar, dot_f64_scalar, dot_f32_scalar,
+	               pair_u8_sse41,  pair_i32_scalar, pair_f64_scalar, pair_f32_scalar },
+	{ SIMD_AVX2,   dot_u8_avx2,   dot_i32_avx2,   dot_f64_avx2,   dot_f32_avx2,
+	               pair_u8_avx2,   pair_i32_avx2,   pair_f64_avx2,   pair_f32_avx2   },
+#endif
+};
+
+static const FormatKernels format_table[] = {
+	{ SIMD_Scalar, u8_to_i16_scalar, i16_to_u8_scalar, dup_u8_scalar, dup_i16_scalar, dup_i32_scalar,
+	               avg_u8_scalar, avg_i16_scalar, avg_i32_scalar, avg_f32_scalar, mix_f32_scalar },
+#if defined KERNELS_X86
+	{ SIMD_SSE41,  u8_to_i16_sse41,  i16_to_u8_sse41,  dup_u8_sse41,  dup_i16_sse41,  dup_i32_sse41,
+	               avg_u8_sse41,  avg_i16_sse41,  avg_i32_sse41,  avg_f32_sse41,  mix_f32_sse41 },
+	{ SIMD_AVX2,   u8_to_i16_avx2,   i16_to_u8_avx2,   dup_u8_avx2,   dup_i16_avx2,   dup_i32_avx2,
+	               avg_u8_avx2,   avg_i16_avx2,   avg_i32_avx2,   avg_f32_avx2,   mix_f32_avx2 },
+#endif
+};
+
+// Queries the highest instruction set level supported by the CPU and the OS
+static int query_simd_level()
+{
+	int level = SIMD_Scalar;
+
+#if defined KERNELS_X86
+	int info[4];
+	CPUID(info, 0);
+	int max_leaf = info[0];
+
+	CPUID(info, 1);
+	bool sse41   = (info[2] & (1 << 19)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+
+	if(sse41)
+	{	level = SIMD_SSE41;
+	}
+
+	// AVX2 also needs the OS to save the YMM registers on context switches
+	if(sse41 && osxsave && max_leaf >= 7 && (XGETBV() & 6) == 6)
+	{
+		CPUID(info, 7);
+		if(info[1] & (1 << 5))
+		{	level = SIMD_AVX2;
+		}
+	}
+#endif
+
+	return level;
+}
+
+// Finds the highest instruction set level supported by the CPU and the OS
+// The CPU is only queried once, later calls return the cached result
+SIMDLevel detect_simd_level()
+{
+	// The initialisation of a local static runs once, even when threads first call this together
+	static const int detected = query_simd_level();
+
+	return (SIMDLevel)detected;
+}
+
+// Returns the kernels of the fastest level supported by the CPU
+const FIRKernels* get_fir_kernels()
+{
+	return &kernel_table[detect_simd_level()];
+}
+
+// Returns the kernels of a specific level (capped at the supported level)
+const FIRKernels* get_fir_kernels(SIMDLevel level)
+{
+	SIMDLevel supported = detect_simd_level();
+	return &kernel_table[level < supported ? level : supported];
+}
+
+// Returns the format conversion kernels of the fastest level supported by the CPU
+const FormatKernels* get_format_kernels()
+{
+	return &format_table[detect_simd_level()];
+}
+
+// Returns the format conversion kernels of a specific level (capped at the supported level)
+const FormatKernels* get_format_kernels(SIMDLevel level)
+{
+	SIMDLevel supported = detect_simd_level();
+	return &format_table[level < supported ? level : supported];
+}
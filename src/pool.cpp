@@ -0,0 +1,116 @@
+#include <audio-lib/pool.h>
+#include <cpthread/cpmutex.h>
+#include <atomic>
+
+// Header before each block, 16 bytes so the blocks keep the alignment of the heap
+struct alignas(16) PoolHeader
+{	PoolHeader* next;			// Next free block of the class, only used while the block is free
+	int size_class;				// Size class of the block, POOL_CLASSES for the blocks too large for the pool
+};
+
+// Free blocks of a size class
+struct PoolClass
+{	std::atomic<PoolHeader*> released;	// Blocks released by any thread, pushed without a lock
+	PoolHeader* free;					// Blocks taken from the released ones, only used under the lock
+	mutex lock;							// Lock of the requests, which can't take a block another one took
+};
+
+static PoolClass pool_classes[POOL_CLASSES];
+
+static std::atomic<size_t> pool_requests(0);
+static std::atomic<size_t> pool_reused(0);
+static std::atomic<size_t> pool_heap_allocs(0);
+static std::atomic<size_t> pool_releases(0);
+static std::atomic<size_t> pool_bytes(0);
+
+// Returns a block of at least n bytes, aligned for any sample type
+void* pool_alloc(size_t bytes)
+{
+	int size_class = 0;
+	while(size_class < POOL_CLASSES && ((size_t)1 << (size_class + POOL_MIN_SHIFT)) < bytes)
+	{	size_class++;
+	}
+
+	pool_requests.fetch_add(1, std::memory_order_relaxed);
+
+	PoolHeader* block = NULL;
+	if(size_class < POOL_CLASSES)
+	{
+		PoolClass &pool = pool_classes[size_class];
+		pool.lock.lock();
+
+		// The whole released list is taken at once, so no other request can pop its blocks in between
+		if(pool.free == NULL)
+		{	pool.free = pool.released.exchange(NULL, std::memory_order_acquire);
+		}
+
+		block = pool.free;
+		if(block != NULL)
+		{	pool.free = block->next;
+		}
+
+		pool.lock.unlock();
+
+		if(block != NULL)
+		{	pool_reused.fetch_add(1, std::memory_order_relaxed);
+			return block + 1;
+		}
+
+		bytes = (size_t)1 << (size_class + POOL_MIN_SHIFT);
+		pool_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	pool_heap_allocs.fetch_add(1, std::memory_order_relaxed);
+
+	block = (PoolHeader*)new char[sizeof(PoolHeader) + bytes];
+	block->next = NULL;
+	block->size_class = size_class;
+	return block + 1;
+}
+
+// Releases a block returned by pool_alloc to its free list, NULL is ignored
+void pool_free(void* ptr)
+{
+	if(ptr == NULL)
+	{	return;
+	}
+
+	PoolHeader* block = (PoolHeader*)ptr - 1;
+	pool_releases.fetch_add(1, std::memory_order_relaxed);
+
+	if(block->size_class == POOL_CLASSES)
+	{	delete[] (char*)block;
+		return;
+	}
+
+	std::atomic<PoolHeader*> &released = pool_classes[block->size_class].released;
+	PoolHeader* head = released.load(std::memory_order_relaxed);
+	do
+	{	block->next = head;
+	}
+	while(!released.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Returns the counters of the pool
+PoolStats get_pool_stats()
+{
+	PoolStats stats;
+	stats.requests     = pool_requests.load(std::memory_order_relaxed);
+	stats.reused       = pool_reused.load(std::memory_order_relaxed);
+	stats.heap_allocs  = pool_heap_allocs.load(std::memory_order_relaxed);
+	stats.releases     = pool_releases.load(std::memory_order_relaxed);
+	stats.in_use       = stats.requests - stats.releases;
+	stats.pooled_bytes = pool_bytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+// Writes the counters of the pool and the share of the requests it served without the heap
+void print_pool_stats(std::ostream &out)
+{
+	PoolStats stats = get_pool_stats();
+
+	out << "pool: " << stats.requests << " requests, " << stats.reused << " reused ("
+	    << (stats.requests != 0 ? 100 * stats.reused / stats.requests : 0) << "%), "
+	    << stats.heap_allocs << " from the heap, " << stats.releases << " releases, "
+	    << stats.in_use << " in use, " << stats.pooled_bytes / 1024 << " KB pooled\n";
+}
@@ -1,22 +1,437 @@
 #include <audio-lib/sampling.h>
 #include <string.h>
+#include <cpthread/cpmutex.h>
 
 #define MODINC(n, m) n = n == m-1 ? 0 : n+1;
 #define MODDEC(n, m) n = n == 0 ? m-1 : n-1;
 #define MODADD(n, v, m) n = (n + v) % m;
 #define MODSUB(n, v, m) n = (n - v) % m;
 
+// Writes a value to both halves of a mirrored delay line of size m, so the last
+// m samples are always contiguous in memory, starting from the oldest one
+#define MIRROR(line, n, m, v) line[n] = line[n + m] = v;
+
+// Rounds to the nearest integer, halfway cases away from zero
+static constexpr inline llong round_nearest(double x)
+{
+	return x < 0 ? -(llong)(0.5 - x) : (llong)(x + 0.5);
+}
+
+// Fraction bits of the fixed-point coefficient types, floating point coefficients have none
+static constexpr inline int q_bits(const short*)  { return 15; }
+static constexpr inline int q_bits(const int*)    { return 31; }
+static constexpr inline int q_bits(const double*) { return 0; }
+static constexpr inline int q_bits(const float*)  { return 0; }
+
+// Stores a filter coefficient divided by the scale of its filter in the coefficient type of the samples
+// Fixed-point coefficients have "shift" fraction bits, so the accumulators only need a rounding shift
+static constexpr inline void set_coef(short &dst, llong coef, llong scale, int shift)  { dst = (short)round_nearest((double)coef / scale * (1ll << shift)); }
+static constexpr inline void set_coef(int &dst, llong coef, llong scale, int shift)    { dst = (int)round_nearest((double)coef / scale * (1ll << shift)); }
+static constexpr inline void set_coef(double &dst, llong coef, llong scale, int)       { dst = (double)coef / scale; }
+static constexpr inline void set_coef(float &dst, llong coef, llong scale, int)        { dst = (float)((double)coef / scale); }
+
+// Corrects the largest fixed-point coefficient of a row for the rounding of the others,
+// so the row keeps a gain of exactly one and silence stays exact
+template<typename C>
+static constexpr void fix_gain(C* row, size_t n, int shift)
+{
+	if(q_bits((const C*)0) == 0 || n == 0)
+	{	return;
+	}
+
+	llong sum = 0;
+	size_t peak = 0;
+	for(size_t i = 0; i < n; i++)
+	{	sum += (llong)row[i];
+		if((row[i] < 0 ? -row[i] : row[i]) > (row[peak] < 0 ? -row[peak] : row[peak]))
+		{	peak = i;
+		}
+	}
+
+	row[peak] = (C)(row[peak] + ((1ll << shift) - sum));
+}
+
+// Normalises the coefficients of a converter to a gain of one, so the outputs need no division
+// The interpolation coefficients are regrouped by phase, so the coefficients used
+// for each of the L phases are contiguous for the convolution kernels
+// Only the rows the converter convolves are normalised, the L phases of interpolation and non-integral
+// steps, or the decimation row of decimation steps, whose other coefficients are left untouched
+// Returns the fraction bits of fixed-point coefficients, which are reduced from Q15/Q31
+// when a row has a coefficient too close to (or above) one to be represented
+template<typename C>
+static constexpr int normalize_coefs(const llong* inter, const llong* decim, size_t L, size_t taps, C* inter_rows, C* decim_row)
+{
+	size_t delay_size = taps / L;
+	size_t row_size   = L > 1 ? delay_size : taps;
+	int    shift      = q_bits((const C*)0);
+	llong  limit      = (1ll << shift) - 1;
+
+	// Calculate the scaling factor (sum of the coefficients) of the decimation filter
+	llong decim_scale = 0;
+	for(size_t i = 0; L == 1 && i < taps; i++)
+	{	decim_scale += decim[i];
+	}
+
+	// Find the largest normalised coefficient, each interpolation phase has its own scale
+	double peak = 0;
+	for(size_t i = 0; L == 1 && i < taps; i++)
+	{	double v = (double)decim[i] / decim_scale;
+		peak = v > peak ? v : -v > peak ? -v : peak;
+	}
+
+	for(size_t i = 0; L > 1 && i < L; i++)
+	{
+		llong inter_scale = 0;
+		for(size_t j = 0; j < delay_size; j++)
+		{	inter_scale += inter[i + j * L];
+		}
+
+		for(size_t j = 0; j < delay_size; j++)
+		{	double v = (double)inter[i + j * L] / inter_scale;
+			peak = v > peak ? v : -v > peak ? -v : peak;
+		}
+	}
+
+	// Leave room for the gain correction of the rows, which moves a coefficient by up to half their taps
+	while(shift > 0 && round_nearest(peak * (1ll << shift)) + (llong)row_size > limit)
+	{	shift--;
+	}
+
+	for(size_t i = 0; L > 1 && i < L; i++)
+	{
+		llong inter_scale = 0;
+		for(size_t j = 0; j < delay_size; j++)
+		{	inter_scale += inter[i + j * L];
+		}
+
+		for(size_t j = 0; j < delay_size; j++)
+		{	set_coef(inter_rows[i * delay_size + j], inter[i + j * L], inter_scale, shift);
+		}
+
+		fix_gain(inter_rows + i * delay_size, delay_size, shift);
+	}
+
+	for(size_t i = 0; L == 1 && i < taps; i++)
+	{	set_coef(decim_row[i], decim[i], decim_scale, shift);
+	}
+
+	if(L == 1)
+	{	fix_gain(decim_row, taps, shift);
+	}
+
+	return shift;
+}
+
+// Normalises the coefficients of a half-band filter of 4k-1 taps, keeping only the k nonzero
+// coefficients on one side of the centre, followed by the centre coefficient
+// The decimation row has a gain of one, the centre weighs one half and each pair of taps adds up the
+// rest, the interpolation row has twice its pair coefficients and a centre of one, which copies the
+// samples the interpolated ones fall between
+// Returns the fraction bits of fixed-point coefficients, a bit lower than Q15/Q31 so the centre
+// coefficient of one can be represented
+template<typename C>
+static int normalize_half_band(const llong* coefs, size_t taps, C* inter_row, C* decim_row)
+{
+	size_t pairs  = (taps + 1) >> 2;
+	size_t centre = taps >> 1;
+	int    shift  = q_bits((const C*)0) > 0 ? q_bits((const C*)0) - 1 : 0;
+
+	// Sum of one side of the filter, the zero coefficients are left out
+	llong side = 0;
+	for(size_t i = 0; i < pairs; i++)
+	{	side += coefs[centre + 1 + 2 * i];
+	}
+
+	for(size_t i = 0; i < pairs; i++)
+	{	set_coef(inter_row[i], coefs[centre + 1 + 2 * i], side * 2, shift);
+		set_coef(decim_row[i], coefs[centre + 1 + 2 * i], side * 4, shift);
+	}
+
+	// The pairs add up to one half of the interpolated samples and one quarter of the decimated ones
+	fix_gain(inter_row, pairs, shift - 1);
+	fix_gain(decim_row, pairs, shift - 2);
+
+	set_coef(inter_row[pairs], 1, 1, shift);
+	set_coef(decim_row[pairs], 1, 2, shift);
+
+	return shift;
+}
+
+// Selects the convolution kernel of each delay line sample type
+static inline int    dot(const FIRKernels* k, const short* c, const uchar* s, size_t n)  { return k->dot_u8(c, s, n); }
+static inline llong  dot(const FIRKernels* k, const int* c, const int* s, size_t n)      { return k->dot_i32(c, s, n); }
+static inline double dot(const FIRKernels* k, const double* c, const int* s, size_t n)   { return k->dot_f64(c, s, n); }
+static inline float  dot(const FIRKernels* k, const float* c, const float* s, size_t n)  { return k->dot_f32(c, s, n); }
+
+// Selects the symmetric convolution kernel of each delay line sample type
+static inline int    pair_dot(const FIRKernels* k, const short* c, const uchar* a, const uchar* b, size_t n)  { return k->pair_u8(c, a, b, n); }
+static inline llong  pair_dot(const FIRKernels* k, const int* c, const int* a, const int* b, size_t n)        { return k->pair_i32(c, a, b, n); }
+static inline double pair_dot(const FIRKernels* k, const double* c, const int* a, const int* b, size_t n)     { return k->pair_f64(c, a, b, n); }
+static inline float  pair_dot(const FIRKernels* k, const float* c, const float* a, const float* b, size_t n)  { return k->pair_f32(c, a, b, n); }
+
+// Limbs the fixed-point coefficients are split into for the overlap-save transforms, each limb times the
+// samples sums up far enough below 2^53 for the transforms to round back to the exact integer convolutions
+// Floating point coefficients have none, their converters keep the direct path
+#define FFT_LIMB_BITS 11
+static constexpr inline int fft_limbs(const short*)  { return 1; }
+static constexpr inline int fft_limbs(const int*)    { return 3; }
+static constexpr inline int fft_limbs(const double*) { return 0; }
+static constexpr inline int fft_limbs(const float*)  { return 0; }
+
+// Cost of each point of each stage of a transform, in multiply-accumulates of the direct path's kernels
+static constexpr inline int fft_point_cost(const short*)  { return 32; }
+static constexpr inline int fft_point_cost(const int*)    { return 6; }
+static constexpr inline int fft_point_cost(const double*) { return 1; }
+static constexpr inline int fft_point_cost(const float*)  { return 1; }
+
+// Cost of the transforms of a chunk of a pair of channels, in multiply-accumulates of the direct path's kernels
+// The chunk takes a forward transform, and an inverse one for each limb of each row
+template<typename C>
+static inline size_t fft_chunk_cost(size_t points, size_t rows)
+{
+	size_t stages = 0;
+	while (((size_t)1 << stages) < points)
+	{	stages++;
+	}
+
+	return (1 + rows * fft_limbs((const C*)0)) * points * stages * fft_point_cost((const C*)0);
+}
+
+// Splits a fixed-point coefficient into limbs of FFT_LIMB_BITS bits, balanced around zero, the last one takes the rest
+static inline void split_coef(llong coef, int limbs, llong* parts)
+{
+	llong half = 1ll << (FFT_LIMB_BITS - 1);
+	for(int p = 0; p < limbs; p++)
+	{	parts[p] = p == limbs - 1 ? coef : ((coef + half) & ((half << 1) - 1)) - half;
+		coef = (coef - parts[p]) >> FFT_LIMB_BITS;
+	}
+}
+
+static RateTables* tables_head = NULL;	// Entries of the converter table cache
+static mutex       tables_lock;			// Lock of the cache, converters are created from many threads
+
+// Builds the normalised coefficient rows of the shared tables in the coefficient type of the samples
+template<typename T>
+static void build_coefs(RateTables* t)
+{
+	typedef typename SampleTraits<T>::coef_t coef_t;
+
+	coef_t* inter_rows = t->L > 1  ? (coef_t*)new char[t->taps / t->L * t->L * sizeof(coef_t)] : NULL;
+	coef_t* decim_row  = t->L == 1 ? (coef_t*)new char[t->taps * sizeof(coef_t)] : NULL;
+
+	t->coef_shift  = normalize_coefs(t->inter_filter.coefs, t->decim_filter.coefs, t->L, t->taps, inter_rows, decim_row);
+	t->inter_coefs = inter_rows;
+	t->decim_coefs = decim_row;
+}
+
+// Builds the normalised pair coefficients of half-band tables in the coefficient type of the samples
+template<typename T>
+static void build_half_band_coefs(RateTables* t)
+{
+	typedef typename SampleTraits<T>::coef_t coef_t;
+
+	size_t size = ((t->taps + 1) >> 2) + 1;
+	coef_t* inter_row = (coef_t*)new char[size * sizeof(coef_t)];
+	coef_t* decim_row = (coef_t*)new char[size * sizeof(coef_t)];
+
+	t->coef_shift  = normalize_half_band(t->decim_filter.coefs, t->taps, inter_row, decim_row);
+	t->inter_coefs = inter_row;
+	t->decim_coefs = decim_row;
+}
+
+// Builds the transforms of the normalised coefficient rows of integer steps, for their overlap-save convolutions
+// Each row is reversed, so the convolutions line up with the dot products of the direct path, and split into limbs
+template<typename T>
+static void build_fft_spectra(RateTables* t)
+{
+	typedef typename SampleTraits<T>::coef_t coef_t;
+
+	size_t rows = t->L > 1 ? t->L : 1;
+	size_t size = t->L > 1 ? t->taps / t->L : t->taps;
+	const coef_t* coefs = (const coef_t*)(t->L > 1 ? t->inter_coefs : t->decim_coefs);
+
+	// Each transform takes a block of new samples after the last size-1 samples of the delay lines
+	// The transforms are only built if the outputs of the longest block cost more through the direct path
+	size_t points = 1;
+	while (points < size << 1)
+	{	points <<= 1;
+	}
+
+	size_t outputs = (points - size + 1) / t->M;
+	if (2 * outputs * rows * size < fft_chunk_cost<coef_t>(points, rows))
+	{	return;
+	}
+
+	t->fft.init(points);
+	t->fft_limbs = fft_limbs((const coef_t*)0);
+
+	t->fft_spectra = new double[rows * t->fft_limbs * points * 2];
+	memset(t->fft_spectra, 0, rows * t->fft_limbs * points * 2 * sizeof(double));
+
+	llong parts[4];
+	for(size_t r = 0; r < rows; r++)
+	{	double* spectra = t->fft_spectra + r * t->fft_limbs * points * 2;
+		for(size_t k = 0; k < size; k++)
+		{	split_coef((llong)coefs[r * size + size - 1 - k], t->fft_limbs, parts);
+			for(int p = 0; p < t->fft_limbs; p++)
+			{	spectra[p * points * 2 + 2 * k] = (double)parts[p] / points;
+			}
+		}
+
+		for(int p = 0; p < t->fft_limbs; p++)
+		{	t->fft.forward(spectra + p * points * 2);
+		}
+	}
+}
+
+// Designs the filters of a converter and builds its coefficient tables
+static RateTables* build_rate_tables(size_t L, size_t M, size_t taps, SampleType type, FIRWindow window, int cutoff, bool half_band)
+{
+	RateTables* t = new RateTables;
+	t->L    = L;
+	t->M    = M;
+	t->taps = taps;
+	t->type = type;
+	t->window = window;
+	t->cutoff = cutoff;
+	t->half_band = half_band;
+	t->refs = 0;
+	t->inter_coefs = NULL;
+	t->decim_coefs = NULL;
+	t->coef_shift  = 0;
+	t->fft_spectra = NULL;
+	t->fft_limbs   = 0;
+
+	// Both directions of a half-band stage use the same filter, cut off at a quarter of its rate
+	if(half_band)
+	{	t->inter_filter.init(taps, 1000, 4000, window);
+		t->decim_filter = t->inter_filter;
+
+		switch(type)
+		{	case _UInt8:   build_half_band_coefs<uchar>(t); break;
+			case _Int16:   build_half_band_coefs<short>(t); break;
+			case _Int24:   build_half_band_coefs<int24>(t); break;
+			case _Int32:   build_half_band_coefs<int>(t);   break;
+			case _Float:   build_half_band_coefs<float>(t); break;
+			default: break;
+		}
+
+		return t;
+	}
+
+	// Non-integral conversions run a single polyphase filter, so its cutoff
+	// must satisfy both the interpolation and the decimation bandwidth
+	// The cutoff is a fraction of the Nyquist frequency, a thousandth of half the filter's rate
+	if(L > 1 && M > 1)
+	{	t->inter_filter.init(taps, cutoff, (L > M ? L : M) * 2000, window);
+	}
+	else
+	{	t->inter_filter.init(taps, cutoff, L * 2000, window);
+	}
+
+	t->decim_filter.init(taps, cutoff, M * 2000, window);
+
+	switch(type)
+	{	case _UInt8:   build_coefs<uchar>(t); break;
+		case _Int16:   build_coefs<short>(t); break;
+		case _Int24:   build_coefs<int24>(t); break;
+		case _Int32:   build_coefs<int>(t);   break;
+		case _Float:   build_coefs<float>(t); break;
+		default: break;
+	}
+
+	// Integer steps with long filters convolve blocks through FFTs, the
+	// floating point samples keep the direct path as their sums aren't exact
+	if(L == 1 || M == 1)
+	{	switch(type)
+		{	case _UInt8:   build_fft_spectra<uchar>(t); break;
+			case _Int16:   build_fft_spectra<short>(t); break;
+			case _Int24:   build_fft_spectra<int24>(t); break;
+			default: break;
+		}
+	}
+
+	return t;
+}
+
+// Finds the coefficient tables of a converter in the cache, building them if no converter holds them yet
+// Every acquired entry must be released once, the last release deallocates it
+// Half-band tables always cut off at a quarter of the filters' rate, whatever the cutoff asked for
+const RateTables* acquire_rate_tables(size_t L, size_t M, size_t taps, SampleType type, FIRWindow window, int cutoff, bool half_band)
+{
+	if(half_band)
+	{	cutoff = 1000;
+	}
+
+	tables_lock.lock();
+
+	RateTables* entry = tables_head;
+	while(entry != NULL)
+	{	if(entry->L == L && entry->M == M && entry->taps == taps && entry->type == type &&
+		   entry->window == window && entry->cutoff == cutoff && entry->half_band == half_band)
+		{	break;
+		}
+		entry = entry->next;
+	}
+
+	// The tables are built under the lock, so concurrent requests don't build them twice
+	if(entry == NULL)
+	{	entry = build_rate_tables(L, M, taps, type, window, cutoff, half_band);
+		entry->next = tables_head;
+		tables_head = entry;
+	}
+
+	entry->refs++;
+	tables_lock.unlock();
+
+	return entry;
+}
+
+// Removes a holder of the tables, deallocating them with the last one
+void release_rate_tables(const RateTables* tables)
+{
+	tables_lock.lock();
+
+	RateTables* owned = (RateTables*)tables;
+	if(--owned->refs == 0)
+	{
+		RateTables** link = &tables_head;
+		while(*link != owned)
+		{	link = &(*link)->next;
+		}
+		*link = owned->next;
+
+		if(owned->inter_coefs != NULL) { delete[] (char*)owned->inter_coefs; }
+		if(owned->decim_coefs != NULL) { delete[] (char*)owned->decim_coefs; }
+		if(owned->fft_spectra != NULL) { delete[] owned->fft_spectra; }
+		delete owned;
+	}
+
+	tables_lock.unlock();
+}
+
+// Distance between the delay lines of consecutive channels
+// Half-band stages keep their pair samples forwards and backwards, so both samples of each pair
+// are read in the same direction, and their decimation also keeps the samples of the centre tap
+static inline size_t inter_stride(const RateConverter &cnv)
+{
+	return cnv.half_band ? cnv.inter_size << 2 : cnv.inter_size << 1;
+}
+
+static inline size_t decim_stride(const RateConverter &cnv)
+{
+	return cnv.half_band ? (cnv.decim_size << 2) + (cnv.decim_size >> 1) : cnv.decim_size << 1;
+}
+
 RateConverter::RateConverter() :
-	inter_delay_lines(0), inter_delay_idxs(0), inter_scales(0),
-	decim_delay_lines(0), decim_delay_idxs(0), decim_fractions(0)
+	inter_delay_lines(0), decim_delay_lines(0), tables(0), fft_buffer(0)
 {
 }
 
-RateConverter::RateConverter(size_t L, size_t M, size_t taps, size_t channels, size_t depth) :
-	inter_delay_lines(0), inter_delay_idxs(0),
-	decim_delay_lines(0), decim_delay_idxs(0), decim_fractions(0)
+RateConverter::RateConverter(size_t L, size_t M, size_t taps, size_t channels, SampleType type, FIRWindow window, int cutoff, bool half_band) :
+	inter_delay_lines(0), decim_delay_lines(0), tables(0), fft_buffer(0)
 {
-	init(L, M, taps, channels, depth);
+	init(L, M, taps, channels, type, window, cutoff, half_band);
 }
 
 RateConverter::~RateConverter()
@@ -25,502 +440,1108 @@ RateConverter::~RateConverter()
 }
 
 // Initializes the filters and buffers for the converter
-void RateConverter::init(size_t L, size_t M, size_t taps, size_t channels, size_t depth)
+// The filters are windowed by "window" and cut off at "cutoff" thousandths of the Nyquist frequency
+// Half-band converters interpolate or decimate by 2 with "taps" = 4k-1 coefficients, of which
+// only the k pairs around the centre are nonzero
+void RateConverter::init(size_t L, size_t M, size_t taps, size_t channels, SampleType type, FIRWindow window, int cutoff, bool half_band)
 {
+	clear();
+
 	this->L = L;
 	this->M = M;
 
-	this->num_channels = channels; 
-	this->bit_depth = depth;
+	this->num_channels = channels;
+	this->sample_type = type;
+	this->half_band = half_band;
+
+	// The filters and coefficient tables are shared by every converter with the same
+	// factors, filter design and sample type, they are only designed by the first one
+	tables = acquire_rate_tables(L, M, taps, type, window, cutoff, half_band);
+
+	inter_filter = tables->inter_filter;
+	decim_filter = tables->decim_filter;
+	inter_coefs  = tables->inter_coefs;
+	decim_coefs  = tables->decim_coefs;
+	coef_shift   = tables->coef_shift;
+
+	// The interpolation delay lines span the taps of one phase and the decimation ones every tap,
+	// the delay lines of a half-band stage span the samples meeting its k pairs of taps
+	inter_size = half_band ? (taps + 1) >> 1 : inter_filter.size / L;
+	decim_size = half_band ? (taps + 1) >> 1 : decim_filter.size;
+
+	inter_delay_idx = 0;
+	inter_phase     = 0;
+	decim_delay_idx = 0;
+	decim_fraction  = 0;
+	fixed_kernel    = NULL;
+
+	switch(type)
+	{	case _UInt8:   init_delay_lines<uchar>(); break;
+		case _Int16:   init_delay_lines<short>(); break;
+		case _Int24:   init_delay_lines<int24>(); break;
+		case _Int32:   init_delay_lines<int>();   break;
+		case _Float:   init_delay_lines<float>(); break;
+		default: break;
+	}
 
-	inter_filter.init(taps, 1, L << 1);
-	inter_delay_lines = new void*[channels];
+	// The overlap-save path transforms a pair of channels at a time, then
+	// convolves them with each limb of a row and sums up the limbs of its outputs
+	if(tables->fft.size > 0)
+	{	fft_buffer = new double[tables->fft.size * 6];
+	}
 
-	decim_filter.init(taps, 1, M << 1);
-	decim_delay_lines = new void*[channels];
+	// Select the fastest convolution kernels the CPU supports
+	kernels = get_fir_kernels();
+}
 
-	inter_delay_idxs = new size_t[channels];
-	decim_delay_idxs = new size_t[channels];
-	decim_fractions  = new size_t[channels];
+// Allocates the delay lines for a sample type
+template<typename T>
+void RateConverter::init_delay_lines()
+{
+	typedef typename SampleTraits<T>::delay_t delay_t;
 
-	memset(inter_delay_idxs, 0, sizeof(size_t) * channels);
-	memset(decim_delay_idxs, 0, sizeof(size_t) * channels);
-	memset(decim_fractions,  0, sizeof(size_t) * channels);
+	// Delay lines are mirrored (every sample is stored twice, size apart), so the
+	// convolution window never wraps around and is always a contiguous block
+	// The lines of all channels are placed side by side in a single allocation
+	size_t inter_count = inter_stride(*this) * num_channels;
+	size_t decim_count = decim_stride(*this) * num_channels;
 
-	// Create and initialize the delay lines for each channel
-	for (size_t i = 0; i < channels; i++)
-	{	inter_delay_lines[i] = new char[(bit_depth << 3) * taps / L];
-		decim_delay_lines[i] = new char[(bit_depth << 3) * taps];
+	inter_delay_lines = new char[inter_count * sizeof(delay_t)];
+	decim_delay_lines = new char[decim_count * sizeof(delay_t)];
 
-		// Set the default values according to unsigned (8-bit) or signed (16-bit+) zeros
-		memset(inter_delay_lines[i], bit_depth == 8 ? 0x80 : 0, (bit_depth << 3) * taps / L);
-		memset(decim_delay_lines[i], bit_depth == 8 ? 0x80 : 0, (bit_depth << 3) * taps);
-	}
+	silence_delay_lines<T>();
+}
+
+// Fills the delay lines with the silence of a sample type
+template<typename T>
+void RateConverter::silence_delay_lines()
+{
+	typedef typename SampleTraits<T>::delay_t delay_t;
 
-	// Add gain to the interpolation coefficients
-	for(int i = 0; i < taps / L; i++)
-	{	inter_filter.coefs[i] *= L;
+	size_t inter_count = inter_stride(*this) * num_channels;
+	size_t decim_count = decim_stride(*this) * num_channels;
+
+	// Set the default values to the zero of the sample type (unsigned for 8-bit)
+	delay_t zero = SampleTraits<T>::load(SampleTraits<T>::silence());
+	for(size_t i = 0; i < inter_count; i++)
+	{	((delay_t*)inter_delay_lines)[i] = zero;
+	}
+	for(size_t i = 0; i < decim_count; i++)
+	{	((delay_t*)decim_delay_lines)[i] = zero;
 	}
+}
 
-	// Calculate the scaling factor (to divide by) after decimation
-	decim_scale = 0;
-	for(size_t i = 0; i < taps ; i++)
-	{	decim_scale += decim_filter.coefs[i];
+// Deallocates all dynamic resources
+void RateConverter::clear()
+{
+	if(inter_delay_lines != 0) { delete[] (char*)inter_delay_lines; }
+	if(decim_delay_lines != 0) { delete[] (char*)decim_delay_lines; }
+	if(tables != 0)            { release_rate_tables(tables); }
+	if(fft_buffer != 0)        { delete[] fft_buffer; }
+
+	inter_delay_lines = 0;
+	decim_delay_lines = 0;
+	tables = 0;
+	fft_buffer = 0;
+
+	inter_filter.clear();
+	decim_filter.clear();
+}
+
+// Brings the converter back to its state after init, without allocating anything
+void RateConverter::reset()
+{
+	inter_delay_idx = 0;
+	inter_phase     = 0;
+	decim_delay_idx = 0;
+	decim_fraction  = 0;
+
+	switch(sample_type)
+	{	case _UInt8:   silence_delay_lines<uchar>(); break;
+		case _Int16:   silence_delay_lines<short>(); break;
+		case _Int24:   silence_delay_lines<int24>(); break;
+		case _Int32:   silence_delay_lines<int>();   break;
+		case _Float:   silence_delay_lines<float>(); break;
+		default: break;
 	}
+}
 
-	// Calculate the scaling factor (to divide by) after interpolation
-	// Each L samples use different coefficients, so they each have a scale factor
-	inter_scales = new llong[L];
-	int coef_orig = ((inter_filter.size >> 1) + 1) % L;
-	int coef_idx;
-	for(size_t i = 0; i < L; i++)
+// Shape of a converter known only at runtime, the factors, filter sizes and
+// coefficients are read from the converter and convolved by the CPU's kernels
+template<typename T>
+struct RuntimeShape
+{	typedef typename SampleTraits<T>::delay_t delay_t;
+	typedef typename SampleTraits<T>::coef_t  coef_t;
+	typedef typename SampleTraits<T>::accum_t accum_t;
+
+	size_t L, M;					// Interpolation and decimation factors
+	size_t taps;					// Number of coefficients of the filters
+	size_t inter_size;				// Size of the interpolation delay lines
+	size_t decim_size;				// Size of the decimation delay lines
+
+	const RateConverter &cnv;
+
+	RuntimeShape(const RateConverter &cnv) :
+		L(cnv.L), M(cnv.M), taps(cnv.inter_filter.size),
+		inter_size(cnv.inter_size), decim_size(cnv.decim_size),
+		cnv(cnv)
 	{
-		inter_scales[coef_orig] = 0;
-		coef_idx = coef_orig;
+	}
 
-		for(size_t j = 0; j < taps / L; j++)
-		{	inter_scales[coef_orig] += inter_filter.coefs[coef_idx];
-			coef_idx += L;
-		}
+	inline const coef_t* inter_row(size_t phase) const	{ return (const coef_t*)cnv.inter_coefs + phase * inter_size; }
+	inline int shift() const							{ return cnv.coef_shift; }
 
-		MODINC(coef_orig, L);
+	inline accum_t inter_dot(const coef_t* coefs, const delay_t* line) const
+	{	return dot(cnv.kernels, coefs, line, inter_size);
 	}
-}
 
-// Deallocates all dynamic resources
-void RateConverter::clear()
-{
-	if(inter_delay_lines != 0)
+	inline accum_t decim_dot(const delay_t* line) const
+	{	return dot(cnv.kernels, (const coef_t*)cnv.decim_coefs, line, decim_size);
+	}
+};
+
+// Coefficient tables of a converter generated at compile time, cut off at CUTOFF thousandths
+// of the Nyquist frequency and laid out the same way RateConverter::init builds them at runtime
+// Only the filter the converter convolves is designed, the other one keeps a single coefficient
+template<typename C, size_t L, size_t M, size_t TAPS, FIRWindow W, int CUTOFF>
+struct FixedTables
+{	C inter_coefs[L > 1 ? TAPS / L * L : 1];	// Interpolation coefficients regrouped into contiguous rows for each phase
+	C decim_coefs[L > 1 ? 1 : TAPS];			// Decimation coefficients
+	int coef_shift;								// Fraction bits of fixed-point coefficients
+
+	constexpr FixedTables() : inter_coefs(), decim_coefs(), coef_shift(0)
 	{
-		for (size_t i = 0; i < num_channels; i++)
-		{	delete[] inter_delay_lines[i];
+		FIRTable_i64<(L > 1 ? TAPS : 1)> inter(CUTOFF, (int)((L > 1 && M > 1 ? (L > M ? L : M) : L) * 2000), W);
+		FIRTable_i64<(L > 1 ? 1 : TAPS)> decim(CUTOFF, (int)(M * 2000), W);
+
+		coef_shift = normalize_coefs(inter.coefs, decim.coefs, L, TAPS, inter_coefs, decim_coefs);
+	}
+};
+
+// Convolution of a constant length, a loop the compiler unrolls and vectorises
+template<typename C, typename D, typename A, size_t N>
+struct FixedDot
+{	static inline A run(const FIRKernels*, const C* coefs, const D* line)
+	{	A acc = 0;
+		for (size_t k = 0; k < N; k++)
+		{	acc += (A)coefs[k] * line[k];
 		}
-		delete[] inter_delay_lines;
+		return acc;
+	}
+};
+
+// The 64-bit products of the Q31 coefficients of 16 and 24-bit samples can't be vectorised
+// with the baseline instruction set, so they run the CPU's kernels with the constant length
+template<size_t N>
+struct FixedDot<int, int, llong, N>
+{	static inline llong run(const FIRKernels* k, const int* coefs, const int* line)
+	{	return k->dot_i32(coefs, line, N);
 	}
+};
+
+// Shape of a converter fixed at compile time, the coefficients are constant tables
+// and the convolutions have a constant length, so the compiler unrolls them
+template<typename T, size_t L_, size_t M_, size_t TAPS, FIRWindow W, int CUTOFF>
+struct FixedShape
+{	typedef typename SampleTraits<T>::delay_t delay_t;
+	typedef typename SampleTraits<T>::coef_t  coef_t;
+	typedef typename SampleTraits<T>::accum_t accum_t;
+	typedef FixedTables<coef_t, L_, M_, TAPS, W, CUTOFF> tables_t;
+
+	static const size_t L = L_;
+	static const size_t M = M_;
+	static const size_t taps = TAPS;
+	static const size_t inter_size = TAPS / L_;
+	static const size_t decim_size = TAPS;
+
+	static constexpr tables_t tables = tables_t();
 
-	if(decim_delay_lines != 0)
+	const FIRKernels* kernels;		// Kernels of the CPU, for the convolutions the compiler can't vectorise
+
+	FixedShape(const RateConverter &cnv) : kernels(cnv.kernels)
 	{
-		for (size_t i = 0; i < num_channels; i++)
-		{	delete[] decim_delay_lines[i];
-		}
-		delete[] decim_delay_lines;
 	}
 
-	if(inter_delay_idxs != 0) { delete[] inter_delay_idxs; }
-	if(inter_scales != 0)     { delete[] inter_scales; }
+	inline const coef_t* inter_row(size_t phase) const	{ return tables.inter_coefs + phase * inter_size; }
+	inline int shift() const							{ return tables.coef_shift; }
 
-	if(decim_delay_idxs != 0) { delete[] decim_delay_idxs; }
-	if(decim_fractions != 0)  { delete[] decim_fractions; }
-}
+	inline accum_t inter_dot(const coef_t* coefs, const delay_t* line) const
+	{	return FixedDot<coef_t, delay_t, accum_t, inter_size>::run(kernels, coefs, line);
+	}
+
+	inline accum_t decim_dot(const delay_t* line) const
+	{	return FixedDot<coef_t, delay_t, accum_t, decim_size>::run(kernels, tables.decim_coefs, line);
+	}
+};
+
+template<typename T, size_t L_, size_t M_, size_t TAPS, FIRWindow W, int CUTOFF>
+constexpr typename FixedShape<T, L_, M_, TAPS, W, CUTOFF>::tables_t FixedShape<T, L_, M_, TAPS, W, CUTOFF>::tables;
 
-// Decimation of n 8-Bit "samples" from src to dst in a wave with some "channels"
-int RateConverter::decimation(const uchar* src, uchar* dst, size_t channel, size_t samples)
+// Decimation of n "blocks" from src to dst, all channels in a single pass
+// The converter's state is kept in locals, as the destination may alias it
+template<typename T, typename Shape>
+static int resample_decimation(RateConverter &cnv, const Shape &shape, const T* src, T* dst, size_t blocks)
 {
-	llong tmpVal;
-	int m, n, count=0;
+	typedef SampleTraits<T> traits;
+	typedef typename traits::delay_t delay_t;
+
+	size_t decim_size = shape.decim_size;		// Size of the delay line
+	size_t line_size  = decim_size << 1;		// Distance between the mirrored delay lines of each channel
+	size_t channels   = cnv.num_channels;
+	size_t delay_idx  = cnv.decim_delay_idx;
+	size_t fraction   = cnv.decim_fraction;
 
-	size_t decim_fraction = decim_fractions[channel];
-	size_t decim_delay_idx = decim_delay_idxs[channel];
-	uchar* decim_delay_line = (uchar*)decim_delay_lines[channel];
+	typename traits::accum_t tmpVal;
+	int count=0;
 
-	src += channel;	// Ptr of next sample in the source (current channel)
-	dst += channel;	// Ptr of next sample in the destination (current channel)
+	delay_t* decim_delay_line;
 
-	for (size_t i = 0; i < samples; i++)
+	for (size_t i = 0; i < blocks; i++)
 	{
-		// Add one sample to the delay line
-		decim_delay_line[decim_delay_idx] = *src;
-		src += num_channels;
-		MODINC(decim_delay_idx, decim_filter.size);
-		MODINC(decim_fraction, M);
-
-		// If enough samples have been added from the source to the delay line, 
-		// derive one sample and add it to the destination pointer
-		if (decim_fraction == 0)
+		// Add one block to the delay lines of each channel
+		decim_delay_line = (delay_t*)cnv.decim_delay_lines;
+		for (size_t c = 0; c < channels; c++)
+		{	MIRROR(decim_delay_line, delay_idx, decim_size, traits::load(*src++));
+			decim_delay_line += line_size;
+		}
+
+		MODINC(delay_idx, decim_size);
+		MODINC(fraction, shape.M);
+
+		// If enough blocks have been added from the source to the delay lines,
+		// derive one block and add it to the destination pointer
+		if (fraction == 0)
 		{
-			tmpVal = 0;
-			m = decim_delay_idx;
-			n = decim_delay_idx;
-			MODDEC(n, decim_filter.size);
-
-			// Perform convolution between impulse response coefficients from the filter
-			// and the delay line sample values at the symmetric ends of the response
-			for (size_t k = 0; k < (decim_filter.size >> 1); k++)
+			decim_delay_line = (delay_t*)cnv.decim_delay_lines + delay_idx;
+			for (size_t c = 0; c < channels; c++)
 			{
-				tmpVal += decim_filter.coefs[k] * ((llong)decim_delay_line[m] + (llong)decim_delay_line[n]);
-				MODINC(m, decim_filter.size);
-				MODDEC(n, decim_filter.size);
-			}
+				// Perform convolution between impulse response coefficients from the filter
+				// and the contiguous window of the delay line starting from the oldest sample
+				tmpVal = shape.decim_dot(decim_delay_line);
 
-			// If the delay line in odd, the middle value is added separately
-			if (decim_filter.size & 1)
-			{
-				tmpVal += decim_filter.coefs[decim_filter.size >> 1] * decim_delay_line[n];
+				// The coefficients are normalised, so the accumulator only needs a rounding shift
+				*dst++ = traits::store(tmpVal, shape.shift());
+				decim_delay_line += line_size;
 			}
 
-			// Divide the accumulator with the scale of the filter
-			*dst = (uchar)(tmpVal /decim_scale);
-			dst += num_channels;
 			count++;
 		}
 	}
 
-	decim_fractions[channel]  = decim_fraction;
-	decim_delay_idxs[channel] = decim_delay_idx;
+	cnv.decim_delay_idx = delay_idx;
+	cnv.decim_fraction  = fraction;
+
 	return count;
 }
 
-// Interpolation of n 8-Bit "samples" from src to dst in a wave with some "channels"
-int RateConverter::interpolation(const uchar* src, uchar* dst, size_t channel, size_t samples)
+// Interpolation of n "blocks" from src to dst, all channels in a single pass
+template<typename T, typename Shape>
+static int resample_interpolation(RateConverter &cnv, const Shape &shape, const T* src, T* dst, size_t blocks)
 {
-	size_t delay_size = inter_filter.size / L;				// Size of the delay line adjusted for interpolation
-	size_t start_coef = ((inter_filter.size >> 1) + 1) % L;	// Coefficient index offset of the first sample
-	size_t coef_idx   = start_coef;							// Index offset of the coefficients to use
+	typedef SampleTraits<T> traits;
+	typedef typename traits::delay_t delay_t;
+	typedef typename traits::coef_t  coef_t;
 
-	llong  tmpVal;
-	int n, h, count=0;
+	size_t delay_size = shape.inter_size;					// Size of the delay line adjusted for interpolation
+	size_t line_size  = delay_size << 1;					// Distance between the mirrored delay lines of each channel
+	size_t channels   = cnv.num_channels;
+	size_t delay_idx  = cnv.inter_delay_idx;
 
-	size_t inter_delay_idx = inter_delay_idxs[channel];
-	uchar* inter_delay_line = (uchar*)inter_delay_lines[channel];
+	typename traits::accum_t tmpVal;
+	const coef_t* coefs;
+	int count=0;
 
-	src += channel;	// Ptr of next sample in the source (current channel)
-	dst += channel;	// Ptr of next sample in the destination (current channel)
+	delay_t* inter_delay_line;
 
-	for (size_t i = 0; i < samples; i++)
+	for (size_t i = 0; i < blocks; i++)
 	{
-		// Add next samples to the delay line
-		inter_delay_line[inter_delay_idx] = *(src);
-		src += num_channels;
-		MODINC(inter_delay_idx, delay_size);
+		// Add next block to the delay lines of each channel
+		inter_delay_line = (delay_t*)cnv.inter_delay_lines;
+		for (size_t c = 0; c < channels; c++)
+		{	MIRROR(inter_delay_line, delay_idx, delay_size, traits::load(*src++));
+			inter_delay_line += line_size;
+		}
+
+		MODINC(delay_idx, delay_size);
 
-		// Calculate L-1 and the real sample with a lowpass filter
-		for (size_t j = 0; j < L; j++)
+		// Calculate L-1 and the real block with a lowpass filter
+		// Later phases are closer to the newest sample, so they use lower coefficients
+		for (size_t j = 0; j < shape.L; j++)
 		{
-			tmpVal = 0;
-			n = inter_delay_idx;
-			h = coef_idx;
-
-			// Perform convolution between impulse response coefficients from the filter
-			// and the delay line sample values to interpolate the zero samples
-			// The coefficients are multiplied by the factor to add gain
-			for (size_t k = 0; k < delay_size; k++)
+			coefs = shape.inter_row(shape.L - 1 - j);
+			inter_delay_line = (delay_t*)cnv.inter_delay_lines + delay_idx;
+
+			for (size_t c = 0; c < channels; c++)
 			{
-				tmpVal += inter_filter.coefs[h] * inter_delay_line[n];
-				MODINC(n, delay_size);
-				h += L;
+				// Perform convolution between impulse response coefficients from the filter
+				// and the delay line sample values to interpolate the zero samples
+				tmpVal = shape.inter_dot(coefs, inter_delay_line);
+
+				// Add next sample from the accumulator to the destination
+				// The coefficients are normalised, so the accumulator only needs a rounding shift
+				*dst++ = traits::store(tmpVal, shape.shift());
+				inter_delay_line += line_size;
 			}
 
-			// Add next sample from the accumulator to the destination
-			// Divide the accumulator with the scale of the filter
-			*dst = (uchar)(tmpVal / inter_scales[coef_idx]);
-			dst += num_channels;
 			count++;
-			MODINC(coef_idx, L);
 		}
 	}
 
-	inter_delay_idxs[channel] = inter_delay_idx;
+	cnv.inter_delay_idx = delay_idx;
+
 	return count;
 }
 
-// Interpolation and Decimation of n 8-Bit "samples" from src to dst in a wave with some "channels"
-int RateConverter::non_integral(const uchar* src, uchar* dst, size_t channel, size_t samples)
+// Interpolation and Decimation of n "blocks" from src to dst, all channels in a single pass
+// Only the interpolated blocks that survive the decimation are calculated
+template<typename T, typename Shape>
+static int resample_non_integral(RateConverter &cnv, const Shape &shape, const T* src, T* dst, size_t blocks)
 {
-	size_t inter_size = inter_filter.size / L;				// Size of the delay line adjusted for interpolation
-	size_t start_coef = ((inter_filter.size >> 1) + 1) % L;	// Coefficient index offset of the first sample
-	size_t coef_idx = start_coef;							// Index offset of the coefficients to use
-
-	llong tmpVal;
-	int m, n, h, count=0;
+	typedef SampleTraits<T> traits;
+	typedef typename traits::delay_t delay_t;
+	typedef typename traits::coef_t  coef_t;
 
-	size_t decim_fraction = decim_fractions[channel];
-	size_t decim_delay_idx = decim_delay_idxs[channel];
-	uchar* decim_delay_line = (uchar*)decim_delay_lines[channel];
+	size_t delay_size = shape.inter_size;					// Size of the delay line adjusted for interpolation
+	size_t line_size  = delay_size << 1;					// Distance between the mirrored delay lines of each channel
+	size_t coef_idx;										// Index offset of the coefficients to use
+	size_t channels   = cnv.num_channels;
+	size_t delay_idx  = cnv.inter_delay_idx;
+	size_t phase      = cnv.inter_phase;
 
-	size_t inter_delay_idx = inter_delay_idxs[channel];
-	uchar* inter_delay_line = (uchar*)inter_delay_lines[channel];
+	typename traits::accum_t tmpVal;
+	const coef_t* coefs;
+	int count=0;
 
-	src += channel;	// Ptr of next sample in the source (current channel)
-	dst += channel;	// Ptr of next sample in the destination (current channel)
+	delay_t* inter_delay_line;
 
-	for (size_t i = 0;;)
+	for (size_t i = 0; i < blocks; i++)
 	{
-		// Calculate L-1 and the real sample with a lowpass filter
-		for (size_t j = decim_fraction; j < M; j++)
-		{
-			// Add new sample if the previous has been fully interpolated
-			if (coef_idx == start_coef)
-			{
-				// If the samples ended, quit the function
-				if (i == samples)
-				{	
-					decim_fractions[channel]  = decim_fraction;
-					decim_delay_idxs[channel] = decim_delay_idx;
-					inter_delay_idxs[channel] = inter_delay_idx;
-					return count;
-				}
+		// Add next block to the delay lines of each channel
+		inter_delay_line = (delay_t*)cnv.inter_delay_lines;
+		for (size_t c = 0; c < channels; c++)
+		{	MIRROR(inter_delay_line, delay_idx, delay_size, traits::load(*src++));
+			inter_delay_line += line_size;
+		}
 
-				inter_delay_line[inter_delay_idx] = *src;
-				MODINC(inter_delay_idx, inter_size);
-				src += num_channels;
-				i++;
-			}
+		MODINC(delay_idx, delay_size);
 
-			tmpVal = 0;
-			n = inter_delay_idx;
-			h = coef_idx;
+		// Out of the L interpolated blocks, only every M-th is kept, so the phase
+		// steps by M and the convolution is only performed for the kept blocks
+		for (; phase < shape.L; phase += shape.M)
+		{
+			// Later phases are closer to the newest sample, so they use lower coefficients
+			coef_idx = shape.L - 1 - phase;
+			coefs = shape.inter_row(coef_idx);
+			inter_delay_line = (delay_t*)cnv.inter_delay_lines + delay_idx;
 
-			// Perform convolution between impulse response coefficients from the filter
-			// and the delay line sample values to interpolate the zero samples
-			// The coefficients are multiplied by the factor to add gain
-			for (size_t k = 0; k < inter_size; k++)
+			for (size_t c = 0; c < channels; c++)
 			{
-				tmpVal += inter_filter.coefs[h] * inter_delay_line[n];
-				MODINC(n, inter_size);
-				h += L;
+				// Perform convolution between impulse response coefficients from the filter
+				// and the delay line sample values to interpolate the zero samples
+				tmpVal = shape.inter_dot(coefs, inter_delay_line);
+
+				// Add next sample from the accumulator to the destination
+				// The coefficients are normalised, so the accumulator only needs a rounding shift
+				*dst++ = traits::store(tmpVal, shape.shift());
+				inter_delay_line += line_size;
 			}
 
-			// Add next sample from the accumulator to the destination
-			// Divide the accumulator with the scale of the filter
-			decim_delay_line[decim_delay_idx] = (uchar)(tmpVal / inter_scales[coef_idx]);
-			MODINC(decim_delay_idx, decim_filter.size);
-			MODINC(decim_fraction, M);
-			MODINC(coef_idx, L);
+			count++;
 		}
 
-		tmpVal = 0;
-		m = decim_delay_idx;
-		n = decim_delay_idx;
-		MODDEC(n, decim_filter.size);
+		// The next input block starts L interpolated blocks later
+		phase -= shape.L;
+	}
 
-		// Perform convolution between impulse response coefficients from the filter
-		// and the delay line sample values at the symmetric ends of the response
-		for (size_t k = 0; k < (decim_filter.size >> 1); k++)
-		{
-			tmpVal += decim_filter.coefs[k] * ((llong)decim_delay_line[m] + (llong)decim_delay_line[n]);
-			MODINC(m, decim_filter.size);
-			MODDEC(n, decim_filter.size);
+	cnv.inter_delay_idx = delay_idx;
+	cnv.inter_phase     = phase;
+
+	return count;
+}
+
+// Half-band decimation by 2 of n "blocks" from src to dst, all channels in a single pass
+// Every other tap of the filter is zero apart from the centre one, so the first block of each pair
+// only meets the centre tap and is kept in a ring for it, the second one meets the other taps,
+// which are symmetric, so each output multiplies the sums of the k pairs of samples sharing a tap
+template<typename T>
+static int half_band_decimation(RateConverter &cnv, const T* src, T* dst, size_t blocks)
+{
+	typedef SampleTraits<T> traits;
+	typedef typename traits::delay_t delay_t;
+	typedef typename traits::coef_t  coef_t;
+
+	size_t delay_size = cnv.decim_size;			// Size of the pair delay lines
+	size_t pairs      = delay_size >> 1;		// Number of nonzero taps on each side of the centre
+	size_t line_size  = decim_stride(cnv);		// Distance between the delay lines of each channel
+	size_t channels   = cnv.num_channels;
+	size_t delay_idx  = cnv.decim_delay_idx;
+	size_t fraction   = cnv.decim_fraction;
+	size_t centre_idx;							// Index of the oldest sample in the centre rings
+
+	const coef_t* coefs = (const coef_t*)cnv.decim_coefs;
+	typename traits::accum_t tmpVal;
+	int count=0;
+
+	delay_t* delay_line;
+	delay_t* forward;							// Pair samples from the oldest one
+	delay_t* backward;							// Pair samples from the newest one
+	delay_t* centre;							// Ring of the samples meeting the centre tap
+
+	for (size_t i = 0; i < blocks; i++)
+	{
+		MODINC(fraction, 2);
+
+		// The centre rings advance with the pair delay lines, one block of each for every output
+		centre_idx = delay_idx >= pairs ? delay_idx - pairs : delay_idx;
+
+		// The first block of each pair only meets the centre tap
+		if (fraction != 0)
+		{	centre = (delay_t*)cnv.decim_delay_lines + (delay_size << 2);
+			for (size_t c = 0; c < channels; c++)
+			{	centre[centre_idx] = traits::load(*src++);
+				centre += line_size;
+			}
+
+			continue;
+		}
+
+		delay_line = (delay_t*)cnv.decim_delay_lines;
+		for (size_t c = 0; c < channels; c++)
+		{	delay_t sample = traits::load(*src++);
+			MIRROR(delay_line, delay_idx, delay_size, sample);
+			MIRROR(delay_line, (delay_size << 1) + delay_size - 1 - delay_idx, delay_size, sample);
+			delay_line += line_size;
 		}
 
-		// If the delay line in odd, the middle value is added separately
-		if (decim_filter.size & 1)
+		MODINC(delay_idx, delay_size);
+		centre_idx = delay_idx >= pairs ? delay_idx - pairs : delay_idx;
+
+		forward  = (delay_t*)cnv.decim_delay_lines + delay_idx + pairs;
+		backward = (delay_t*)cnv.decim_delay_lines + (delay_size << 1) + (delay_idx == 0 ? 0 : delay_size - delay_idx) + pairs;
+		centre   = (delay_t*)cnv.decim_delay_lines + (delay_size << 2) + centre_idx;
+		for (size_t c = 0; c < channels; c++)
 		{
-			tmpVal += decim_filter.coefs[decim_filter.size >> 1] * decim_delay_line[n];
+			// The pairs start on each side of the centre and move away from it
+			tmpVal  = pair_dot(cnv.kernels, coefs, backward, forward, pairs);
+			tmpVal += (typename traits::accum_t)coefs[pairs] * *centre;
+
+			*dst++ = traits::store(tmpVal, cnv.coef_shift);
+			forward  += line_size;
+			backward += line_size;
+			centre   += line_size;
 		}
 
-		// Divide the accumulator with the scale of the filter
-		*dst = (uchar)(tmpVal  / decim_scale);
-		dst += num_channels;
 		count++;
 	}
 
-	return 0;
-}
+	cnv.decim_delay_idx = delay_idx;
+	cnv.decim_fraction  = fraction;
 
+	return count;
+}
 
-// Decimation of n 16-Bit "samples" from src to dst in a wave with some "channels"
-int RateConverter::decimation(const short* src, short* dst, size_t channel, size_t samples)
+// Half-band interpolation by 2 of n "blocks" from src to dst, all channels in a single pass
+// The first interpolated block only meets the centre tap, which is one, so it is the sample in the
+// middle of the delay lines, the second one falls between two samples and meets the other taps,
+// which are symmetric, so it multiplies the sums of the k pairs of samples sharing a tap
+template<typename T>
+static int half_band_interpolation(RateConverter &cnv, const T* src, T* dst, size_t blocks)
 {
-	llong tmpVal;
-	int m, n, count=0;
+	typedef SampleTraits<T> traits;
+	typedef typename traits::delay_t delay_t;
+	typedef typename traits::coef_t  coef_t;
+
+	size_t delay_size = cnv.inter_size;			// Size of the pair delay lines
+	size_t pairs      = delay_size >> 1;		// Number of nonzero taps on each side of the centre
+	size_t line_size  = inter_stride(cnv);		// Distance between the delay lines of each channel
+	size_t channels   = cnv.num_channels;
+	size_t delay_idx  = cnv.inter_delay_idx;
 
-	size_t decim_fraction = decim_fractions[channel];
-	size_t decim_delay_idx = decim_delay_idxs[channel];
-	short* decim_delay_line = (short*)decim_delay_lines[channel];
+	const coef_t* coefs = (const coef_t*)cnv.inter_coefs;
+	int count=0;
 
-	src += channel;	// Ptr of next sample in the source (current channel)
-	dst += channel;	// Ptr of next sample in the destination (current channel)
+	delay_t* delay_line;
+	delay_t* forward;							// Pair samples from the oldest one
+	delay_t* backward;							// Pair samples from the newest one
 
-	for (size_t i = 0; i < samples; i++)
+	for (size_t i = 0; i < blocks; i++)
 	{
-		// Add one sample to the delay line
-		decim_delay_line[decim_delay_idx] = *src;
-		src += num_channels;
-		MODINC(decim_delay_idx, decim_filter.size);
-		MODINC(decim_fraction, M);
-
-		// If enough samples have been added from the source to the delay line, 
-		// derive one sample and add it to the destination pointer
-		if (decim_fraction == 0)
+		// Add next block to the delay lines of each channel, in both directions
+		delay_line = (delay_t*)cnv.inter_delay_lines;
+		for (size_t c = 0; c < channels; c++)
+		{	delay_t sample = traits::load(*src++);
+			MIRROR(delay_line, delay_idx, delay_size, sample);
+			MIRROR(delay_line, (delay_size << 1) + delay_size - 1 - delay_idx, delay_size, sample);
+			delay_line += line_size;
+		}
+
+		MODINC(delay_idx, delay_size);
+
+		// The sample before the middle of the delay lines is stored back as it was
+		backward = (delay_t*)cnv.inter_delay_lines + (delay_size << 1) + (delay_idx == 0 ? 0 : delay_size - delay_idx) + pairs;
+		for (size_t c = 0; c < channels; c++)
+		{	*dst++ = traits::store((typename traits::accum_t)coefs[pairs] * *backward, cnv.coef_shift);
+			backward += line_size;
+		}
+
+		forward  = (delay_t*)cnv.inter_delay_lines + delay_idx + pairs;
+		backward = (delay_t*)cnv.inter_delay_lines + (delay_size << 1) + (delay_idx == 0 ? 0 : delay_size - delay_idx) + pairs;
+		for (size_t c = 0; c < channels; c++)
+		{	*dst++ = traits::store(pair_dot(cnv.kernels, coefs, backward, forward, pairs), cnv.coef_shift);
+			forward  += line_size;
+			backward += line_size;
+		}
+
+		count += 2;
+	}
+
+	cnv.inter_delay_idx = delay_idx;
+
+	return count;
+}
+
+// Integer interpolation or decimation of n "blocks" from src to dst through overlap-save convolutions
+// Each chunk of blocks follows the last samples of the delay lines in a transform, with a pair of channels
+// in its real and imaginary parts, and is convolved with every limb of a row, whose rounded sums are exactly
+// the accumulators of the direct path. The delay lines are then refreshed with the chunk as usual
+template<typename T>
+static int fft_convert(RateConverter &cnv, const T* src, T* dst, size_t blocks)
+{
+	typedef SampleTraits<T> traits;
+	typedef typename traits::delay_t delay_t;
+	typedef typename traits::accum_t accum_t;
+	typedef typename traits::coef_t  coef_t;
+
+	const RateTables* t = cnv.tables;
+	bool interpolate  = cnv.L > 1;
+	size_t rows       = interpolate ? cnv.L : 1;							// Rows of coefficients, one for each output of a block
+	size_t delay_size = interpolate ? cnv.inter_size : cnv.decim_size;	// Size of the delay line, and taps of each row
+	size_t line_size  = delay_size << 1;								// Distance between the mirrored delay lines of each channel
+	size_t points     = t->fft.size;
+	size_t step       = points - delay_size + 1;						// Blocks of the chunk each transform takes
+	size_t channels   = cnv.num_channels;
+	size_t M          = cnv.M;
+	int limbs         = t->fft_limbs;
+
+	size_t transform_cost = fft_chunk_cost<coef_t>(points, rows);
+
+	delay_t* delay_lines = (delay_t*)(interpolate ? cnv.inter_delay_lines : cnv.decim_delay_lines);
+	size_t delay_idx  = interpolate ? cnv.inter_delay_idx : cnv.decim_delay_idx;
+	size_t fraction   = interpolate ? 0 : cnv.decim_fraction;
+
+	double* input  = cnv.fft_buffer;							// Transform of the chunk of a pair of channels
+	double* output = input + (points << 1);						// Convolution of the chunk with a limb of a row
+	llong*  sums   = (llong*)(output + (points << 1));			// Sums of the limbs of each output of the pair
+
+	int count=0;
+
+	while (blocks > 0)
+	{
+		size_t chunk = blocks < step ? blocks : step;
+
+		// Decimation only outputs a block for each M blocks added to the delay lines
+		size_t first   = interpolate ? 0 : M - 1 - fraction;
+		size_t outputs = first < chunk ? (chunk - 1 - first) / M + 1 : 0;
+
+		// The transforms cost the same whatever the length of the chunk,
+		// so short chunks are left to the direct convolutions
+		if (2 * outputs * rows * delay_size < transform_cost)
+		{	break;
+		}
+
+		for (size_t c = 0; c < channels; c += 2)
 		{
-			tmpVal = 0;
-			m = decim_delay_idx;
-			n = decim_delay_idx;
-			MODDEC(n, decim_filter.size);
-
-			// Perform convolution between impulse response coefficients from the filter
-			// and the delay line sample values at the symmetric ends of the response
-			for (size_t k = 0; k < (decim_filter.size >> 1); k++)
-			{
-				tmpVal += decim_filter.coefs[k] * ((llong)decim_delay_line[m] + (llong)decim_delay_line[n]);
-				MODINC(m, decim_filter.size);
-				MODDEC(n, decim_filter.size);
+			bool pair = c + 1 < channels;
+			const delay_t* history = delay_lines + c * line_size + delay_idx + 1;
+
+			// The last delay_size-1 samples of the delay lines come before the chunk
+			for (size_t k = 0; k < delay_size - 1; k++)
+			{	input[2 * k]     = history[k];
+				input[2 * k + 1] = pair ? history[line_size + k] : 0;
+			}
+
+			const T* in = src + c;
+			for (size_t k = delay_size - 1; k < delay_size - 1 + chunk; k++)
+			{	input[2 * k]     = traits::load(in[0]);
+				input[2 * k + 1] = pair ? traits::load(in[1]) : 0;
+				in += channels;
 			}
 
-			// If the delay line in odd, the middle value is added separately
-			if (decim_filter.size & 1)
+			memset(input + 2 * (delay_size - 1 + chunk), 0, (step - chunk) * 2 * sizeof(double));
+			t->fft.forward(input);
+
+			for (size_t j = 0; j < rows; j++)
 			{
-				tmpVal += decim_filter.coefs[decim_filter.size >> 1] * decim_delay_line[n];
+				// Later phases are closer to the newest sample, so they use lower coefficients
+				const double* spectra = t->fft_spectra + (rows - 1 - j) * limbs * (points << 1);
+
+				for (int p = 0; p < limbs; p++)
+				{
+					const double* h = spectra + p * (points << 1);
+					for (size_t k = 0; k < points << 1; k += 2)
+					{	output[k]     = input[k] * h[k] - input[k + 1] * h[k + 1];
+						output[k + 1] = input[k] * h[k + 1] + input[k + 1] * h[k];
+					}
+					t->fft.inverse(output);
+
+					// The real parts are the convolutions of the first channel and the imaginary parts the ones of the second
+					// Outputs before delay_size-1 wrapped around the transform and are discarded
+					const double* valid = output + 2 * (delay_size - 1 + first);
+					llong weight = 1ll << (p * FFT_LIMB_BITS);
+					for (size_t o = 0; o < outputs; o++)
+					{	sums[2 * o]     = (p == 0 ? 0 : sums[2 * o])     + round_nearest(valid[0]) * weight;
+						sums[2 * o + 1] = (p == 0 ? 0 : sums[2 * o + 1]) + round_nearest(valid[1]) * weight;
+						valid += 2 * M;
+					}
+				}
+
+				// The sums are the accumulators of the direct path, so they only need the same rounding shift
+				T* out = dst + (count + j) * channels + c;
+				for (size_t o = 0; o < outputs; o++)
+				{	out[0] = traits::store((accum_t)sums[2 * o], cnv.coef_shift);
+					if (pair)
+					{	out[1] = traits::store((accum_t)sums[2 * o + 1], cnv.coef_shift);
+					}
+					out += rows * channels;
+				}
 			}
+		}
 
-			// Divide the accumulator with the scale of the filter
-			*dst = (short)(tmpVal / decim_scale);
-			dst += num_channels;
-			count++;
+		// Add the chunk to the delay lines of each channel
+		for (size_t i = 0; i < chunk; i++)
+		{	delay_t* delay_line = delay_lines;
+			for (size_t c = 0; c < channels; c++)
+			{	MIRROR(delay_line, delay_idx, delay_size, traits::load(*src++));
+				delay_line += line_size;
+			}
+
+			MODINC(delay_idx, delay_size);
 		}
+
+		fraction = (fraction + chunk) % M;
+		count += (int)(outputs * rows);
+		blocks -= chunk;
+	}
+
+	if (interpolate)
+	{	cnv.inter_delay_idx = delay_idx;
+	}
+	else
+	{	cnv.decim_delay_idx = delay_idx;
+		cnv.decim_fraction  = fraction;
+	}
+
+	if (blocks > 0)
+	{	count += interpolate ? resample_interpolation(cnv, RuntimeShape<T>(cnv), src, dst + count * channels, blocks)
+		                     : resample_decimation(cnv, RuntimeShape<T>(cnv), src, dst + count * channels, blocks);
 	}
 
-	decim_fractions[channel]  = decim_fraction;
-	decim_delay_idxs[channel] = decim_delay_idx;
 	return count;
 }
 
-// Interpolation of n 16-Bit "samples" from src to dst in a wave with some "channels"
-int RateConverter::interpolation(const short* src, short* dst, size_t channel, size_t samples)
+// Decimation of n "blocks" from src to dst, all channels in a single pass
+template<typename T>
+int RateConverter::decimation(const T* src, T* dst, size_t blocks)
 {
-	size_t delay_size = inter_filter.size / L;				// Size of the delay line adjusted for interpolation
-	size_t start_coef = ((inter_filter.size >> 1) + 1) % L;	// Coefficient index offset of the first sample
-	size_t coef_idx   = start_coef;							// Index offset of the coefficients to use
+	if(half_band)
+	{	return half_band_decimation(*this, src, dst, blocks);
+	}
+
+	if(fft_buffer != NULL)
+	{	return fft_convert(*this, src, dst, blocks);
+	}
+
+	return resample_decimation(*this, RuntimeShape<T>(*this), src, dst, blocks);
+}
 
-	llong  tmpVal;
-	int n, h, count=0;
+// Interpolation of n "blocks" from src to dst, all channels in a single pass
+template<typename T>
+int RateConverter::interpolation(const T* src, T* dst, size_t blocks)
+{
+	if(half_band)
+	{	return half_band_interpolation(*this, src, dst, blocks);
+	}
 
-	size_t inter_delay_idx = inter_delay_idxs[channel];
-	short* inter_delay_line = (short*)inter_delay_lines[channel];
+	if(fft_buffer != NULL)
+	{	return fft_convert(*this, src, dst, blocks);
+	}
 
-	src += channel;	// Ptr of next sample in the source (current channel)
-	dst += channel;	// Ptr of next sample in the destination (current channel)
+	return resample_interpolation(*this, RuntimeShape<T>(*this), src, dst, blocks);
+}
 
-	for (size_t i = 0; i < samples; i++)
-	{
-		// Add next samples to the delay line
-		inter_delay_line[inter_delay_idx] = *(src);
-		src += num_channels;
-		MODINC(inter_delay_idx, delay_size);
+// Interpolation and Decimation of n "blocks" from src to dst, all channels in a single pass
+// Only the interpolated blocks that survive the decimation are calculated
+template<typename T>
+int RateConverter::non_integral(const T* src, T* dst, size_t blocks)
+{
+	return resample_non_integral(*this, RuntimeShape<T>(*this), src, dst, blocks);
+}
 
-		// Calculate L-1 and the real sample with a lowpass filter
-		for (size_t j = 0; j < L; j++)
-		{
-			tmpVal = 0;
-			n = inter_delay_idx;
-			h = coef_idx;
-
-			// Perform convolution between impulse response coefficients from the filter
-			// and the delay line sample values to interpolate the zero samples
-			// The coefficients are multiplied by the factor to add gain
-			for (size_t k = 0; k < delay_size; k++)
-			{
-				tmpVal += inter_filter.coefs[h] * inter_delay_line[n];
-				MODINC(n, delay_size);
-				h += L;
-			}
+// Advances the phase of the conversion by n "blocks" without converting them
+// The delay lines are left as they are, until new blocks refresh them
+// Returns the number of blocks the conversion would have output
+size_t RateConverter::skip(size_t blocks)
+{
+	size_t count = 0;
 
-			// Add next sample from the accumulator to the destination
-			// Divide the accumulator with the scale of the filter
-			*dst = (short)(tmpVal / inter_scales[coef_idx]);
-			dst += num_channels;
-			count++;
-			MODINC(coef_idx, L);
+	if(L > 1 && M > 1)
+	{	for (size_t i = 0; i < blocks; i++)
+		{	for (; inter_phase < L; inter_phase += M)
+			{	count++;
+			}
+			inter_phase -= L;
+		}
+	}
+	else if(L > 1)
+	{	count = blocks * L;
+	}
+	else if(M > 1)
+	{	for (size_t i = 0; i < blocks; i++)
+		{	MODINC(decim_fraction, M);
+			if(decim_fraction == 0)
+			{	count++;
+			}
 		}
 	}
 
-	inter_delay_idxs[channel] = inter_delay_idx;
 	return count;
 }
 
-// Interpolation and Decimation of n 16-Bit "samples" from src to dst in a wave with some "channels"
-int RateConverter::non_integral(const short* src, short* dst, size_t channel, size_t samples)
+// Conversion of n "blocks" with the factors, taps, window and cutoff of the converter fixed at compile time
+// Only the path of the factors is instantiated, the tables only hold the filter it convolves
+template<typename T, size_t L, size_t M, size_t TAPS, FIRWindow W, int CUTOFF>
+static int fixed_convert(RateConverter &cnv, const void* src, void* dst, size_t blocks)
 {
- 
-	size_t inter_size = inter_filter.size / L;				// Size of the delay line adjusted for interpolation
-	size_t start_coef = ((inter_filter.size >> 1) + 1) % L;	// Coefficient index offset of the first sample
-	size_t coef_idx = start_coef;							// Index offset of the coefficients to use
+	FixedShape<T, L, M, TAPS, W, CUTOFF> shape(cnv);
 
-	llong tmpVal;
-	int m, n, h, count=0;
+	if constexpr(L > 1 && M > 1)
+	{	return resample_non_integral(cnv, shape, (const T*)src, (T*)dst, blocks);
+	}
+	else if constexpr(L > 1)
+	{	return resample_interpolation(cnv, shape, (const T*)src, (T*)dst, blocks);
+	}
+	else
+	{	return resample_decimation(cnv, shape, (const T*)src, (T*)dst, blocks);
+	}
+}
 
-	size_t decim_fraction = decim_fractions[channel];
-	size_t decim_delay_idx = decim_delay_idxs[channel];
-	short* decim_delay_line = (short*)decim_delay_lines[channel];
+// Specialised kernels of one converter step, for each sample type
+struct FixedStep
+{	size_t L, M, taps;
+	FIRWindow window;
+	int cutoff;
+	fixed_rate_fn kernels[_Unsupported];
+};
+
+#define FIXED_STEP(L, M, TAPS, W, C) { L, M, TAPS, W, C, { \
+	fixed_convert<uchar, L, M, TAPS, W, C>, fixed_convert<short, L, M, TAPS, W, C>, fixed_convert<int24, L, M, TAPS, W, C>, \
+	fixed_convert<int, L, M, TAPS, W, C>,   fixed_convert<float, L, M, TAPS, W, C> } }
+
+// Float decimations convolve their whole filter for each output, which the SIMD kernels of the generic path do faster
+#define FIXED_DECIMATION(M, TAPS, W, C) { 1, M, TAPS, W, C, { \
+	fixed_convert<uchar, 1, M, TAPS, W, C>, fixed_convert<short, 1, M, TAPS, W, C>, fixed_convert<int24, 1, M, TAPS, W, C>, \
+	fixed_convert<int, 1, M, TAPS, W, C>,   NULL } }
+
+// Steps FormatConverter plans for the most common conversions in the Standard tier, its factor 2
+// steps are half-band stages, 48k -> 44.1k is a decimation between close rates, cut off at 900
+static const FixedStep fixed_steps[] = {
+	FIXED_STEP(3, 1, 85, Window_Blackman, 1000),												// 16k -> 48k
+	FIXED_STEP(6, 1, 169, Window_Blackman, 1000),												// 8k -> 48k
+	FIXED_DECIMATION(3, 85, Window_Blackman, 1000),												// 48k -> 16k
+	FIXED_STEP(160, 147, 4481, Window_Blackman, 1000),											// 44.1k -> 48k
+	FIXED_STEP(147, 160, 7521, Window_Blackman, 900),											// 48k -> 44.1k
+};
+
+// Finds a kernel specialised at compile time for the factors, taps, window, cutoff and sample type of a converter
+// Returns NULL if there is none, so the converter runs the generic path
+fixed_rate_fn find_fixed_kernel(size_t L, size_t M, size_t taps, FIRWindow window, int cutoff, SampleType type)
+{
+	if(type >= _Unsupported)
+	{	return NULL;
+	}
 
-	size_t inter_delay_idx = inter_delay_idxs[channel];
-	short* inter_delay_line = (short*)inter_delay_lines[channel];
+	for(size_t i = 0; i < sizeof(fixed_steps) / sizeof(FixedStep); i++)
+	{	if(fixed_steps[i].L == L && fixed_steps[i].M == M && fixed_steps[i].taps == taps && fixed_steps[i].window == window &&
+		   fixed_steps[i].cutoff == cutoff)
+		{	return fixed_steps[i].kernels[type];
+		}
+	}
+
+	return NULL;
+}
 
-	src += channel;	// Ptr of next sample in the source (current channel)
-	dst += channel;	// Ptr of next sample in the destination (current channel)
+#define SINC_PHASE_BITS 8								// Bits of the position selecting the phase of the table
+#define SINC_PHASES     (1 << SINC_PHASE_BITS)			// Number of phases of the table
+#define SINC_FRAC_BITS  (32 - SINC_PHASE_BITS)			// Bits of the position interpolating between two phases
+#define SINC_ONE        (1ll << 32)						// One input block in the 32.32 fixed-point positions
+#define SINC_ROLLOFF    0.9								// Cutoff of the table relative to the lowest Nyquist frequency
+
+// Modified Bessel function of the first kind and order zero, for the Kaiser window
+static double bessel_i0(double x)
+{
+	double term = 1, sum = 1;
+	for(int k = 1; k < 50 && term > sum * 1e-17; k++)
+	{	term *= (x / (2 * k)) * (x / (2 * k));
+		sum  += term;
+	}
+
+	return sum;
+}
+
+// Cutoff of the table for a ratio, below the Nyquist frequency of the lower rate
+static inline double sinc_cutoff(double ratio)
+{
+	return SINC_ROLLOFF * (ratio < 1 ? ratio : 1);
+}
 
-	for (size_t i = 0;;)
+// Coefficients on each side of the centre of the sinc for a cutoff
+// Lower cutoffs widen the sinc, the taps grow so the window keeps the same zero crossings
+static inline size_t sinc_half_taps(double cutoff, size_t zero_crossings)
+{
+	return (size_t)ceil(zero_crossings * SINC_ROLLOFF / cutoff);
+}
+
+SincResampler::SincResampler() :
+	table(0), delay_lines(0)
+{
+}
+
+SincResampler::SincResampler(double ratio, size_t channels, SampleType type) :
+	table(0), delay_lines(0)
+{
+	init(ratio, channels, type);
+}
+
+SincResampler::~SincResampler()
+{
+	clear();
+}
+
+// Initializes the table and delay lines for a ratio of output over input sampling rates
+void SincResampler::init(double ratio, size_t channels, SampleType type, size_t zero_crossings, double beta)
+{
+	clear();
+
+	this->num_channels   = channels;
+	this->sample_type    = type;
+	this->zero_crossings = zero_crossings;
+	this->beta           = beta;
+
+	taps      = 0;
+	delay_idx = 0;
+	position  = 0;
+
+	// Select the fastest convolution kernels the CPU supports
+	kernels = get_fir_kernels();
+
+	this->ratio = ratio;
+	step = (llong)(SINC_ONE / ratio + 0.5);
+	design(sinc_cutoff(ratio), sinc_half_taps(sinc_cutoff(ratio), zero_crossings));
+}
+
+// Deallocates all dynamic resources
+void SincResampler::clear()
+{
+	if(table != 0)       { delete[] table; }
+	if(delay_lines != 0) { delete[] delay_lines; }
+
+	table = 0;
+	delay_lines = 0;
+}
+
+// Silences the delay lines and brings the position back to its start, the table is kept
+void SincResampler::reset()
+{
+	for(size_t i = 0; i < taps * 2 * num_channels; i++)
+	{	delay_lines[i] = 0;
+	}
+
+	delay_idx = 0;
+	position  = 0;
+}
+
+// Designs the table for a cutoff with "half" coefficients on each side of its centre,
+// and resizes the delay lines to its taps, keeping the newest samples
+void SincResampler::design(double cutoff, size_t half)
+{
+	const double pi = 3.14159265358979323846;
+
+	size_t size = half << 1;
+
+	if(table != 0)
+	{	delete[] table;
+	}
+
+	this->cutoff = cutoff;
+	table = new float[(SINC_PHASES + 1) * size];
+
+	// Phase p interpolates the point p/SINC_PHASES of a block after the centre of the delay line,
+	// the extra phase is the next block's first one, so neighbouring phases can always be interpolated
+	double* row = new double[size];
+	double  window_scale = 1 / bessel_i0(beta);
+
+	for(size_t p = 0; p <= SINC_PHASES; p++)
 	{
-		// Calculate L-1 and the real sample with a lowpass filter
-		for (size_t j = decim_fraction; j < M; j++)
+		double sum = 0;
+		for(size_t j = 0; j < size; j++)
 		{
-			// Add new sample if the previous has been fully interpolated
-			if (coef_idx == start_coef)
-			{
-				// If the samples ended, quit the function
-				if (i == samples)
-				{	
-					decim_fractions[channel]  = decim_fraction;
-					decim_delay_idxs[channel] = decim_delay_idx;
-					inter_delay_idxs[channel] = inter_delay_idx;
-					
-					return count;
-				}
+			double x = (double)j - (double)(half - 1) - (double)p / SINC_PHASES;
+			double t = x / half;
+			double w = t <= -1 || t >= 1 ? 0 : bessel_i0(beta * sqrt(1 - t * t)) * window_scale;
 
-				inter_delay_line[inter_delay_idx] = *src;
-				MODINC(inter_delay_idx, inter_size);
-				src += num_channels;
-				i++;
-			}
+			row[j] = (x == 0 ? cutoff : sin(pi * cutoff * x) / (pi * x)) * w;
+			sum += row[j];
+		}
 
-			tmpVal = 0;
-			n = inter_delay_idx;
-			h = coef_idx;
+		for(size_t j = 0; j < size; j++)
+		{	table[p * size + j] = (float)(row[j] / sum);
+		}
+	}
 
-			// Perform convolution between impulse response coefficients from the filter
-			// and the delay line sample values to interpolate the zero samples
-			// The coefficients are multiplied by the factor to add gain
-			for (size_t k = 0; k < inter_size; k++)
-			{
-				tmpVal += inter_filter.coefs[h] * inter_delay_line[n];
-				MODINC(n, inter_size);
-				h += L;
+	delete[] row;
+
+	// Delay lines are mirrored, so the convolution window never wraps around
+	// The newest samples of the previous lines are kept, aligned to the newest end
+	float* lines = new float[size * 2 * num_channels];
+	for(size_t c = 0; c < num_channels; c++)
+	{
+		float* line = lines + c * size * 2;
+		for(size_t i = 0; i < size; i++)
+		{
+			size_t back = size - i;
+			float  v    = 0;
+			if(delay_lines != 0 && back <= taps)
+			{	v = delay_lines[c * taps * 2 + delay_idx + taps - back];
 			}
+			MIRROR(line, i, size, v);
+		}
+	}
+
+	if(delay_lines != 0)
+	{	delete[] delay_lines;
+	}
+
+	// The centre moves away from the newest sample as the taps grow, the position
+	// moves with it so the next output block keeps its place in the input
+	if(taps != 0)
+	{	position += (llong)(half - (taps >> 1)) * SINC_ONE;
+	}
+
+	delay_lines = lines;
+	delay_idx   = 0;
+	taps        = size;
+}
+
+// Changes the ratio between two conversions, the table is only designed again
+// when the cutoff must drop below the current one or rise far above it
+// The taps only grow, so the outputs stay continuous across the changes
+void SincResampler::set_ratio(double ratio)
+{
+	double wanted = sinc_cutoff(ratio);
+	size_t half   = sinc_half_taps(wanted, zero_crossings);
+
+	this->ratio = ratio;
+	step = (llong)(SINC_ONE / ratio + 0.5);
+
+	if(wanted < cutoff || wanted > cutoff * 1.05)
+	{	design(wanted, half > (taps >> 1) ? half : taps >> 1);
+	}
+}
+
+// Largest number of blocks output for n input "blocks"
+size_t SincResampler::max_output(size_t blocks) const
+{
+	return max_output(ratio, blocks);
+}
+
+// Largest number of blocks output for n input "blocks" by a resampler of a ratio
+size_t SincResampler::max_output(double ratio, size_t blocks)
+{
+	return (size_t)(blocks * ratio) + 2;
+}
+
+// Number of coefficients of each phase of the table designed for a ratio
+size_t SincResampler::phase_taps(double ratio, size_t zero_crossings)
+{
+	return sinc_half_taps(sinc_cutoff(ratio), zero_crossings) << 1;
+}
+
+// Advances the position of the resampler by n "blocks" without converting them
+// The delay lines are left as they are, until new blocks refresh them
+// Returns the number of blocks the resampler would have output
+size_t SincResampler::skip(size_t blocks)
+{
+	size_t count = 0;
 
-			// Add next sample from the accumulator to the destination
-			// Divide the accumulator with the scale of the filter
-			decim_delay_line[decim_delay_idx] = (short)(tmpVal / inter_scales[coef_idx]);
-			MODINC(decim_delay_idx, decim_filter.size);
-			MODINC(decim_fraction, M);
-			MODINC(coef_idx, L);
+	for (size_t i = 0; i < blocks; i++)
+	{	for (; position < SINC_ONE; position += step)
+		{	count++;
 		}
+		position -= SINC_ONE;
+	}
+
+	return count;
+}
 
-		tmpVal = 0;
-		m = decim_delay_idx;
-		n = decim_delay_idx;
-		MODDEC(n, decim_filter.size);
+// Resampling of n "blocks" from src to dst, all channels in a single pass
+template<typename T>
+int SincResampler::process(const T* src, T* dst, size_t blocks)
+{
+	typedef SampleTraits<T> traits;
 
-		// Perform convolution between impulse response coefficients from the filter
-		// and the delay line sample values at the symmetric ends of the response
-		for (size_t k = 0; k < (decim_filter.size >> 1); k++)
-		{
-			tmpVal += decim_filter.coefs[k] * ((llong)decim_delay_line[m] + (llong)decim_delay_line[n]);
-			MODINC(m, decim_filter.size);
-			MODDEC(n, decim_filter.size);
+	size_t line_size = taps << 1;
+	const float* coefs;
+	float* line;
+	float  frac, lower, upper;
+	int count = 0;
+
+	for (size_t i = 0; i < blocks; i++)
+	{
+		// Add next block to the delay lines of each channel
+		line = delay_lines;
+		for (size_t c = 0; c < num_channels; c++)
+		{	MIRROR(line, delay_idx, taps, traits::to_float(*src++));
+			line += line_size;
 		}
 
-		// If the delay line in odd, the middle value is added separately
-		if (decim_filter.size & 1)
+		MODINC(delay_idx, taps);
+
+		// Output every block that falls before the next input block
+		for (; position < SINC_ONE; position += step)
 		{
-			tmpVal += decim_filter.coefs[decim_filter.size >> 1] * decim_delay_line[n];
-		}
+			coefs = table + (position >> SINC_FRAC_BITS) * taps;
+			frac  = (float)(position & ((1 << SINC_FRAC_BITS) - 1)) * (1.0f / (1 << SINC_FRAC_BITS));
+			line  = delay_lines + delay_idx;
 
+			for (size_t c = 0; c < num_channels; c++)
+			{
+				// Convolve with the two nearest phases and interpolate linearly between them
+				lower = kernels->dot_f32(coefs, line, taps);
+				upper = kernels->dot_f32(coefs + taps, line, taps);
 
-		// Divide the accumulator with the scale of the filter
-		*dst = (short)(tmpVal / decim_scale);
-		dst += num_channels;
-		count++;
+				*dst++ = traits::from_float(lower + (upper - lower) * frac);
+				line += line_size;
+			}
+
+			count++;
+		}
+
+		position -= SINC_ONE;
 	}
 
-	return 0;
-}
\ No newline at end of file
+	return count;
+}
+
+// Instantiate the converters for every supported sample type
+#define INSTANTIATE_CONVERTERS(T) \
+	template void RateConverter::init_delay_lines<T>(); \
+	template int RateConverter::decimation<T>(const T* src, T* dst, size_t blocks); \
+	template int RateConverter::interpolation<T>(const T* src, T* dst, size_t blocks); \
+	template int RateConverter::non_integral<T>(const T* src, T* dst, size_t blocks); \
+	template int SincResampler::process<T>(const T* src, T* dst, size_t blocks);
+
+INSTANTIATE_CONVERTERS(uchar)
+INSTANTIATE_CONVERTERS(short)
+INSTANTIATE_CONVERTERS(int24)
+INSTANTIATE_CONVERTERS(int)
+INSTANTIATE_CONVERTERS(float)
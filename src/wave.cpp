@@ -3,7 +3,8 @@
 
 bool operator==(const WaveFmt &a, const WaveFmt &b)
 {
-    return  a.numChannels   == b.numChannels   &&
+    return  a.audioFormat   == b.audioFormat   &&
+		    a.numChannels   == b.numChannels   &&
 		    a.bitsPerSample == b.bitsPerSample &&
 		    a.sampleRate    == b.sampleRate;
 }
@@ -13,10 +14,10 @@ bool operator!=(const WaveFmt &a, const WaveFmt &b)
     return  !(a == b);
 }
 
-WaveFmt makeWaveFmt(short numChannels, short bitsPerSample, long sampleRate)
+WaveFmt makeWaveFmt(short numChannels, short bitsPerSample, long sampleRate, short audioFormat)
 {
     WaveFmt fmt;
-    fmt.audioFormat   = 1;
+    fmt.audioFormat   = audioFormat;
     fmt.numChannels   = numChannels;
     fmt.bitsPerSample = bitsPerSample;
     fmt.sampleRate    = sampleRate;
@@ -26,6 +27,23 @@ WaveFmt makeWaveFmt(short numChannels, short bitsPerSample, long sampleRate)
     return fmt;
 }
 
+// Finds the type of the samples in a wave from its format and bit depth
+SampleType getSampleType(const WaveFmt &fmt)
+{
+    if(fmt.audioFormat == _IEEEFloat)
+    {   return fmt.bitsPerSample == 32 ? _Float : _Unsupported;
+    }
+
+    switch(fmt.bitsPerSample)
+    {   case 8:  return _UInt8;
+        case 16: return _Int16;
+        case 24: return _Int24;
+        case 32: return _Int32;
+    }
+
+    return _Unsupported;
+}
+
 bool isCorrectHeader(WAVEHeader &hdr)
 {
     if(memcmp(hdr.chunkID, "RIFF", 4) == 0)
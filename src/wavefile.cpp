@@ -0,0 +1,172 @@
+#include <audio-lib/wavefile.h>
+#include <string.h>
+#if defined PLATFORM_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE  // Format tag of the fmt chunks whose sub-format holds the actual format
+
+// Little-endian fields of the chunks, read a byte at a time so neither the alignment nor the byte order of the host matter
+static unsigned read_u16(const char* p)
+{
+	const unsigned char* b = (const unsigned char*)p;
+	return b[0] | (b[1] << 8);
+}
+
+static unsigned long read_u32(const char* p)
+{
+	const unsigned char* b = (const unsigned char*)p;
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned long)b[3] << 24);
+}
+
+// Walks the chunks of a RIFF wave for its fmt and data chunks, skipping the others (LIST, fact, ...)
+// The fields are read one by one, as WaveFmt and WAVEHeader hold longs, which are 8 bytes on 64-bit Unix
+// Returns false if either chunk is missing, the fmt chunk is too short, or the data chunk doesn't fit in the file
+static bool find_chunks(const char* view, size_t size, WaveFmt &fmt, size_t &data_offset, size_t &data_size)
+{
+	if(size < 12 || memcmp(view, "RIFF", 4) != 0 || memcmp(view + 8, "WAVE", 4) != 0)
+	{	return false;
+	}
+
+	bool has_fmt = false, has_data = false;
+	size_t pos = 12;
+
+	while(size - pos >= 8 && !(has_fmt && has_data))
+	{
+		const char* chunk = view + pos;
+		size_t length = read_u32(chunk + 4);
+		pos += 8;
+
+		if(memcmp(chunk, "fmt ", 4) == 0)
+		{	if(length < 16 || size - pos < length)
+			{	return false;
+			}
+
+			fmt.audioFormat   = (short)read_u16(chunk + 8);
+			fmt.numChannels   = (short)read_u16(chunk + 10);
+			fmt.sampleRate    = (long)read_u32(chunk + 12);
+			fmt.byteRate      = (long)read_u32(chunk + 16);
+			fmt.blockAlign    = (short)read_u16(chunk + 20);
+			fmt.bitsPerSample = (short)read_u16(chunk + 22);
+
+			// The sub-format GUID starts with the format tag of the samples
+			if((unsigned short)fmt.audioFormat == WAVE_FORMAT_EXTENSIBLE && length >= 40)
+			{	fmt.audioFormat = (short)read_u16(chunk + 32);
+			}
+
+			has_fmt = true;
+		}
+		else if(memcmp(chunk, "data", 4) == 0)
+		{	if(size - pos < length)
+			{	return false;
+			}
+
+			data_offset = pos;
+			data_size   = length;
+			has_data    = true;
+		}
+
+		// Chunks of an odd length are followed by a pad byte
+		if(size - pos < length + (length & 1))
+		{	break;
+		}
+
+		pos += length + (length & 1);
+	}
+
+	return has_fmt && has_data;
+}
+
+WaveFile::WaveFile()
+	: view(NULL), view_size(0), data(NULL), blocks(0)
+{
+}
+
+WaveFile::~WaveFile()
+{
+	close();
+}
+
+// Maps the file and validates its header
+// The data region is wherever the data chunk is, and must fit in the file
+bool WaveFile::open(const char* filename)
+{
+	close();
+
+#if defined PLATFORM_WINDOWS
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{	return false;
+	}
+
+	LARGE_INTEGER size;
+	mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	if(mapping == NULL)
+	{	CloseHandle(file);
+		return false;
+	}
+
+	view      = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	view_size = (size_t)size.QuadPart;
+	if(view == NULL)
+	{	CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+#elif defined PLATFORM_UNIX
+	int fd = ::open(filename, O_RDONLY);
+	if(fd == -1)
+	{	return false;
+	}
+
+	// The mapping keeps the file, which can be closed right away
+	struct stat st;
+	void* mapped = fstat(fd, &st) == 0 && st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	::close(fd);
+
+	if(mapped == MAP_FAILED)
+	{	return false;
+	}
+
+	view      = (char*)mapped;
+	view_size = (size_t)st.st_size;
+	madvise(view, view_size, MADV_SEQUENTIAL);
+#endif
+
+	// A data chunk is never at the start of the file, an offset of 0 means there is none
+	size_t data_offset = 0, data_size = 0;
+	if(!find_chunks(view, view_size, fmt, data_offset, data_size) || data_offset == 0 || getSampleType(fmt) == _Unsupported ||
+	   fmt.numChannels <= 0 || fmt.blockAlign != fmt.numChannels * fmt.bitsPerSample / 8)
+	{	close();
+		return false;
+	}
+
+	data   = view + data_offset;
+	blocks = data_size / fmt.blockAlign;
+	return true;
+}
+
+// Unmaps the file
+void WaveFile::close()
+{
+	if(view == NULL)
+	{	return;
+	}
+
+#if defined PLATFORM_WINDOWS
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+#elif defined PLATFORM_UNIX
+	munmap(view, view_size);
+#endif
+
+	view      = NULL;
+	view_size = 0;
+	data      = NULL;
+	blocks    = 0;
+}
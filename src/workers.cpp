@@ -0,0 +1,257 @@
+#include <audio-lib/workers.h>
+#include <cpthread/cpevent.h>
+#include <cpthread/cpmutex.h>
+#include <cpthread/cpthread.h>
+#include <thread>
+
+// Tasks waiting for a worker, linked through the tasks themselves
+struct WorkerQueue
+{	WorkerTask* first;			// Oldest task, run by the owner or stolen by another worker next
+	WorkerTask* last;			// Newest task, where the owner puts back the tasks it ran a step of
+	mutex lock;					// Lock of the owner, the stealing workers and the cancellations
+};
+
+// Workers and their queues, allocated with the first submission and never destroyed, as the workers
+// run until the process exits and would still wait on the signal while the static objects are destroyed
+struct WorkerPool
+{	WorkerQueue queues[MAX_CONVERSION_WORKERS];
+	thread threads[MAX_CONVERSION_WORKERS];
+	int count;							// Number of workers
+
+	signal wake;						// Wakes a worker waiting for tasks
+	std::atomic<int> queued;			// Tasks in all the queues
+	std::atomic<unsigned> next_queue;	// Queue of the next submission, spreading them over the workers
+};
+
+static std::atomic<WorkerPool*> worker_pool(NULL);
+static mutex start_lock;
+static int worker_count = 0;			// Number of workers set before they start, 0 for the default
+
+WorkerTask::WorkerTask(bool (*step)(void*), void* data)
+	: step(step), data(data), state(Task_Idle), cancelled(false), next(NULL)
+{
+}
+
+// One worker per processor, leaving one to the playback
+static int default_workers()
+{
+	int threads = (int)std::thread::hardware_concurrency() - 1;
+	return threads < 1 ? 1 : threads > MAX_CONVERSION_WORKERS ? MAX_CONVERSION_WORKERS : threads;
+}
+
+// Adds the task at the end of a queue
+static void push_task(WorkerPool* pool, int q, WorkerTask* task)
+{
+	WorkerQueue &queue = pool->queues[q];
+	queue.lock.lock();
+
+	task->next = NULL;
+	if(queue.last == NULL)
+	{	queue.first = task;
+	}
+	else
+	{	queue.last->next = task;
+	}
+	queue.last = task;
+
+	pool->queued.fetch_add(1);
+	queue.lock.unlock();
+}
+
+// Takes the oldest task of a queue, which is running from then on, NULL if the queue is empty
+static WorkerTask* pop_task(WorkerPool* pool, int q)
+{
+	WorkerQueue &queue = pool->queues[q];
+	queue.lock.lock();
+
+	WorkerTask* task = queue.first;
+	if(task != NULL)
+	{	queue.first = task->next;
+		if(queue.first == NULL)
+		{	queue.last = NULL;
+		}
+
+		task->state.store(Task_Running);
+		pool->queued.fetch_sub(1);
+	}
+
+	queue.lock.unlock();
+	return task;
+}
+
+// Takes a queued task out of the queue it waits in, returns false if no queue holds it
+static bool remove_task(WorkerPool* pool, WorkerTask* task)
+{
+	for(int q = 0; q < pool->count; q++)
+	{
+		WorkerQueue &queue = pool->queues[q];
+		queue.lock.lock();
+
+		WorkerTask* prev = NULL;
+		WorkerTask* curr = queue.first;
+		while(curr != NULL && curr != task)
+		{	prev = curr;
+			curr = curr->next;
+		}
+
+		if(curr != NULL)
+		{	(prev == NULL ? queue.first : prev->next) = task->next;
+			if(queue.last == task)
+			{	queue.last = prev;
+			}
+
+			task->state.store(Task_Idle);
+			pool->queued.fetch_sub(1);
+			queue.lock.unlock();
+			return true;
+		}
+
+		queue.lock.unlock();
+	}
+
+	return false;
+}
+
+// Runs the steps of the tasks of its queue in turns, and steals the oldest tasks of the other
+// queues once its own is empty, then waits for new submissions
+static THREAD worker_main(void* lparam)
+{
+	WorkerPool* pool = worker_pool.load(std::memory_order_acquire);
+	int self = (int)(size_t)lparam;
+	WorkerTask* task;
+	bool more;
+
+	while(true)
+	{
+		task = pop_task(pool, self);
+		for(int i = 1; task == NULL && i < pool->count; i++)
+		{	task = pop_task(pool, (self + i) % pool->count);
+		}
+
+		if(task == NULL)
+		{	pool->wake.wait();
+			continue;
+		}
+
+		// Other workers may be waiting while tasks are left, wake one up to take them
+		if(pool->queued.load() > 0)
+		{	pool->wake.set();
+		}
+
+		more = !task->cancelled.load() && task->step(task->data);
+
+		// A cancelled task is dropped, and no longer touched once idle
+		if(task->cancelled.load())
+		{	task->state.store(Task_Idle);
+			continue;
+		}
+
+		// The task goes back at the end of the queue while it has more to convert, or if it was submitted
+		// during the step, since the step may have missed the data of that submission
+		int running = Task_Running;
+		if(!more && task->state.compare_exchange_strong(running, Task_Idle))
+		{	continue;
+		}
+
+		task->state.store(Task_Queued);
+		push_task(pool, self, task);
+	}
+
+	return 0;
+}
+
+// Starts the workers on the first submission, and returns them
+static WorkerPool* start_workers()
+{
+	WorkerPool* pool = worker_pool.load(std::memory_order_acquire);
+	if(pool != NULL)
+	{	return pool;
+	}
+
+	start_lock.lock();
+
+	pool = worker_pool.load(std::memory_order_relaxed);
+	if(pool == NULL)
+	{	pool = new WorkerPool();
+		pool->count = worker_count != 0 ? worker_count : default_workers();
+		worker_pool.store(pool, std::memory_order_release);
+
+		for(int i = 0; i < pool->count; i++)
+		{	pool->threads[i].create(worker_main, (void*)(size_t)i);
+		}
+	}
+
+	start_lock.unlock();
+	return pool;
+}
+
+// Queues the task to run its steps until it has nothing left to convert
+// Does nothing if the task is already queued, and runs it again if a worker is running a step
+void submit_task(WorkerTask* task)
+{
+	int state = task->state.load();
+
+	while(true)
+	{
+		if(state == Task_Idle)
+		{	if(task->state.compare_exchange_weak(state, Task_Queued))
+			{	WorkerPool* pool = start_workers();
+				push_task(pool, pool->next_queue.fetch_add(1) % pool->count, task);
+				pool->wake.set();
+				return;
+			}
+		}
+		else if(state == Task_Running)
+		{	if(task->state.compare_exchange_weak(state, Task_Resubmitted))
+			{	return;
+			}
+		}
+		else
+		{	return;
+		}
+	}
+}
+
+// Takes the task out of the workers, waiting for the step a worker runs to finish
+// A queued task is removed from its queue, a running one is dropped by its worker after the step
+void cancel_task(WorkerTask* task)
+{
+	WorkerPool* pool = worker_pool.load(std::memory_order_acquire);
+	task->cancelled.store(true);
+
+	while(task->state.load() != Task_Idle)
+	{
+		// The pool is started before a task is pushed, but may not be yet if the task is about to be
+		pool = pool != NULL ? pool : worker_pool.load(std::memory_order_acquire);
+		if(pool != NULL && remove_task(pool, task))
+		{	break;
+		}
+
+		thread::sleep(1);
+	}
+
+	task->cancelled.store(false);
+}
+
+// Sets the number of worker threads, within 1 and MAX_CONVERSION_WORKERS
+void set_conversion_workers(int threads)
+{
+	start_lock.lock();
+
+	if(worker_pool.load(std::memory_order_relaxed) == NULL)
+	{	worker_count = threads < 1 ? 1 : threads > MAX_CONVERSION_WORKERS ? MAX_CONVERSION_WORKERS : threads;
+	}
+
+	start_lock.unlock();
+}
+
+// Returns the number of worker threads, started or to be started
+int get_conversion_workers()
+{
+	start_lock.lock();
+	WorkerPool* pool = worker_pool.load(std::memory_order_relaxed);
+	int threads = pool != NULL ? pool->count : worker_count != 0 ? worker_count : default_workers();
+	start_lock.unlock();
+
+	return threads;
+}
@@ -0,0 +1,204 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+// Accuracy of the normalised fixed-point coefficients against the division of the 64-bit accumulators they replaced
+// Each step converts a fixed tone and noise with a Rate Converter, and the same filters are convolved with the raw
+// Q32 coefficients of the designs, each output divided by the sum of the coefficients of its row as the converters
+// used to, so the outputs only differ by the rounding of the coefficients and of the outputs
+// The steps are the ones the plans of every quality tier give the conversions between the device rates, with the
+// taps, window and cutoff FormatConverter builds them with
+// Rounding instead of truncating the outputs accounts for up to one bit, the Q15 coefficients of the 8-bit samples
+// and the Q31 ones of the 16-bit samples add well under one bit more, even for the rows of thousands of taps
+// Fails if an output differs by more than MAX_ERROR, or if the mean difference exceeds MAX_MEAN_ERROR
+
+#define MAX_ERROR      3        // Largest difference of an output, in least significant bits
+#define MAX_MEAN_ERROR 1.25     // Largest mean absolute difference of the outputs, in least significant bits
+#define TEST_BLOCKS    9600     // Input blocks of each step, converted in 10ms buffers at 48kHz
+
+static const long device_rates[] = { 8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000 };
+
+// Step of a cascade, as a plan gives it and FormatConverter builds it
+struct TestStep
+{   size_t L;                   // Interpolation factor
+    size_t M;                   // Decimation factor
+    size_t taps;                // Filter size
+    FIRWindow window;           // Window of the filter
+    int cutoff;                 // Cutoff of the filter, in thousandths of the Nyquist frequency
+    bool half_band;             // Half-band stage
+};
+
+// Collects the distinct steps of the plans of every tier for the conversions between the device rates
+static std::vector<TestStep> plan_steps()
+{
+    std::vector<TestStep> steps;
+
+    for(int q = Quality_Fast; q <= Quality_Archival; q++)
+    {   const QualityPreset &preset = get_quality_preset((ResampleQuality)q);
+
+        for(size_t a = 0; a < sizeof(device_rates) / sizeof(device_rates[0]); a++)
+        {   for(size_t b = 0; b < sizeof(device_rates) / sizeof(device_rates[0]); b++)
+            {   if(a == b)
+                {   continue;
+                }
+
+                const ConversionPlan* plan = acquire_conversion_plan(makeWaveFmt(1, 16, device_rates[a]), makeWaveFmt(1, 16, device_rates[b]), (ResampleQuality)q);
+                for(int i = 0; !plan->resample && i < plan->step_count; i++)
+                {   TestStep step = { (size_t)plan->steps[i].L, (size_t)plan->steps[i].M, (size_t)plan->taps[i], preset.window, plan->cutoffs[i], plan->half_band[i] };
+
+                    bool known = false;
+                    for(size_t k = 0; k < steps.size() && !known; k++)
+                    {   known = steps[k].L == step.L && steps[k].M == step.M && steps[k].taps == step.taps &&
+                                steps[k].window == step.window && steps[k].cutoff == step.cutoff && steps[k].half_band == step.half_band;
+                    }
+                    if(!known)
+                    {   steps.push_back(step);
+                    }
+                }
+                release_conversion_plan(plan);
+            }
+        }
+    }
+
+    return steps;
+}
+
+// Samples of the wave at an index before its start, which is silence
+template<typename T>
+static llong sample_at(const std::vector<T> &wave, llong i)
+{
+    return i < 0 ? SampleTraits<T>::load(SampleTraits<T>::silence()) : SampleTraits<T>::load(wave[i]);
+}
+
+// Output of the division path, an accumulator of the Q32 coefficients divided by their sum, truncated and clamped
+template<typename T>
+static llong divide(llong acc, llong scale)
+{
+    llong low  = sizeof(T) == 1 ? 0 : -32768;
+    llong high = sizeof(T) == 1 ? 255 : 32767;
+    llong out  = acc / scale;
+    return out < low ? low : out > high ? high : out;
+}
+
+// Converts a mono wave through the division path of a converter's filters
+// Decimation convolves the whole filter with the newest taps blocks, every M blocks
+// Interpolation and non-integral conversions convolve a row of taps/L coefficients for each kept phase
+template<typename T>
+static std::vector<llong> convert_divided(const RateConverter &cnv, const std::vector<T> &wave)
+{
+    std::vector<llong> out;
+    size_t taps = cnv.decim_filter.size, L = cnv.L, M = cnv.M;
+
+    // Half-band filters of 4k-1 taps only keep the taps an odd distance from their centre, which weighs
+    // as much as all of them, and take a zero tap at their end, so both phases have 2k taps
+    std::vector<llong> filter(L > 1 ? cnv.inter_filter.coefs : cnv.decim_filter.coefs, (L > 1 ? cnv.inter_filter.coefs : cnv.decim_filter.coefs) + taps);
+    if(cnv.half_band)
+    {   llong pairs = 0;
+        for(size_t k = 0; k < taps; k++)
+        {   size_t distance = k > taps / 2 ? k - taps / 2 : taps / 2 - k;
+            filter[k] = distance % 2 == 1 ? filter[k] : 0;
+            pairs    += filter[k];
+        }
+        filter[taps / 2] = pairs;
+
+        if(L > 1)
+        {   filter.push_back(0);
+        }
+    }
+
+    const llong* inter = &filter[0];
+    const llong* decim = &filter[0];
+    size_t size = filter.size() / L;
+
+    if(L == 1)
+    {   llong scale = 0;
+        for(size_t k = 0; k < taps; k++)
+        {   scale += decim[k];
+        }
+
+        for(size_t i = M - 1; i < wave.size(); i += M)
+        {   llong acc = 0;
+            for(size_t k = 0; k < taps; k++)
+            {   acc += decim[k] * sample_at(wave, (llong)i - (llong)taps + 1 + (llong)k);
+            }
+            out.push_back(divide<T>(acc, scale));
+        }
+
+        return out;
+    }
+
+    size_t phase = 0;
+    for(size_t i = 0; i < wave.size(); i++)
+    {   for(; phase < L; phase += M)
+        {   size_t row = L - 1 - phase;
+            llong acc = 0, scale = 0;
+            for(size_t k = 0; k < size; k++)
+            {   acc   += inter[row + k * L] * sample_at(wave, (llong)i - (llong)size + 1 + (llong)k);
+                scale += inter[row + k * L];
+            }
+            out.push_back(divide<T>(acc, scale));
+        }
+        phase -= L;
+    }
+
+    return out;
+}
+
+// Converts a fixed mono wave through a step both ways and compares the outputs
+// Returns true if the differences stay within the bounds
+template<typename T>
+static bool test_step(const TestStep &step, SampleType type, const char* name)
+{
+    const double pi = 3.14159265358979323846;
+    double amplitude = sizeof(T) == 1 ? 100 : 26000, centre = sizeof(T) == 1 ? 128 : 0;
+
+    // A tone near the top of the band of the lowest rate, and noise
+    std::vector<T> wave(TEST_BLOCKS);
+    unsigned seed = 1;
+    for(size_t i = 0; i < wave.size(); i++)
+    {   seed = seed * 1103515245 + 12345;
+        double noise = ((int)(seed >> 16) % 2001 - 1000) / 1000.0;
+        wave[i] = (T)floor(centre + amplitude * (0.8 * sin(2 * pi * 0.07 * i) + 0.15 * noise) + 0.5);
+    }
+
+    RateConverter cnv(step.L, step.M, step.taps, 1, type, step.window, step.cutoff, step.half_band);
+    std::vector<T> converted(TEST_BLOCKS * step.L / step.M + 16);
+    size_t output = 0;
+    for(size_t done = 0; done < wave.size(); done += 480)
+    {   size_t count = wave.size() - done < 480 ? wave.size() - done : 480;
+        output += convert_sample_rate(&wave[done], &converted[output], count, cnv);
+    }
+
+    std::vector<llong> divided = convert_divided(cnv, wave);
+
+    llong worst = 0;
+    double total = 0;
+    for(size_t i = 0; i < output && i < divided.size(); i++)
+    {   llong diff = SampleTraits<T>::load(converted[i]) - divided[i];
+        diff   = diff < 0 ? -diff : diff;
+        worst  = diff > worst ? diff : worst;
+        total += diff;
+    }
+
+    double mean = total / output;
+    bool passed = output == divided.size() && worst <= MAX_ERROR && mean <= MAX_MEAN_ERROR;
+
+    printf("%-7s %4zu/%-4zu %5zu taps%s: %6zu outputs, max %lld LSB, mean %.3f LSB%s\n", name, step.L, step.M, step.taps,
+           step.half_band ? " half-band" : "", output, worst, mean, passed ? "" : output != divided.size() ? "  output count differs" : "  too inaccurate");
+
+    return passed;
+}
+
+int main()
+{
+    int failures = 0;
+    std::vector<TestStep> steps = plan_steps();
+
+    for(size_t s = 0; s < steps.size(); s++)
+    {   failures += !test_step<short>(steps[s], _Int16, "16-bit");
+        failures += !test_step<uchar>(steps[s], _UInt8, "8-bit");
+    }
+
+    return failures != 0;
+}
@@ -0,0 +1,140 @@
+#include <audio-lib/conversion.h>
+#include <stdio.h>
+#include <vector>
+
+// Overlap-save convolutions of the integer steps against the direct path of the same converters
+// Each step is sized long enough for the transforms, and converts the same noise twice, once through the
+// transforms and once with them taken away, alternating long buffers with short ones the direct path takes over
+// The limbs of the transforms round to the accumulators of the direct path, so the outputs must be the same
+// The conversions of the Archival tier are also run through FormatConverter both ways, as its steps get transforms
+// Fails if a step or conversion doesn't get its transforms, or if its outputs differ from the direct path's
+
+#define TEST_BLOCKS  48000      // Input blocks of each conversion
+#define LONG_BUFFER  4800       // Blocks of the buffers the transforms convert
+#define SHORT_BUFFER 37         // Blocks of the buffers too short for the transforms
+
+// Factors and taps for each unit of the factor of the tested steps, interpolations and decimations
+static const size_t test_steps[][3] = { { 2, 1, 512 }, { 3, 1, 512 }, { 6, 1, 512 }, { 1, 2, 1024 }, { 1, 3, 1024 } };
+
+// Rates of the conversions of the Archival tier, which its planner cascades into integer steps
+static const long test_rates[][2] = { { 16000, 48000 }, { 24000, 48000 }, { 48000, 16000 }, { 48000, 24000 } };
+
+// Sample types of the transforms
+struct TestType
+{   const char* name;           // Name of the samples
+    SampleType type;            // Type of the samples
+    size_t size;                // Bytes of a sample
+};
+
+static const TestType test_types[] =
+{   { "8-bit",  _UInt8, 1 },
+    { "16-bit", _Int16, 2 },
+    { "24-bit", _Int24, 3 },
+};
+
+// Converts n blocks of a type through a converter
+static int convert_blocks(const char* src, char* dst, size_t blocks, SampleType type, RateConverter &cnv)
+{
+    switch(type)
+    {   case _UInt8: return convert_sample_rate((const uchar*)src, (uchar*)dst, blocks, cnv);
+        case _Int24: return convert_sample_rate((const int24*)src, (int24*)dst, blocks, cnv);
+        default:     return convert_sample_rate((const short*)src, (short*)dst, blocks, cnv);
+    }
+}
+
+// Converts the noise through a converter in alternating long and short buffers, returns the output
+static std::vector<char> convert_all(RateConverter &cnv, const std::vector<char> &src, size_t block)
+{
+    std::vector<char> dst((TEST_BLOCKS * cnv.L / cnv.M + 16) * block);
+    size_t output = 0;
+    for(size_t done = 0, i = 0; done < TEST_BLOCKS; i++)
+    {   size_t count = i % 2 == 0 ? LONG_BUFFER : SHORT_BUFFER;
+        count = TEST_BLOCKS - done < count ? TEST_BLOCKS - done : count;
+        output += convert_blocks(&src[done * block], &dst[output * block], count, cnv.sample_type, cnv);
+        done += count;
+    }
+
+    dst.resize(output * block);
+    return dst;
+}
+
+// Converts the noise through a step both ways, returns true if the outputs are the same
+static bool test_step(const size_t* step, const TestType &type, size_t channels, const std::vector<char> &noise)
+{
+    size_t L = step[0], M = step[1];
+    size_t taps = ((L > M ? L : M) * step[2]) | 1;
+
+    RateConverter transformed(L, M, taps, channels, type.type, Window_Blackman);
+    RateConverter direct(L, M, taps, channels, type.type, Window_Blackman);
+
+    // Without its transform buffer, the converter runs the direct path
+    bool has_fft = transformed.fft_buffer != NULL;
+    delete[] direct.fft_buffer;
+    direct.fft_buffer = NULL;
+
+    std::vector<char> fft_output    = convert_all(transformed, noise, channels * type.size);
+    std::vector<char> direct_output = convert_all(direct, noise, channels * type.size);
+    bool passed = has_fft && fft_output == direct_output;
+
+    printf("%-7s %zu ch %zu/%zu %5zu taps: %7zu outputs%s\n", type.name, channels, L, M, taps, direct_output.size() / (channels * type.size),
+           !has_fft ? "  no transforms" : passed ? "" : "  differs from the direct path");
+
+    return passed;
+}
+
+// Converts the noise through a stereo conversion of the Archival tier both ways, returns true if the outputs are the same
+static bool test_conversion(const long* rates, const TestType &type, std::vector<char> &noise)
+{
+    WaveFmt in  = makeWaveFmt(2, type.size * 8, rates[0]);
+    WaveFmt out = makeWaveFmt(2, type.size * 8, rates[1]);
+    FormatConverter transformed(in, out, Quality_Archival);
+    FormatConverter direct(in, out, Quality_Archival);
+
+    // Without their transform buffers, the steps run the direct path
+    bool has_fft = false;
+    for(int i = 0; i < direct.step_count; i++)
+    {   has_fft = has_fft || transformed.sub_steps[i].fft_buffer != NULL;
+        delete[] direct.sub_steps[i].fft_buffer;
+        direct.sub_steps[i].fft_buffer = NULL;
+    }
+
+    size_t blocks = noise.size() / (2 * type.size);
+    std::vector<char> fft_output((blocks * rates[1] / rates[0] + transformed.max_output) * 2 * type.size);
+    std::vector<char> direct_output(fft_output.size());
+    int fft_count    = transformed.convert(&noise[0], &fft_output[0], blocks);
+    int direct_count = direct.convert(&noise[0], &direct_output[0], blocks);
+    bool passed = has_fft && fft_count == direct_count && fft_output == direct_output;
+
+    printf("%-7s 2 ch %5ld -> %-5ld %s: %7d outputs%s\n", type.name, rates[0], rates[1], get_quality_preset(Quality_Archival).name,
+           direct_count, !has_fft ? "  no transforms" : passed ? "" : "  differs from the direct path");
+
+    return passed;
+}
+
+int main()
+{
+    int failures = 0;
+
+    // Noise of scattered bytes, a valid sample of every integer type
+    std::vector<char> noise(TEST_BLOCKS * 3 * 3);
+    for(size_t i = 0; i < noise.size(); i++)
+    {   noise[i] = (char)((i * 2654435761u) >> 13);
+    }
+
+    for(size_t t = 0; t < sizeof(test_types) / sizeof(test_types[0]); t++)
+    {   for(size_t s = 0; s < sizeof(test_steps) / sizeof(test_steps[0]); s++)
+        {   for(size_t channels = 1; channels <= 3; channels++)
+            {   failures += !test_step(test_steps[s], test_types[t], channels, noise);
+            }
+        }
+    }
+
+    // 8-bit samples have a single limb, but their direct path is too fast for the transforms of the tier's steps
+    for(size_t t = 1; t < sizeof(test_types) / sizeof(test_types[0]); t++)
+    {   for(size_t r = 0; r < sizeof(test_rates) / sizeof(test_rates[0]); r++)
+        {   failures += !test_conversion(test_rates[r], test_types[t], noise);
+        }
+    }
+
+    return failures != 0;
+}
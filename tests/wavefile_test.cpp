@@ -0,0 +1,164 @@
+#include <audio-lib/wavefile.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Wave files written byte by byte as the specification lays them out, then mapped through WaveFile
+// The valid files must open with the format and data region they were written with, whatever chunks come
+// before the data, and the malformed ones must be rejected instead of mapping data past the end of the file
+// Fails if a valid file doesn't open as written, or if a malformed one opens
+
+#define TEST_FILE   "wavefile_test.wav"     // File written and opened by each case, in the working directory
+#define TEST_BLOCKS 1001                    // Blocks of the data chunk of each file
+
+// Chunks of the written files
+enum TestChunks
+{   Chunks_Plain,               // fmt and data only, the 44-byte header of most files
+    Chunks_Extensible,          // fmt of the extensible format, and a LIST chunk of an odd length before the data
+    Chunks_Fact,                // fact chunk between the fmt and data chunks, as float files have
+    Chunks_NoFmt,               // data without a fmt chunk
+    Chunks_NoData,              // fmt followed by the samples in a JUNK chunk, without a data chunk
+    Chunks_Truncated,           // data chunk longer than the file
+    Chunks_RIFX                 // big-endian RIFX header
+};
+
+// Files of each case
+struct TestFile
+{   const char* name;           // Name of the case
+    TestChunks chunks;          // Chunks of the file
+    short format;               // Format tag of the samples
+    short channels;             // Number of channels
+    short bits;                 // Bits of each sample
+    long rate;                  // Sampling rate
+    bool valid;                 // The file must open
+};
+
+static const TestFile test_files[] =
+{   { "16-bit stereo",            Chunks_Plain,      _PCM,       2, 16, 44100, true  },
+    { "24-bit 5.1 extensible",    Chunks_Extensible, _PCM,       6, 24, 48000, true  },
+    { "float mono with fact",     Chunks_Fact,       _IEEEFloat, 1, 32, 96000, true  },
+    { "8-bit mono",               Chunks_Plain,      _PCM,       1,  8, 8000,  true  },
+    { "no fmt chunk",             Chunks_NoFmt,      _PCM,       2, 16, 44100, false },
+    { "no data chunk",            Chunks_NoData,     _PCM,       2, 16, 44100, false },
+    { "truncated data",           Chunks_Truncated,  _PCM,       2, 16, 44100, false },
+    { "big-endian RIFX",          Chunks_RIFX,       _PCM,       2, 16, 44100, false },
+    { "12-bit samples",           Chunks_Plain,      _PCM,       1, 12, 44100, false },
+};
+
+// Appends little-endian fields and tags to the bytes of a file
+static void put16(std::vector<char> &out, unsigned value)
+{
+    out.push_back((char)(value & 0xFF));
+    out.push_back((char)(value >> 8));
+}
+
+static void put32(std::vector<char> &out, unsigned long value)
+{
+    put16(out, value & 0xFFFF);
+    put16(out, value >> 16);
+}
+
+static void put_tag(std::vector<char> &out, const char* tag)
+{
+    out.insert(out.end(), tag, tag + 4);
+}
+
+// Bytes of the file of a case, with the data chunk holding the given samples
+static std::vector<char> write_wave(const TestFile &test, const std::vector<char> &samples)
+{
+    std::vector<char> out;
+    short block = test.channels * test.bits / 8;
+
+    put_tag(out, test.chunks == Chunks_RIFX ? "RIFX" : "RIFF");
+    put32(out, 0);
+    put_tag(out, "WAVE");
+
+    if(test.chunks != Chunks_NoFmt)
+    {   bool extensible = test.chunks == Chunks_Extensible;
+        put_tag(out, "fmt ");
+        put32(out, extensible ? 40 : 16);
+        put16(out, extensible ? 0xFFFE : test.format);
+        put16(out, test.channels);
+        put32(out, test.rate);
+        put32(out, test.rate * block);
+        put16(out, block);
+        put16(out, test.bits);
+
+        // Size of the extension, valid bits, channel mask and sub-format GUID
+        if(extensible)
+        {   put16(out, 22);
+            put16(out, test.bits);
+            put32(out, 0x3F);
+            put16(out, test.format);
+            const char guid[] = "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71";
+            out.insert(out.end(), guid, guid + 14);
+
+            put_tag(out, "LIST");
+            put32(out, 5);
+            out.insert(out.end(), "INFO", "INFO" + 4);
+            out.push_back('x');
+            out.push_back(0);
+        }
+    }
+
+    if(test.chunks == Chunks_Fact)
+    {   put_tag(out, "fact");
+        put32(out, 4);
+        put32(out, TEST_BLOCKS);
+    }
+
+    put_tag(out, test.chunks == Chunks_NoData ? "JUNK" : "data");
+    put32(out, samples.size() + (test.chunks == Chunks_Truncated ? block : 0));
+    out.insert(out.end(), samples.begin(), samples.end());
+
+    // Size of the RIFF chunk
+    std::vector<char> riff;
+    put32(riff, out.size() - 8);
+    memcpy(&out[4], &riff[0], 4);
+    return out;
+}
+
+// Writes the file of a case and opens it, returns true if it opens as written, or is rejected if malformed
+static bool test_file(const TestFile &test)
+{
+    short block = test.channels * test.bits / 8;
+    std::vector<char> samples(TEST_BLOCKS * block);
+    for(size_t i = 0; i < samples.size(); i++)
+    {   samples[i] = (char)((i * 2654435761u) >> 13);
+    }
+
+    std::vector<char> bytes = write_wave(test, samples);
+    FILE* file = fopen(TEST_FILE, "wb");
+    if(file == NULL || fwrite(&bytes[0], 1, bytes.size(), file) != bytes.size())
+    {   printf("%-24s can't be written\n", test.name);
+        return false;
+    }
+    fclose(file);
+
+    WaveFile wave;
+    bool opened = wave.open(TEST_FILE);
+    bool passed = opened == test.valid;
+
+    if(opened && test.valid)
+    {   WaveFmt fmt = makeWaveFmt(test.channels, test.bits, test.rate, test.format);
+        passed = wave.fmt == fmt && wave.fmt.blockAlign == fmt.blockAlign && wave.fmt.byteRate == fmt.byteRate &&
+                 wave.blocks == TEST_BLOCKS && memcmp(wave.data, &samples[0], samples.size()) == 0;
+    }
+
+    printf("%-24s %s%s\n", test.name, opened ? "opened" : "rejected", passed ? "" : test.valid && opened ? "  differs from the file" : "  expected otherwise");
+
+    wave.close();
+    remove(TEST_FILE);
+    return passed;
+}
+
+int main()
+{
+    int failures = 0;
+
+    for(size_t i = 0; i < sizeof(test_files) / sizeof(test_files[0]); i++)
+    {   failures += !test_file(test_files[i]);
+    }
+
+    return failures != 0;
+}